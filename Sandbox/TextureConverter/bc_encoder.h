@@ -0,0 +1,371 @@
+#ifndef BC_ENCODER_H
+#define BC_ENCODER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Small block compressors for the formats the Sandbox loads. They favour simplicity over the last
+// bit of quality: endpoints come from the principal axis of each 4x4 block, indices are the nearest
+// palette entry. BC7 always uses mode 6 (one subset, RGBA, 4 bit indices), which is a good fit for
+// the smooth albedo textures the project has.
+
+enum BCFormat {
+    BC1, BC3, BC4, BC5, BC7
+};
+
+inline size_t bcBlockBytes(BCFormat format)
+{
+    return format == BC1 || format == BC4 ? 8 : 16;
+}
+
+namespace bc_detail
+{
+    // principal axis of count points of dimension dims, by power iteration on the covariance
+    inline void principalAxis(const float points[16][4], int count, int dims, float mean[4], float axis[4])
+    {
+        for (int d = 0; d < 4; d++)
+            mean[d] = 0.0f;
+        for (int i = 0; i < count; i++)
+            for (int d = 0; d < dims; d++)
+                mean[d] += points[i][d] / count;
+
+        float covariance[4][4] = {};
+        for (int i = 0; i < count; i++)
+            for (int a = 0; a < dims; a++)
+                for (int b = 0; b < dims; b++)
+                    covariance[a][b] += (points[i][a] - mean[a]) * (points[i][b] - mean[b]);
+
+        for (int d = 0; d < 4; d++)
+            axis[d] = d < dims ? 1.0f : 0.0f;
+        for (int iteration = 0; iteration < 8; iteration++)
+        {
+            float next[4] = {};
+            for (int a = 0; a < dims; a++)
+                for (int b = 0; b < dims; b++)
+                    next[a] += covariance[a][b] * axis[b];
+            float length = 0.0f;
+            for (int d = 0; d < dims; d++)
+                length += next[d] * next[d];
+            if (length < 1e-12f)
+                break;
+            length = std::sqrt(length);
+            for (int d = 0; d < dims; d++)
+                axis[d] = next[d] / length;
+        }
+    }
+
+    // the two points where the block's colours, projected on their principal axis, end
+    inline void fitEndpoints(const float points[16][4], int dims, float low[4], float high[4])
+    {
+        float mean[4], axis[4];
+        principalAxis(points, 16, dims, mean, axis);
+        float minT = 0.0f, maxT = 0.0f;
+        for (int i = 0; i < 16; i++)
+        {
+            float t = 0.0f;
+            for (int d = 0; d < dims; d++)
+                t += (points[i][d] - mean[d]) * axis[d];
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+        for (int d = 0; d < 4; d++)
+        {
+            low[d] = std::min(255.0f, std::max(0.0f, mean[d] + axis[d] * minT));
+            high[d] = std::min(255.0f, std::max(0.0f, mean[d] + axis[d] * maxT));
+        }
+    }
+
+    inline int nearest(const float point[4], const float palette[][4], int paletteSize, int dims)
+    {
+        int best = 0;
+        float bestError = 1e30f;
+        for (int p = 0; p < paletteSize; p++)
+        {
+            float error = 0.0f;
+            for (int d = 0; d < dims; d++)
+                error += (point[d] - palette[p][d]) * (point[d] - palette[p][d]);
+            if (error < bestError)
+            {
+                bestError = error;
+                best = p;
+            }
+        }
+        return best;
+    }
+
+    inline uint16_t to565(const float c[4])
+    {
+        int r = static_cast<int>(c[0] * 31.0f / 255.0f + 0.5f);
+        int g = static_cast<int>(c[1] * 63.0f / 255.0f + 0.5f);
+        int b = static_cast<int>(c[2] * 31.0f / 255.0f + 0.5f);
+        return static_cast<uint16_t>(r << 11 | g << 5 | b);
+    }
+    inline void from565(uint16_t c, float out[4])
+    {
+        int r = c >> 11 & 31, g = c >> 5 & 63, b = c & 31;
+        out[0] = static_cast<float>(r << 3 | r >> 2);
+        out[1] = static_cast<float>(g << 2 | g >> 4);
+        out[2] = static_cast<float>(b << 3 | b >> 2);
+        out[3] = 255.0f;
+    }
+
+    // 4 colour BC1 block, also the colour half of BC3
+    inline void encodeColorBlock(const float texels[16][4], unsigned char* out)
+    {
+        float low[4], high[4];
+        fitEndpoints(texels, 3, low, high);
+        uint16_t c0 = to565(high), c1 = to565(low);
+        if (c0 < c1)
+            std::swap(c0, c1);
+
+        uint32_t indices = 0;
+        if (c0 != c1)
+        {
+            float palette[4][4];
+            from565(c0, palette[0]);
+            from565(c1, palette[1]);
+            for (int d = 0; d < 3; d++)
+            {
+                palette[2][d] = (2.0f * palette[0][d] + palette[1][d]) / 3.0f;
+                palette[3][d] = (palette[0][d] + 2.0f * palette[1][d]) / 3.0f;
+            }
+            for (int i = 0; i < 16; i++)
+                indices |= static_cast<uint32_t>(nearest(texels[i], palette, 4, 3)) << (2 * i);
+        }
+        out[0] = c0 & 0xFF; out[1] = c0 >> 8;
+        out[2] = c1 & 0xFF; out[3] = c1 >> 8;
+        for (int b = 0; b < 4; b++)
+            out[4 + b] = static_cast<unsigned char>(indices >> (8 * b));
+    }
+
+    // BC4 block of one channel, also the alpha half of BC3 and each half of BC5
+    inline void encodeChannelBlock(const float texels[16][4], int channel, unsigned char* out)
+    {
+        float minValue = 255.0f, maxValue = 0.0f;
+        for (int i = 0; i < 16; i++)
+        {
+            minValue = std::min(minValue, texels[i][channel]);
+            maxValue = std::max(maxValue, texels[i][channel]);
+        }
+        int a0 = static_cast<int>(maxValue + 0.5f), a1 = static_cast<int>(minValue + 0.5f);
+
+        uint64_t indices = 0;
+        if (a0 != a1)
+        {
+            // a0 > a1 selects the 8 value mode: a0, a1 and six steps in between
+            float palette[8][4] = {};
+            palette[0][0] = static_cast<float>(a0);
+            palette[1][0] = static_cast<float>(a1);
+            for (int k = 2; k < 8; k++)
+                palette[k][0] = ((8 - k) * a0 + (k - 1) * a1) / 7.0f;
+            for (int i = 0; i < 16; i++)
+            {
+                float value[4] = { texels[i][channel], 0.0f, 0.0f, 0.0f };
+                indices |= static_cast<uint64_t>(nearest(value, palette, 8, 1)) << (3 * i);
+            }
+        }
+        out[0] = static_cast<unsigned char>(a0);
+        out[1] = static_cast<unsigned char>(a1);
+        for (int b = 0; b < 6; b++)
+            out[2 + b] = static_cast<unsigned char>(indices >> (8 * b));
+    }
+
+    // appends bits to a 128 bit block, least significant first
+    struct BitWriter {
+        unsigned char* out;
+        int position;
+
+        void write(uint32_t value, int bits)
+        {
+            for (int i = 0; i < bits; i++, position++)
+                if (value >> i & 1)
+                    out[position >> 3] |= static_cast<unsigned char>(1 << (position & 7));
+        }
+    };
+
+    // 7 bit endpoint channel plus the shared p-bit of the endpoint, chosen to fit best
+    inline void quantizeMode6Endpoint(const float endpoint[4], int channels[4], int& pBit)
+    {
+        pBit = 0;
+        for (int d = 0; d < 4; d++)
+            channels[d] = 0;
+        float bestError = 1e30f;
+        for (int p = 0; p < 2; p++)
+        {
+            int candidate[4];
+            float error = 0.0f;
+            for (int d = 0; d < 4; d++)
+            {
+                candidate[d] = std::min(127, std::max(0, static_cast<int>((endpoint[d] - p) / 2.0f + 0.5f)));
+                float value = static_cast<float>(candidate[d] << 1 | p);
+                error += (value - endpoint[d]) * (value - endpoint[d]);
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                pBit = p;
+                std::memcpy(channels, candidate, sizeof(candidate));
+            }
+        }
+    }
+
+    inline void encodeBC7Block(const float texels[16][4], unsigned char* out)
+    {
+        static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+        float low[4], high[4];
+        fitEndpoints(texels, 4, low, high);
+        int e[2][4], p[2];
+        quantizeMode6Endpoint(low, e[0], p[0]);
+        quantizeMode6Endpoint(high, e[1], p[1]);
+
+        float palette[16][4];
+        for (int w = 0; w < 16; w++)
+        {
+            for (int d = 0; d < 4; d++)
+            {
+                int a = e[0][d] << 1 | p[0], b = e[1][d] << 1 | p[1];
+                palette[w][d] = static_cast<float>(((64 - weights[w]) * a + weights[w] * b + 32) >> 6);
+            }
+        }
+        int indices[16];
+        for (int i = 0; i < 16; i++)
+            indices[i] = nearest(texels[i], palette, 16, 4);
+
+        // the first index is stored with its top bit implied zero, swap the endpoints if it is set
+        if (indices[0] & 8)
+        {
+            for (int d = 0; d < 4; d++)
+                std::swap(e[0][d], e[1][d]);
+            std::swap(p[0], p[1]);
+            for (int i = 0; i < 16; i++)
+                indices[i] = 15 - indices[i];
+        }
+
+        std::memset(out, 0, 16);
+        BitWriter bits = { out, 0 };
+        bits.write(1 << 6, 7); // mode 6
+        for (int d = 0; d < 4; d++)
+        {
+            bits.write(e[0][d], 7);
+            bits.write(e[1][d], 7);
+        }
+        bits.write(p[0], 1);
+        bits.write(p[1], 1);
+        bits.write(indices[0], 3);
+        for (int i = 1; i < 16; i++)
+            bits.write(indices[i], 4);
+    }
+}
+
+// compress one RGBA8 image (width * height * 4 bytes) into tightly packed blocks
+inline std::vector<unsigned char> encodeBC(const unsigned char* rgba, int width, int height, BCFormat format)
+{
+    using namespace bc_detail;
+    int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    size_t blockSize = bcBlockBytes(format);
+    std::vector<unsigned char> blocks(static_cast<size_t>(blocksX) * blocksY * blockSize);
+
+    for (int by = 0; by < blocksY; by++)
+    {
+        for (int bx = 0; bx < blocksX; bx++)
+        {
+            // edge blocks of sizes that are not a multiple of 4 repeat the last row/column
+            float texels[16][4];
+            for (int y = 0; y < 4; y++)
+            {
+                for (int x = 0; x < 4; x++)
+                {
+                    int sx = std::min(bx * 4 + x, width - 1), sy = std::min(by * 4 + y, height - 1);
+                    const unsigned char* texel = rgba + (static_cast<size_t>(sy) * width + sx) * 4;
+                    for (int d = 0; d < 4; d++)
+                        texels[y * 4 + x][d] = texel[d];
+                }
+            }
+
+            unsigned char* out = &blocks[(static_cast<size_t>(by) * blocksX + bx) * blockSize];
+            switch (format)
+            {
+            case BC1:
+                encodeColorBlock(texels, out);
+                break;
+            case BC3:
+                encodeChannelBlock(texels, 3, out);
+                encodeColorBlock(texels, out + 8);
+                break;
+            case BC4:
+                encodeChannelBlock(texels, 0, out);
+                break;
+            case BC5:
+                encodeChannelBlock(texels, 0, out);
+                encodeChannelBlock(texels, 1, out + 8);
+                break;
+            case BC7:
+                encodeBC7Block(texels, out);
+                break;
+            }
+        }
+    }
+    return blocks;
+}
+
+inline float srgbToLinear(float c)
+{
+    return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+inline float linearToSrgb(float c)
+{
+    return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+// next mip level of an RGBA8 image with a 2x2 box filter. srgb averages colour in linear light,
+// normalMap renormalises the tangent space normal stored in rgb
+inline std::vector<unsigned char> downsample(const std::vector<unsigned char>& rgba, int width, int height, bool srgb, bool normalMap)
+{
+    int outWidth = std::max(1, width / 2), outHeight = std::max(1, height / 2);
+    std::vector<unsigned char> out(static_cast<size_t>(outWidth) * outHeight * 4);
+    for (int y = 0; y < outHeight; y++)
+    {
+        for (int x = 0; x < outWidth; x++)
+        {
+            float sum[4] = {};
+            for (int dy = 0; dy < 2; dy++)
+            {
+                for (int dx = 0; dx < 2; dx++)
+                {
+                    int sx = std::min(x * 2 + dx, width - 1), sy = std::min(y * 2 + dy, height - 1);
+                    const unsigned char* texel = &rgba[(static_cast<size_t>(sy) * width + sx) * 4];
+                    for (int d = 0; d < 4; d++)
+                    {
+                        float value = texel[d] / 255.0f;
+                        if (normalMap && d < 3)
+                            value = value * 2.0f - 1.0f;
+                        else if (srgb && d < 3)
+                            value = srgbToLinear(value);
+                        sum[d] += value * 0.25f;
+                    }
+                }
+            }
+            if (normalMap)
+            {
+                float length = std::sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+                for (int d = 0; d < 3; d++)
+                    sum[d] = (length > 1e-6f ? sum[d] / length : (d == 2 ? 1.0f : 0.0f)) * 0.5f + 0.5f;
+            }
+            else if (srgb)
+            {
+                for (int d = 0; d < 3; d++)
+                    sum[d] = linearToSrgb(sum[d]);
+            }
+            unsigned char* texel = &out[(static_cast<size_t>(y) * outWidth + x) * 4];
+            for (int d = 0; d < 4; d++)
+                texel[d] = static_cast<unsigned char>(std::min(255.0f, std::max(0.0f, sum[d] * 255.0f + 0.5f)));
+        }
+    }
+    return out;
+}
+
+#endif
@@ -0,0 +1,183 @@
+// Offline converter from the PNG/JPG sources to block compressed DDS files with a full mip chain.
+// Every input is written next to itself with a .dds extension, which is where the Sandbox's
+// TextureLoader looks for it:
+//
+//   TextureConverter [--bc1|--bc3|--bc4|--bc5|--bc7] [--srgb] [--normal] [--no-mips] image...
+//
+// Without a format option it is picked per file: BC5 for files with "normal" in their name, BC4 for
+// single channel images (height/displacement maps) and BC7 for everything else. --srgb filters the
+// mips of colour textures in linear light; --normal renormalises normal map mips (implied for BC5).
+#include <stb/stb_image.h>
+
+#include "bc_encoder.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct ConvertOptions {
+    bool autoFormat;
+    BCFormat format;
+    bool srgb;
+    bool normalMap;
+    bool mipmaps;
+};
+
+static void put32(std::vector<unsigned char>& out, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+        out.push_back(static_cast<unsigned char>(value >> (8 * i)));
+}
+
+static uint32_t dxgiFormat(BCFormat format)
+{
+    switch (format)
+    {
+    case BC1: return 71; // DXGI_FORMAT_BC1_UNORM
+    case BC3: return 77; // DXGI_FORMAT_BC3_UNORM
+    case BC4: return 80; // DXGI_FORMAT_BC4_UNORM
+    case BC5: return 83; // DXGI_FORMAT_BC5_UNORM
+    default:  return 98; // DXGI_FORMAT_BC7_UNORM
+    }
+}
+
+// "DDS " magic, DDS_HEADER and DDS_HEADER_DXT10; the loader picks the sRGB variant at runtime
+static std::vector<unsigned char> ddsHeader(BCFormat format, int width, int height, size_t levels, size_t topLevelSize)
+{
+    std::vector<unsigned char> out;
+    out.insert(out.end(), { 'D', 'D', 'S', ' ' });
+    put32(out, 124);
+    put32(out, 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000); // CAPS | HEIGHT | WIDTH | PIXELFORMAT | MIPMAPCOUNT | LINEARSIZE
+    put32(out, height);
+    put32(out, width);
+    put32(out, static_cast<uint32_t>(topLevelSize));
+    put32(out, 0); // depth
+    put32(out, static_cast<uint32_t>(levels));
+    for (int i = 0; i < 11; i++)
+        put32(out, 0);
+    // DDS_PIXELFORMAT
+    put32(out, 32);
+    put32(out, 0x4); // DDPF_FOURCC
+    out.insert(out.end(), { 'D', 'X', '1', '0' });
+    for (int i = 0; i < 5; i++)
+        put32(out, 0);
+    put32(out, 0x1000 | (levels > 1 ? 0x400000 | 0x8 : 0)); // TEXTURE | MIPMAP | COMPLEX
+    for (int i = 0; i < 4; i++)
+        put32(out, 0);
+    // DDS_HEADER_DXT10
+    put32(out, dxgiFormat(format));
+    put32(out, 3); // D3D10_RESOURCE_DIMENSION_TEXTURE2D
+    put32(out, 0);
+    put32(out, 1); // array size
+    put32(out, 0);
+    return out;
+}
+
+static std::string outputPath(const std::string& input)
+{
+    size_t dot = input.find_last_of('.');
+    size_t slash = input.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return input + ".dds";
+    return input.substr(0, dot) + ".dds";
+}
+
+static bool convert(const std::string& input, ConvertOptions options)
+{
+    int width, height, components;
+    unsigned char* data = stbi_load(input.c_str(), &width, &height, &components, 4);
+    if (!data)
+    {
+        std::cout << "ERROR::TEXTURE_CONVERTER::CANNOT_LOAD " << input << ": " << stbi_failure_reason() << std::endl;
+        return false;
+    }
+    std::vector<unsigned char> level(data, data + static_cast<size_t>(width) * height * 4);
+    stbi_image_free(data);
+
+    if (options.autoFormat)
+    {
+        std::string name = input.substr(input.find_last_of("/\\") + 1);
+        if (name.find("normal") != std::string::npos)
+            options.format = BC5;
+        else if (components == 1)
+            options.format = BC4;
+        else
+            options.format = BC7;
+    }
+    if (options.format == BC5)
+        options.normalMap = true;
+
+    std::vector<unsigned char> blocks;
+    size_t levels = 0, topLevelSize = 0;
+    int w = width, h = height;
+    for (;;)
+    {
+        std::vector<unsigned char> encoded = encodeBC(level.data(), w, h, options.format);
+        if (levels == 0)
+            topLevelSize = encoded.size();
+        blocks.insert(blocks.end(), encoded.begin(), encoded.end());
+        levels++;
+        if (!options.mipmaps || (w == 1 && h == 1))
+            break;
+        level = downsample(level, w, h, options.srgb, options.normalMap);
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+
+    std::vector<unsigned char> file = ddsHeader(options.format, width, height, levels, topLevelSize);
+    file.insert(file.end(), blocks.begin(), blocks.end());
+
+    std::string output = outputPath(input);
+    FILE* out = std::fopen(output.c_str(), "wb");
+    bool written = out && std::fwrite(file.data(), 1, file.size(), out) == file.size();
+    if (out)
+        written = std::fclose(out) == 0 && written;
+    if (!written)
+    {
+        std::cout << "ERROR::TEXTURE_CONVERTER::CANNOT_WRITE " << output << std::endl;
+        return false;
+    }
+    static const char* const names[] = { "BC1", "BC3", "BC4", "BC5", "BC7" };
+    std::cout << input << " -> " << output << " (" << names[options.format] << ", " << width << "x" << height << ", " << levels << " levels, "
+              << file.size() / 1024 << " KiB)" << std::endl;
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    ConvertOptions options = { true, BC7, false, false, true };
+    std::vector<std::string> inputs;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--bc1")        { options.autoFormat = false; options.format = BC1; }
+        else if (arg == "--bc3")   { options.autoFormat = false; options.format = BC3; }
+        else if (arg == "--bc4")   { options.autoFormat = false; options.format = BC4; }
+        else if (arg == "--bc5")   { options.autoFormat = false; options.format = BC5; }
+        else if (arg == "--bc7")   { options.autoFormat = false; options.format = BC7; }
+        else if (arg == "--srgb")    options.srgb = true;
+        else if (arg == "--normal")  options.normalMap = true;
+        else if (arg == "--no-mips") options.mipmaps = false;
+        else if (arg.size() > 1 && arg[0] == '-')
+        {
+            std::cout << "unknown option " << arg << std::endl;
+            return 1;
+        }
+        else
+            inputs.push_back(arg);
+    }
+    if (inputs.empty())
+    {
+        std::cout << "usage: TextureConverter [--bc1|--bc3|--bc4|--bc5|--bc7] [--srgb] [--normal] [--no-mips] image..." << std::endl;
+        return 1;
+    }
+
+    int failed = 0;
+    for (size_t i = 0; i < inputs.size(); i++)
+        if (!convert(inputs[i], options))
+            failed++;
+    return failed == 0 ? 0 : 1;
+}
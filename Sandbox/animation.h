@@ -0,0 +1,168 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include </OpenGl programming/Sandbox/model_cache.h>
+#include </OpenGl programming/Sandbox/job_pool.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// a bone of a skinned model: the node it follows and the transform from the mesh's bind pose into
+// that node's space (Assimp's offset matrix)
+struct Bone {
+    int node;           // index into Model::nodes
+    glm::mat4 offset;
+};
+
+// everything needed to turn a pose of the node hierarchy into bone matrices
+struct Skeleton {
+    std::vector<Bone> bones;
+    std::unordered_map<std::string, unsigned int> boneIndex; // bone name -> index, what the vertices' m_BoneIDs refer to
+    // per mesh: the bone its vertices follow rigidly when they have no weights (meshes without bones just
+    // ride on their node), -1 for skinned meshes
+    std::vector<int> meshRigidBone;
+    glm::mat4 globalInverse; // of the root node, bone matrices are relative to the model's origin
+
+    Skeleton() : globalInverse(1.0f)
+    {
+    }
+
+    bool empty() const
+    {
+        return bones.empty();
+    }
+};
+
+struct VectorKey {
+    float time; // in ticks
+    glm::vec3 value;
+};
+struct RotationKey {
+    float time;
+    glm::quat value;
+};
+
+// the keys of one animated node; a track with no keys leaves that part of the node's bind transform alone
+struct NodeChannel {
+    int node;
+    std::vector<VectorKey> positions;
+    std::vector<RotationKey> rotations;
+    std::vector<VectorKey> scales;
+};
+
+struct AnimationClip {
+    std::string name;
+    float duration;       // in ticks
+    float ticksPerSecond;
+    std::vector<NodeChannel> channels;
+    std::vector<int> nodeChannel; // per node of the model, its channel or -1 to keep the bind transform
+};
+
+// one character playing a clip, placed in the world by transform
+struct AnimationState {
+    unsigned int clip;
+    float time;           // in seconds, the clip loops
+    glm::mat4 transform;
+};
+
+// Evaluates poses on the jobPool(): every character's node hierarchy is posed and turned into its bone
+// palette independently, so the characters spread over all cores. The palettes come out in world space
+// (the character's transform is folded in) and back to back, skeleton.bones.size() matrices each, which
+// is exactly what GpuSkinning uploads.
+class AnimationSampler
+{
+public:
+    std::vector<glm::mat4> palettes;
+
+    void sample(const std::vector<ModelNode>& nodes, const Skeleton& skeleton, const std::vector<AnimationClip>& clips,
+                const AnimationState* states, size_t count)
+    {
+        size_t boneCount = skeleton.bones.size();
+        size_t nodeCount = nodes.size();
+        palettes.resize(count * boneCount);
+        // one slice of scratch per character, so the jobs share nothing they write
+        globals.resize(count * nodeCount);
+        jobPool().parallelFor(count, [&](size_t i) {
+            const AnimationClip* clip = states[i].clip < clips.size() ? &clips[states[i].clip] : NULL;
+            pose(nodes, clip, states[i].time, &globals[i * nodeCount]);
+            const glm::mat4 root = states[i].transform * skeleton.globalInverse;
+            for (size_t b = 0; b < boneCount; b++)
+                palettes[i * boneCount + b] = root * globals[i * nodeCount + skeleton.bones[b].node] * skeleton.bones[b].offset;
+        });
+    }
+
+private:
+    std::vector<glm::mat4> globals;
+
+    // the model space transform of every node at time seconds into the clip; nodes are in pre-order, so a
+    // parent is always computed before its children
+    static void pose(const std::vector<ModelNode>& nodes, const AnimationClip* clip, float seconds, glm::mat4* global)
+    {
+        float ticks = 0.0f;
+        if (clip && clip->duration > 0.0f)
+            ticks = std::fmod(seconds * (clip->ticksPerSecond > 0.0f ? clip->ticksPerSecond : 25.0f), clip->duration);
+        for (size_t n = 0; n < nodes.size(); n++)
+        {
+            int channel = clip && n < clip->nodeChannel.size() ? clip->nodeChannel[n] : -1;
+            glm::mat4 local = channel >= 0 ? channelTransform(clip->channels[channel], ticks, nodes[n].transform) : nodes[n].transform;
+            global[n] = nodes[n].parent >= 0 ? global[nodes[n].parent] * local : local;
+        }
+    }
+
+    static glm::mat4 channelTransform(const NodeChannel& channel, float ticks, const glm::mat4& bind)
+    {
+        if (channel.positions.empty() && channel.rotations.empty() && channel.scales.empty())
+            return bind;
+        // a missing track keeps that part of the bind transform
+        glm::vec3 bindScale(glm::length(glm::vec3(bind[0])), glm::length(glm::vec3(bind[1])), glm::length(glm::vec3(bind[2])));
+        glm::vec3 position = channel.positions.empty() ? glm::vec3(bind[3]) : interpolate(channel.positions, ticks);
+        glm::quat rotation = channel.rotations.empty()
+            ? glm::quat_cast(glm::mat3(glm::vec3(bind[0]) / bindScale.x, glm::vec3(bind[1]) / bindScale.y, glm::vec3(bind[2]) / bindScale.z))
+            : interpolate(channel.rotations, ticks);
+        glm::vec3 scale = channel.scales.empty() ? bindScale : interpolate(channel.scales, ticks);
+        glm::mat4 transform = glm::mat4_cast(rotation);
+        transform[0] *= scale.x;
+        transform[1] *= scale.y;
+        transform[2] *= scale.z;
+        transform[3] = glm::vec4(position, 1.0f);
+        return transform;
+    }
+
+    // the key at or before ticks and the blend towards the next one
+    template <typename Key>
+    static size_t findKey(const std::vector<Key>& keys, float ticks, float& blend)
+    {
+        size_t next = std::upper_bound(keys.begin(), keys.end(), ticks, [](float t, const Key& key) { return t < key.time; }) - keys.begin();
+        if (next == 0 || next == keys.size())
+        {
+            blend = 0.0f;
+            return next == 0 ? 0 : keys.size() - 1;
+        }
+        float span = keys[next].time - keys[next - 1].time;
+        blend = span > 0.0f ? (ticks - keys[next - 1].time) / span : 0.0f;
+        return next - 1;
+    }
+
+    static glm::vec3 interpolate(const std::vector<VectorKey>& keys, float ticks)
+    {
+        float blend;
+        size_t i = findKey(keys, ticks, blend);
+        return blend > 0.0f ? glm::mix(keys[i].value, keys[i + 1].value, blend) : keys[i].value;
+    }
+
+    static glm::quat interpolate(const std::vector<RotationKey>& keys, float ticks)
+    {
+        float blend;
+        size_t i = findKey(keys, ticks, blend);
+        return blend > 0.0f ? glm::normalize(glm::slerp(keys[i].value, keys[i + 1].value, blend)) : keys[i].value;
+    }
+};
+
+#endif
@@ -0,0 +1,358 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <glm/glm.hpp>
+
+#include </OpenGl programming/Sandbox/camera.h>
+#include </OpenGl programming/Sandbox/gpu_profiler.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// One pose of a recorded camera path
+struct CameraKey {
+    float time;
+    glm::vec3 position;
+    float yaw;
+    float pitch;
+};
+
+// A camera path as a list of timed poses, replayed as a Catmull-Rom spline through them. Stored as
+// text, one "time x y z yaw pitch" line per key; F5 in the interactive mode records one.
+class CameraPath
+{
+public:
+    std::vector<CameraKey> keys;
+
+    bool load(const std::string& path)
+    {
+        std::ifstream file(path.c_str());
+        if (!file)
+        {
+            std::cout << "CameraPath: cannot read " << path << std::endl;
+            return false;
+        }
+        keys.clear();
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (line.empty() || line[0] == '#')
+                continue;
+            std::istringstream in(line);
+            CameraKey key;
+            if (in >> key.time >> key.position.x >> key.position.y >> key.position.z >> key.yaw >> key.pitch)
+                keys.push_back(key);
+        }
+        if (keys.empty())
+            std::cout << "CameraPath: " << path << " has no keys" << std::endl;
+        return !keys.empty();
+    }
+
+    bool save(const std::string& path) const
+    {
+        std::ofstream file(path.c_str());
+        if (!file)
+            return false;
+        file << "# time x y z yaw pitch\n";
+        for (size_t i = 0; i < keys.size(); i++)
+            file << keys[i].time << " " << keys[i].position.x << " " << keys[i].position.y << " " << keys[i].position.z << " "
+                 << keys[i].yaw << " " << keys[i].pitch << "\n";
+        return static_cast<bool>(file);
+    }
+
+    // appends the camera's pose if at least interval seconds passed since the last key
+    void record(float time, const Camera& camera, float interval = 0.25f)
+    {
+        if (!keys.empty() && time - keys.back().time < interval)
+            return;
+        CameraKey key = { time, camera.Position, camera.Yaw, camera.Pitch };
+        keys.push_back(key);
+    }
+
+    float duration() const
+    {
+        return keys.empty() ? 0.0f : keys.back().time - keys.front().time;
+    }
+
+    // the pose at time seconds into the path, clamped to its ends
+    void sample(float time, Camera& camera) const
+    {
+        if (keys.empty())
+            return;
+        float t = keys.front().time + time;
+        size_t i = 0;
+        while (i + 2 < keys.size() && keys[i + 1].time <= t)
+            i++;
+        if (keys.size() == 1 || t <= keys.front().time)
+        {
+            camera.SetPose(keys.front().position, keys.front().yaw, keys.front().pitch);
+            return;
+        }
+        const CameraKey& k0 = keys[i > 0 ? i - 1 : i];
+        const CameraKey& k1 = keys[i];
+        const CameraKey& k2 = keys[i + 1];
+        const CameraKey& k3 = keys[i + 2 < keys.size() ? i + 2 : i + 1];
+        float span = k2.time - k1.time;
+        float s = span > 0.0f ? (t - k1.time) / span : 1.0f;
+        s = s < 0.0f ? 0.0f : (s > 1.0f ? 1.0f : s);
+        camera.SetPose(catmullRom(k0.position, k1.position, k2.position, k3.position, s),
+                       catmullRom(k0.yaw, k1.yaw, k2.yaw, k3.yaw, s),
+                       catmullRom(k0.pitch, k1.pitch, k2.pitch, k3.pitch, s));
+    }
+
+    // a slow orbit around the scene, used when no path file is given
+    static CameraPath orbit(float seconds = 20.0f)
+    {
+        CameraPath path;
+        const int steps = 16;
+        for (int i = 0; i <= steps; i++)
+        {
+            float angle = glm::radians(360.0f * i / steps);
+            glm::vec3 target(2.0f, 1.5f, 2.0f);
+            glm::vec3 position = target + glm::vec3(cos(angle) * 9.0f, 2.0f + sin(angle * 2.0f), sin(angle) * 9.0f);
+            glm::vec3 front = glm::normalize(target - position);
+            // keep the yaw continuous so the spline does not swing the long way round at +-180
+            float yaw = glm::degrees(angle) + 180.0f;
+            CameraKey key = { seconds * i / steps, position, yaw, glm::degrees(asin(front.y)) };
+            path.keys.push_back(key);
+        }
+        return path;
+    }
+
+private:
+    template <typename T>
+    static T catmullRom(const T& p0, const T& p1, const T& p2, const T& p3, float t)
+    {
+        float t2 = t * t, t3 = t2 * t;
+        return 0.5f * ((2.0f * p1) + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 + (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+    }
+};
+
+// What one benchmark run renders. Read from a text file, one scenario per line:
+//   name frames pyramids models parallaxLayers [modelPath]
+// pyramids is the number of pyramid pairs of each program, models the instances of modelPath drawn.
+// parallaxLayers caps the layers the adaptive parallax march may take per pixel.
+struct BenchmarkScenario {
+    std::string name;
+    unsigned int frames;
+    unsigned int pyramids;
+    unsigned int models;
+    float parallaxLayers;
+    std::string modelPath;
+};
+
+inline std::vector<BenchmarkScenario> defaultBenchmarkScenarios()
+{
+    BenchmarkScenario scenarios[] = {
+        { "baseline", 600, 1, 0, 10.0f, "" },
+        { "pyramids_256", 600, 256, 0, 10.0f, "" },
+        { "pyramids_4096", 600, 4096, 0, 10.0f, "" },
+        { "parallax_32_layers", 600, 1, 0, 32.0f, "" }
+    };
+    return std::vector<BenchmarkScenario>(scenarios, scenarios + sizeof(scenarios) / sizeof(scenarios[0]));
+}
+
+inline bool loadBenchmarkScenarios(const std::string& path, std::vector<BenchmarkScenario>& scenarios)
+{
+    std::ifstream file(path.c_str());
+    if (!file)
+    {
+        std::cout << "Benchmark: cannot read " << path << std::endl;
+        return false;
+    }
+    scenarios.clear();
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream in(line);
+        BenchmarkScenario scenario;
+        if (!(in >> scenario.name >> scenario.frames >> scenario.pyramids >> scenario.models >> scenario.parallaxLayers))
+        {
+            std::cout << "Benchmark: bad scenario line \"" << line << "\"" << std::endl;
+            continue;
+        }
+        std::getline(in >> std::ws, scenario.modelPath);
+        scenarios.push_back(scenario);
+    }
+    return !scenarios.empty();
+}
+
+// Sandbox --benchmark [--scenarios file] [--camera file] [--out file]
+struct BenchmarkOptions {
+    bool enabled;
+    std::string scenarioFile; // empty runs defaultBenchmarkScenarios()
+    std::string cameraFile;   // empty flies CameraPath::orbit()
+    std::string output;
+    bool depthPrepass;        // run every scenario with the depth pre-pass on
+};
+
+inline bool parseBenchmarkOptions(int argc, char** argv, BenchmarkOptions& options)
+{
+    options.enabled = false;
+    options.output = "benchmark.json";
+    options.depthPrepass = false;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--benchmark")
+            options.enabled = true;
+        else if (arg == "--scenarios" && hasValue)
+            options.scenarioFile = argv[++i];
+        else if (arg == "--camera" && hasValue)
+            options.cameraFile = argv[++i];
+        else if (arg == "--out" && hasValue)
+            options.output = argv[++i];
+        else if (arg == "--prepass")
+            options.depthPrepass = true;
+        else
+        {
+            std::cout << "usage: Sandbox [--benchmark [--scenarios file] [--camera file] [--out file] [--prepass]]" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Runs the scenarios one after another on a fixed timestep and collects each one's frame timings,
+// the first WARMUP_FRAMES of every scenario are rendered but not counted.
+class BenchmarkRunner
+{
+public:
+    static const unsigned int WARMUP_FRAMES = 30;
+
+    std::vector<BenchmarkScenario> scenarios;
+    CameraPath path;
+    float timestep;
+
+    BenchmarkRunner() : timestep(1.0f / 60.0f), current(0), frameInScenario(0), firstFrame(0)
+    {
+    }
+
+    bool finished() const { return current >= scenarios.size(); }
+    const BenchmarkScenario& scenario() const { return scenarios[current]; }
+    // true on the first frame of each scenario, the caller applies its settings then
+    bool scenarioStarting() const { return frameInScenario == 0; }
+
+    // simulated seconds since the start of the scenario
+    float time() const { return frameInScenario * timestep; }
+
+    // poses the camera for this frame, call before the profiler's beginFrame
+    void beginFrame(Camera& camera, GpuProfiler& profiler)
+    {
+        if (frameInScenario == 0)
+        {
+            profiler.keepFrameTimings(true);
+            firstFrame = profiler.frameIndex() + WARMUP_FRAMES;
+        }
+        if (frameInScenario == WARMUP_FRAMES)
+            start = Clock::now();
+        // the path loops if the scenario outlasts it
+        float length = path.duration();
+        float t = time();
+        if (length > 0.0f)
+            t -= length * static_cast<float>(static_cast<int>(t / length));
+        path.sample(t, camera);
+    }
+
+    // call after the profiler's endFrame
+    void endFrame(GpuProfiler& profiler)
+    {
+        frameInScenario++;
+        if (frameInScenario < WARMUP_FRAMES + scenario().frames)
+            return;
+
+        // the wall clock stops before the flush, whose glFinish would otherwise count as a frame
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        profiler.flush();
+        std::vector<GpuProfiler::FrameTiming> frames;
+        profiler.takeFrames(frames);
+        profiler.keepFrameTimings(false);
+
+        Result result;
+        result.name = scenario().name;
+        result.seconds = seconds;
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+            if (frames[i].frame < firstFrame)
+                continue;
+            result.cpu.push_back(frames[i].cpuMs);
+            if (frames[i].gpuMs >= 0.0f)
+                result.gpu.push_back(frames[i].gpuMs);
+        }
+        std::cout << "Benchmark: " << result.name << " " << result.cpu.size() << " frames in " << seconds << " s" << std::endl;
+        results.push_back(result);
+        current++;
+        frameInScenario = 0;
+    }
+
+    bool writeJson(const std::string& file) const
+    {
+        FILE* out = std::fopen(file.c_str(), "w");
+        if (!out)
+        {
+            std::cout << "Benchmark: cannot write " << file << std::endl;
+            return false;
+        }
+        std::fprintf(out, "{\n  \"timestep\": %.6f,\n  \"scenarios\": [\n", timestep);
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const Result& r = results[i];
+            const BenchmarkScenario& s = scenarios[i];
+            std::fprintf(out, "    {\n      \"name\": \"%s\",\n      \"frames\": %u,\n      \"pyramids\": %u,\n      \"models\": %u,\n      \"parallaxLayers\": %.1f,\n",
+                         r.name.c_str(), static_cast<unsigned int>(r.cpu.size()), s.pyramids, s.models, s.parallaxLayers);
+            std::fprintf(out, "      \"seconds\": %.4f,\n      \"fps\": %.2f,\n", r.seconds, r.seconds > 0.0 ? r.cpu.size() / r.seconds : 0.0);
+            writeStats(out, "cpuFrameMs", r.cpu);
+            std::fprintf(out, ",\n");
+            writeStats(out, "gpuFrameMs", r.gpu);
+            std::fprintf(out, "\n    }%s\n", i + 1 < results.size() ? "," : "");
+        }
+        std::fprintf(out, "  ]\n}\n");
+        return std::fclose(out) == 0;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Result {
+        std::string name;
+        double seconds;
+        std::vector<float> cpu;
+        std::vector<float> gpu;
+    };
+
+    size_t current;
+    unsigned int frameInScenario;
+    uint64_t firstFrame;
+    Clock::time_point start;
+    std::vector<Result> results;
+
+    static void writeStats(FILE* out, const char* name, std::vector<float> values)
+    {
+        std::sort(values.begin(), values.end());
+        double sum = 0.0;
+        for (size_t i = 0; i < values.size(); i++)
+            sum += values[i];
+        std::fprintf(out, "      \"%s\": { \"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f }", name,
+                     values.empty() ? 0.0 : sum / values.size(), rank(values, 0.5), rank(values, 0.9), rank(values, 0.99),
+                     values.empty() ? 0.0 : values.back());
+    }
+
+    static double rank(const std::vector<float>& sorted, double p)
+    {
+        if (sorted.empty())
+            return 0.0;
+        return sorted[static_cast<size_t>(p * (sorted.size() - 1) + 0.5)];
+    }
+};
+
+#endif
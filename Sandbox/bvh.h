@@ -0,0 +1,573 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+
+#include </OpenGl programming/Sandbox/frustum.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+// Dynamic bounding volume hierarchy of axis aligned boxes, for scenes of 100k+ objects. Leaves are
+// inserted next to the sibling that grows the surface area heuristic cost least, a moved leaf keeps
+// its place and only refits its ancestors, and rebuild() rebuilds the whole tree top-down with a binned
+// SAH once the moves have loosened it (needsRebuild()). Each leaf carries an int the caller chooses.
+//
+//   int proxy = bvh.insert(boxMin, boxMax, objectIndex);
+//   bvh.update(proxy, movedMin, movedMax);
+//   bvh.queryFrustum(frustum, [&](int object) { ... });
+class BVH
+{
+public:
+    static const int NONE = -1;
+
+    BVH() : root(NONE), freeList(NONE), leafCount(0), builtCost(0.0f)
+    {
+    }
+
+    size_t size() const { return leafCount; }
+    bool empty() const { return root == NONE; }
+
+    // returns the leaf's proxy, stable until it is removed (rebuild() keeps it as well)
+    int insert(const glm::vec3& boundsMin, const glm::vec3& boundsMax, int userData)
+    {
+        int leaf = allocate();
+        Node& node = nodes[leaf];
+        node.boundsMin = boundsMin;
+        node.boundsMax = boundsMax;
+        node.userData = userData;
+        insertLeaf(leaf);
+        leafCount++;
+        return leaf;
+    }
+
+    void remove(int proxy)
+    {
+        removeLeaf(proxy);
+        release(proxy);
+        leafCount--;
+    }
+
+    // O(depth): the leaf takes the new box where it is and its ancestors grow or shrink around it
+    void update(int proxy, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+    {
+        nodes[proxy].boundsMin = boundsMin;
+        nodes[proxy].boundsMax = boundsMax;
+        refit(nodes[proxy].parent);
+    }
+
+    int userData(int proxy) const { return nodes[proxy].userData; }
+
+    // SAH cost: the summed surface of the inner nodes relative to the root's
+    float cost() const
+    {
+        if (root == NONE || isLeaf(root))
+            return 0.0f;
+        float rootArea = surface(nodes[root].boundsMin, nodes[root].boundsMax);
+        if (rootArea <= 0.0f)
+            return 0.0f;
+        float total = 0.0f;
+        std::vector<int>& stack = scratch;
+        stack.clear();
+        stack.push_back(root);
+        while (!stack.empty())
+        {
+            int index = stack.back();
+            stack.pop_back();
+            const Node& node = nodes[index];
+            if (isLeaf(index))
+                continue;
+            total += surface(node.boundsMin, node.boundsMax);
+            stack.push_back(node.left);
+            stack.push_back(node.right);
+        }
+        return total / rootArea;
+    }
+
+    // true when the tree costs noticeably more than right after the last rebuild(); O(n), so check
+    // it after a batch of moves rather than every frame
+    bool needsRebuild(float tolerance = 1.3f) const
+    {
+        return leafCount > 2 && (builtCost <= 0.0f || cost() > builtCost * tolerance);
+    }
+
+    // top-down binned SAH over the current leaves, proxies and user data stay as they are
+    void rebuild()
+    {
+        std::vector<int> leaves;
+        leaves.reserve(leafCount);
+        if (root != NONE)
+        {
+            scratch.clear();
+            scratch.push_back(root);
+            while (!scratch.empty())
+            {
+                int index = scratch.back();
+                scratch.pop_back();
+                if (isLeaf(index))
+                {
+                    leaves.push_back(index);
+                    continue;
+                }
+                scratch.push_back(nodes[index].left);
+                scratch.push_back(nodes[index].right);
+                release(index);
+            }
+        }
+        root = leaves.empty() ? NONE : build(leaves, 0, leaves.size());
+        if (root != NONE)
+            nodes[root].parent = NONE;
+        builtCost = cost();
+    }
+
+    // every leaf whose box is at least partly inside; a node fully inside a plane stops testing it,
+    // and one inside all six hands over its whole subtree untested
+    template <typename Visit>
+    void queryFrustum(const Frustum& frustum, Visit visit) const
+    {
+        if (root == NONE)
+            return;
+        std::vector<std::pair<int, unsigned int> > stack;
+        stack.push_back(std::make_pair(root, 0x3Fu));
+        while (!stack.empty())
+        {
+            int index = stack.back().first;
+            unsigned int planes = stack.back().second;
+            stack.pop_back();
+            const Node& node = nodes[index];
+
+            glm::vec3 center = (node.boundsMin + node.boundsMax) * 0.5f;
+            glm::vec3 extent = (node.boundsMax - node.boundsMin) * 0.5f;
+            bool outside = false;
+            for (int p = 0; p < 6 && !outside; p++)
+            {
+                if (!(planes & (1u << p)))
+                    continue;
+                const glm::vec4& plane = frustum.planes[p];
+                float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+                float radius = std::fabs(plane.x) * extent.x + std::fabs(plane.y) * extent.y + std::fabs(plane.z) * extent.z;
+                if (distance + radius < 0.0f)
+                    outside = true;
+                else if (distance - radius >= 0.0f)
+                    planes &= ~(1u << p);
+            }
+            if (outside)
+                continue;
+            if (planes == 0)
+                visitSubtree(index, visit);
+            else if (isLeaf(index))
+                visit(node.userData);
+            else
+            {
+                stack.push_back(std::make_pair(node.left, planes));
+                stack.push_back(std::make_pair(node.right, planes));
+            }
+        }
+    }
+
+    // every leaf whose box overlaps [boundsMin, boundsMax]
+    template <typename Visit>
+    void queryBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, Visit visit) const
+    {
+        if (root == NONE)
+            return;
+        std::vector<int> stack(1, root);
+        while (!stack.empty())
+        {
+            const Node& node = nodes[stack.back()];
+            int index = stack.back();
+            stack.pop_back();
+            if (!overlaps(node.boundsMin, node.boundsMax, boundsMin, boundsMax))
+                continue;
+            if (isLeaf(index))
+                visit(node.userData);
+            else
+            {
+                stack.push_back(node.left);
+                stack.push_back(node.right);
+            }
+        }
+    }
+
+    // closest hit along origin + t * direction for t in [0, distance]. test(userData, distance) is asked
+    // for every leaf whose box the ray enters before the best hit so far and returns its own hit t, or a
+    // negative value for a miss. Returns the user data of the hit (NONE without one), distance becomes its t.
+    template <typename Test>
+    int raycast(const glm::vec3& origin, const glm::vec3& direction, float& distance, Test test) const
+    {
+        int hit = NONE;
+        if (root == NONE)
+            return hit;
+        glm::vec3 inverse(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+        std::vector<int> stack(1, root);
+        while (!stack.empty())
+        {
+            int index = stack.back();
+            stack.pop_back();
+            const Node& node = nodes[index];
+            float entry;
+            if (!rayBox(origin, inverse, node.boundsMin, node.boundsMax, distance, entry))
+                continue;
+            if (isLeaf(index))
+            {
+                float t = test(node.userData, distance);
+                if (t >= 0.0f && t <= distance)
+                {
+                    distance = t;
+                    hit = node.userData;
+                }
+                continue;
+            }
+            // the nearer child goes on top so its hit can prune the farther one
+            float leftEntry, rightEntry;
+            bool left = rayBox(origin, inverse, nodes[node.left].boundsMin, nodes[node.left].boundsMax, distance, leftEntry);
+            bool right = rayBox(origin, inverse, nodes[node.right].boundsMin, nodes[node.right].boundsMax, distance, rightEntry);
+            if (left && right)
+            {
+                stack.push_back(leftEntry < rightEntry ? node.right : node.left);
+                stack.push_back(leftEntry < rightEntry ? node.left : node.right);
+            }
+            else if (left)
+                stack.push_back(node.left);
+            else if (right)
+                stack.push_back(node.right);
+        }
+        return hit;
+    }
+
+    // the k leaves whose boxes are closest to point (0 inside a box), nearest first, as
+    // {distance, userData}. Best-first: nodes are opened in order of their box distance and the
+    // search stops once the next one is farther than the k-th result.
+    void nearest(const glm::vec3& point, size_t k, std::vector<std::pair<float, int> >& out) const
+    {
+        out.clear();
+        if (root == NONE || k == 0)
+            return;
+        typedef std::pair<float, int> Entry; // squared distance, node (queue) or user data (results)
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > open;
+        std::priority_queue<Entry> best;
+        open.push(Entry(distanceSquared(point, nodes[root]), root));
+        while (!open.empty())
+        {
+            Entry next = open.top();
+            open.pop();
+            if (best.size() == k && next.first >= best.top().first)
+                break;
+            const Node& node = nodes[next.second];
+            if (isLeaf(next.second))
+            {
+                best.push(Entry(next.first, node.userData));
+                if (best.size() > k)
+                    best.pop();
+                continue;
+            }
+            open.push(Entry(distanceSquared(point, nodes[node.left]), node.left));
+            open.push(Entry(distanceSquared(point, nodes[node.right]), node.right));
+        }
+        out.resize(best.size());
+        for (size_t i = out.size(); i-- > 0; best.pop())
+            out[i] = Entry(std::sqrt(best.top().first), best.top().second);
+    }
+
+    void clear()
+    {
+        nodes.clear();
+        root = freeList = NONE;
+        leafCount = 0;
+        builtCost = 0.0f;
+    }
+
+private:
+    struct Node {
+        glm::vec3 boundsMin, boundsMax;
+        int parent;   // the next free node while on the free list
+        int left, right;
+        int userData; // leaves only
+    };
+
+    static const unsigned int BINS = 12;
+
+    std::vector<Node> nodes;
+    int root;
+    int freeList;
+    size_t leafCount;
+    float builtCost;
+    mutable std::vector<int> scratch;
+
+    bool isLeaf(int index) const { return nodes[index].left == NONE; }
+
+    int allocate()
+    {
+        int index;
+        if (freeList != NONE)
+        {
+            index = freeList;
+            freeList = nodes[index].parent;
+        }
+        else
+        {
+            index = static_cast<int>(nodes.size());
+            nodes.push_back(Node());
+        }
+        Node& node = nodes[index];
+        node.parent = node.left = node.right = NONE;
+        node.userData = NONE;
+        return index;
+    }
+
+    void release(int index)
+    {
+        nodes[index].parent = freeList;
+        nodes[index].left = nodes[index].right = NONE;
+        freeList = index;
+    }
+
+    static float surface(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+    {
+        glm::vec3 d = boundsMax - boundsMin;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    static bool overlaps(const glm::vec3& aMin, const glm::vec3& aMax, const glm::vec3& bMin, const glm::vec3& bMax)
+    {
+        return aMin.x <= bMax.x && aMax.x >= bMin.x && aMin.y <= bMax.y && aMax.y >= bMin.y && aMin.z <= bMax.z && aMax.z >= bMin.z;
+    }
+
+    // slab test, entry is where the ray enters the box (0 when it starts inside)
+    static bool rayBox(const glm::vec3& origin, const glm::vec3& inverse, const glm::vec3& boundsMin, const glm::vec3& boundsMax, float maxDistance, float& entry)
+    {
+        float tmin = 0.0f, tmax = maxDistance;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float t1 = (boundsMin[axis] - origin[axis]) * inverse[axis];
+            float t2 = (boundsMax[axis] - origin[axis]) * inverse[axis];
+            // NaN (a zero direction on the slab plane) never wins a min/max this way round
+            tmin = std::max(tmin, std::min(t1, t2));
+            tmax = std::min(tmax, std::max(t1, t2));
+        }
+        entry = tmin;
+        return tmin <= tmax;
+    }
+
+    static float distanceSquared(const glm::vec3& point, const Node& node)
+    {
+        glm::vec3 d = glm::max(glm::max(node.boundsMin - point, point - node.boundsMax), glm::vec3(0.0f));
+        return glm::dot(d, d);
+    }
+
+    void refit(int index)
+    {
+        while (index != NONE)
+        {
+            Node& node = nodes[index];
+            node.boundsMin = glm::min(nodes[node.left].boundsMin, nodes[node.right].boundsMin);
+            node.boundsMax = glm::max(nodes[node.left].boundsMax, nodes[node.right].boundsMax);
+            index = node.parent;
+        }
+    }
+
+    void insertLeaf(int leaf)
+    {
+        if (root == NONE)
+        {
+            root = leaf;
+            nodes[leaf].parent = NONE;
+            return;
+        }
+
+        // walk down while pushing the leaf into a child is cheaper than pairing it with the current node
+        glm::vec3 leafMin = nodes[leaf].boundsMin, leafMax = nodes[leaf].boundsMax;
+        int index = root;
+        while (!isLeaf(index))
+        {
+            const Node& node = nodes[index];
+            float area = surface(node.boundsMin, node.boundsMax);
+            float combined = surface(glm::min(node.boundsMin, leafMin), glm::max(node.boundsMax, leafMax));
+            float pairCost = 2.0f * combined;
+            float inherited = 2.0f * (combined - area); // every ancestor below here grows by this much
+            float leftCost = descendCost(node.left, leafMin, leafMax) + inherited;
+            float rightCost = descendCost(node.right, leafMin, leafMax) + inherited;
+            if (pairCost < leftCost && pairCost < rightCost)
+                break;
+            index = leftCost < rightCost ? node.left : node.right;
+        }
+
+        int sibling = index;
+        int oldParent = nodes[sibling].parent;
+        int parent = allocate(); // may move nodes, so no references are held across it
+        nodes[parent].parent = oldParent;
+        nodes[parent].left = sibling;
+        nodes[parent].right = leaf;
+        nodes[sibling].parent = parent;
+        nodes[leaf].parent = parent;
+        if (oldParent == NONE)
+            root = parent;
+        else if (nodes[oldParent].left == sibling)
+            nodes[oldParent].left = parent;
+        else
+            nodes[oldParent].right = parent;
+        refit(parent);
+    }
+
+    float descendCost(int child, const glm::vec3& leafMin, const glm::vec3& leafMax) const
+    {
+        const Node& node = nodes[child];
+        float combined = surface(glm::min(node.boundsMin, leafMin), glm::max(node.boundsMax, leafMax));
+        return isLeaf(child) ? combined : combined - surface(node.boundsMin, node.boundsMax);
+    }
+
+    void removeLeaf(int leaf)
+    {
+        if (leaf == root)
+        {
+            root = NONE;
+            return;
+        }
+        int parent = nodes[leaf].parent;
+        int grandParent = nodes[parent].parent;
+        int sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+        if (grandParent == NONE)
+        {
+            root = sibling;
+            nodes[sibling].parent = NONE;
+        }
+        else
+        {
+            if (nodes[grandParent].left == parent)
+                nodes[grandParent].left = sibling;
+            else
+                nodes[grandParent].right = sibling;
+            nodes[sibling].parent = grandParent;
+            refit(grandParent);
+        }
+        release(parent);
+    }
+
+    // subtree over leaves[begin, end), split where the binned SAH estimate is lowest
+    int build(std::vector<int>& leaves, size_t begin, size_t end)
+    {
+        if (end - begin == 1)
+            return leaves[begin];
+
+        glm::vec3 centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+        for (size_t i = begin; i < end; i++)
+        {
+            glm::vec3 c = centroid(leaves[i]);
+            centroidMin = glm::min(centroidMin, c);
+            centroidMax = glm::max(centroidMax, c);
+        }
+        glm::vec3 span = centroidMax - centroidMin;
+        int axis = span.x > span.y ? (span.x > span.z ? 0 : 2) : (span.y > span.z ? 1 : 2);
+
+        size_t middle = begin + (end - begin) / 2;
+        if (span[axis] > 0.0f)
+        {
+            unsigned int counts[BINS] = {};
+            glm::vec3 binMin[BINS], binMax[BINS];
+            for (unsigned int b = 0; b < BINS; b++)
+            {
+                binMin[b] = glm::vec3(FLT_MAX);
+                binMax[b] = glm::vec3(-FLT_MAX);
+            }
+            float scale = BINS / span[axis];
+            for (size_t i = begin; i < end; i++)
+            {
+                unsigned int b = bin(leaves[i], axis, centroidMin[axis], scale);
+                counts[b]++;
+                binMin[b] = glm::min(binMin[b], nodes[leaves[i]].boundsMin);
+                binMax[b] = glm::max(binMax[b], nodes[leaves[i]].boundsMax);
+            }
+
+            // sweep from the right for the cost of everything past each split, then from the left
+            float rightCost[BINS];
+            glm::vec3 accumulatedMin(FLT_MAX), accumulatedMax(-FLT_MAX);
+            unsigned int accumulated = 0;
+            for (unsigned int b = BINS - 1; b > 0; b--)
+            {
+                accumulated += counts[b];
+                accumulatedMin = glm::min(accumulatedMin, binMin[b]);
+                accumulatedMax = glm::max(accumulatedMax, binMax[b]);
+                rightCost[b] = accumulated ? accumulated * surface(accumulatedMin, accumulatedMax) : 0.0f;
+            }
+            float bestCost = FLT_MAX;
+            unsigned int bestSplit = 0;
+            accumulatedMin = glm::vec3(FLT_MAX);
+            accumulatedMax = glm::vec3(-FLT_MAX);
+            accumulated = 0;
+            for (unsigned int split = 1; split < BINS; split++)
+            {
+                accumulated += counts[split - 1];
+                accumulatedMin = glm::min(accumulatedMin, binMin[split - 1]);
+                accumulatedMax = glm::max(accumulatedMax, binMax[split - 1]);
+                if (accumulated == 0 || accumulated == end - begin)
+                    continue;
+                float splitCost = accumulated * surface(accumulatedMin, accumulatedMax) + rightCost[split];
+                if (splitCost < bestCost)
+                {
+                    bestCost = splitCost;
+                    bestSplit = split;
+                }
+            }
+            if (bestSplit > 0)
+            {
+                float origin = centroidMin[axis];
+                std::vector<int>::iterator cut = std::partition(leaves.begin() + begin, leaves.begin() + end, [&](int leaf) {
+                    return bin(leaf, axis, origin, scale) < bestSplit;
+                });
+                middle = static_cast<size_t>(cut - leaves.begin());
+            }
+        }
+        // all centroids in one spot: any split is as good, halve the range
+        if (middle == begin || middle == end)
+            middle = begin + (end - begin) / 2;
+
+        int left = build(leaves, begin, middle);
+        int right = build(leaves, middle, end);
+        int parent = allocate();
+        Node& node = nodes[parent];
+        node.left = left;
+        node.right = right;
+        node.boundsMin = glm::min(nodes[left].boundsMin, nodes[right].boundsMin);
+        node.boundsMax = glm::max(nodes[left].boundsMax, nodes[right].boundsMax);
+        nodes[left].parent = parent;
+        nodes[right].parent = parent;
+        return parent;
+    }
+
+    glm::vec3 centroid(int leaf) const
+    {
+        return (nodes[leaf].boundsMin + nodes[leaf].boundsMax) * 0.5f;
+    }
+
+    unsigned int bin(int leaf, int axis, float origin, float scale) const
+    {
+        int b = static_cast<int>((centroid(leaf)[axis] - origin) * scale);
+        return static_cast<unsigned int>(std::min(std::max(b, 0), static_cast<int>(BINS) - 1));
+    }
+
+    template <typename Visit>
+    void visitSubtree(int index, Visit& visit) const
+    {
+        std::vector<int> stack(1, index);
+        while (!stack.empty())
+        {
+            int i = stack.back();
+            stack.pop_back();
+            if (isLeaf(i))
+                visit(nodes[i].userData);
+            else
+            {
+                stack.push_back(nodes[i].left);
+                stack.push_back(nodes[i].right);
+            }
+        }
+    }
+};
+
+#endif
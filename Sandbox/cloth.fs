@@ -0,0 +1,15 @@
+#version 430 core
+out vec4 FragColor;
+
+#include <FrameData>
+
+in vec3 FragPos;
+in vec3 Normal;
+
+void main()
+{
+    // both sides of the flag are lit, the folds are what shows it moving
+    vec3 normal = normalize(gl_FrontFacing ? Normal : -Normal);
+    float diffuse = max(dot(normal, normalize(lightPos - FragPos)), 0.0);
+    FragColor = vec4(vec3(1.0, 0.0, 0.0) * (0.35 + 0.65 * diffuse), 1.0);
+}
@@ -0,0 +1,34 @@
+#version 430 core
+
+#include <FrameData>
+
+struct Particle {
+    vec4 position;
+    vec4 previous;
+};
+layout (std430, binding = 0) readonly buffer Particles {
+    Particle particles[];
+};
+
+uniform int columns;
+uniform int rows;
+
+out vec3 FragPos;
+out vec3 Normal;
+
+vec3 at(int x, int y)
+{
+    return particles[y * columns + x].position.xyz;
+}
+
+void main()
+{
+    // the particles are in world space already, the index buffer picks them by gl_VertexID
+    int x = gl_VertexID % columns;
+    int y = gl_VertexID / columns;
+    vec3 dx = at(min(x + 1, columns - 1), y) - at(max(x - 1, 0), y);
+    vec3 dy = at(x, min(y + 1, rows - 1)) - at(x, max(y - 1, 0));
+    FragPos = at(x, y);
+    Normal = normalize(cross(dx, dy));
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
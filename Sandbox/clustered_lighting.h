@@ -0,0 +1,168 @@
+#ifndef CLUSTERED_LIGHTING_H
+#define CLUSTERED_LIGHTING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include </OpenGl programming/Sandbox/gl_extensions.h>
+#include </OpenGl programming/Sandbox/gl_state_cache.h>
+#include </OpenGl programming/Sandbox/shader_s.h>
+#include </OpenGl programming/Sandbox/gbuffer.h>
+
+#include <cstddef>
+
+// one point light as the shaders read it from the LIGHT_BINDING buffer (std430):
+//
+//     struct PointLight { vec4 positionRadius; vec4 colorIntensity; };
+struct PointLight {
+    glm::vec4 positionRadius; // world position, and the distance at which the light has faded out completely
+    glm::vec4 colorIntensity; // linear color, and a multiplier on it
+};
+static_assert(sizeof(PointLight) == 32, "PointLight must match the std430 layout of the shaders' PointLight");
+
+// Clustered shading: the view frustum is cut into a 16x9 grid of screen tiles, each split into 24 depth
+// slices that grow exponentially with distance. A compute pass lists the lights touching every cluster,
+// and the lighting pass only loops over the list of the cluster a pixel falls in, so its cost follows the
+// lights that actually overlap the pixel instead of all of them.
+//
+// needs glCaps().computeShaders; the programs are owned by the caller (see cluster_bounds.comp,
+// light_cull.comp and deferred_lighting.vs/.fs).
+class ClusteredLighting
+{
+public:
+    // must match the constants in the three shaders
+    static const unsigned int CLUSTERS_X = 16;
+    static const unsigned int CLUSTERS_Y = 9;
+    static const unsigned int CLUSTERS_Z = 24;
+    static const unsigned int CLUSTER_COUNT = CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z;
+    static const unsigned int MAX_LIGHTS_PER_CLUSTER = 128; // further lights in a cluster are dropped
+    static const unsigned int CULL_GROUP_SIZE = 128;        // light_cull.comp local_size_x
+
+    unsigned int lightBuffer, boundsBuffer, countBuffer, indexBuffer;
+    unsigned int lightCount;
+
+    ClusteredLighting() : lightBuffer(0), boundsBuffer(0), countBuffer(0), indexBuffer(0), lightCount(0),
+        lightCapacity(0), emptyVAO(0), boundsValid(false), boundsProjection(1.0f), boundsNear(0.0f), boundsFar(0.0f)
+    {
+    }
+
+    // replace this frame's lights; the buffer grows to the largest count seen and is orphaned every upload
+    void setLights(const PointLight* lights, unsigned int count)
+    {
+        create();
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, lightBuffer);
+        if (count > lightCapacity)
+            lightCapacity = count;
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (lightCapacity > 0 ? lightCapacity : 1) * sizeof(PointLight), NULL, GL_STREAM_DRAW);
+        if (count > 0)
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(PointLight), lights);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        lightCount = count;
+    }
+
+    // assign the lights to clusters. the cluster boxes only depend on the projection, they are rebuilt
+    // when it changes (zoom, resize) and reused otherwise; the view comes from the FrameData block.
+    void cull(Shader& boundsProgram, Shader& cullProgram, const glm::mat4& projection, float zNear, float zFar)
+    {
+        create();
+        bindBuffers();
+        if (!boundsValid || projection != boundsProjection || zNear != boundsNear || zFar != boundsFar)
+        {
+            boundsProgram.use();
+            boundsProgram.setMat4("inverseProjection", glm::inverse(projection));
+            boundsProgram.setFloat("zNear", zNear);
+            boundsProgram.setFloat("zFar", zFar);
+            // one work group per slice, one invocation per tile
+            glDispatchCompute(1, 1, CLUSTERS_Z);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+            boundsValid = true;
+            boundsProjection = projection;
+            boundsNear = zNear;
+            boundsFar = zFar;
+        }
+
+        cullProgram.use();
+        cullProgram.setInt("lightCount", (int)lightCount);
+        glDispatchCompute((CLUSTER_COUNT + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    // shade every pixel the G-buffer covers into the bound framebuffer. it writes the G-buffer's depth as
+    // well, so forward passes drawn afterwards are depth tested against the deferred geometry; pixels
+    // nothing was drawn to are discarded and keep the clear color and depth.
+    void shade(Shader& lightingProgram, GBuffer& gbuffer, const glm::mat4& projection, const glm::mat4& view, float zNear, float zFar)
+    {
+        create();
+        bindBuffers();
+        lightingProgram.use();
+        lightingProgram.setMat4("inverseProjection", glm::inverse(projection));
+        lightingProgram.setMat4("inverseView", glm::inverse(view));
+        lightingProgram.setFloat("zNear", zNear);
+        lightingProgram.setFloat("zFar", zFar);
+        lightingProgram.setVec2("screenSize", (float)gbuffer.width, (float)gbuffer.height);
+        lightingProgram.setVec2("uvScale", (float)gbuffer.width / gbuffer.allocatedWidth, (float)gbuffer.height / gbuffer.allocatedHeight);
+        gbuffer.bindTextures(0);
+
+        GLStateCache& state = glState();
+        state.depthFunc(GL_ALWAYS);
+        state.bindVertexArray(emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        state.countDraw();
+        state.depthFunc(GL_LESS);
+    }
+
+    // delete the buffers, call before the context goes away
+    void release()
+    {
+        unsigned int buffers[4] = { lightBuffer, boundsBuffer, countBuffer, indexBuffer };
+        if (lightBuffer)
+            glDeleteBuffers(4, buffers);
+        if (emptyVAO)
+        {
+            glState().forgetVertexArray(emptyVAO);
+            glDeleteVertexArrays(1, &emptyVAO);
+        }
+        lightBuffer = boundsBuffer = countBuffer = indexBuffer = emptyVAO = 0;
+        lightCapacity = lightCount = 0;
+        boundsValid = false;
+    }
+
+private:
+    unsigned int lightCapacity;
+    unsigned int emptyVAO; // the fullscreen triangle is generated from gl_VertexID, core still wants a VAO bound
+    bool boundsValid;
+    glm::mat4 boundsProjection;
+    float boundsNear, boundsFar;
+
+    void create()
+    {
+        if (lightBuffer)
+            return;
+        glGenBuffers(1, &lightBuffer);
+        glGenBuffers(1, &boundsBuffer);
+        glGenBuffers(1, &countBuffer);
+        glGenBuffers(1, &indexBuffer);
+        allocate(boundsBuffer, CLUSTER_COUNT * 2 * sizeof(glm::vec4));
+        allocate(countBuffer, CLUSTER_COUNT * sizeof(GLuint));
+        allocate(indexBuffer, CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER * sizeof(GLuint));
+        allocate(lightBuffer, sizeof(PointLight));
+        glGenVertexArrays(1, &emptyVAO);
+    }
+
+    static void allocate(unsigned int buffer, size_t size)
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, size, NULL, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    void bindBuffers()
+    {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_BINDING, lightBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_BOUNDS_BINDING, boundsBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_LIGHT_COUNT_BINDING, countBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_LIGHT_INDEX_BINDING, indexBuffer);
+    }
+};
+
+#endif
@@ -0,0 +1,263 @@
+#ifndef COMMAND_BUFFER_H
+#define COMMAND_BUFFER_H
+
+#include <glm/glm.hpp>
+
+#include </OpenGl programming/Sandbox/model.h>
+#include </OpenGl programming/Sandbox/sort_key.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Hands out memory from large blocks and takes all of it back at once with reset(), which keeps the
+// blocks, so once the first frames have grown it recording allocates nothing.
+class CommandArena
+{
+public:
+    static const size_t BLOCK_SIZE = 64 * 1024;
+
+    CommandArena() : block(0), offset(0)
+    {
+    }
+
+    // alignment is a power of two no larger than alignof(std::max_align_t)
+    void* allocate(size_t size, size_t alignment)
+    {
+        for (;;)
+        {
+            if (block < blocks.size())
+            {
+                size_t start = (offset + alignment - 1) & ~(alignment - 1);
+                if (start + size <= blocks[block].size)
+                {
+                    offset = start + size;
+                    return blocks[block].data.get() + start;
+                }
+                block++;
+                offset = 0;
+                continue;
+            }
+            Block added;
+            added.size = size > BLOCK_SIZE ? size : BLOCK_SIZE;
+            added.data.reset(new char[added.size]);
+            blocks.push_back(std::move(added));
+        }
+    }
+
+    void reset()
+    {
+        block = 0;
+        offset = 0;
+    }
+
+private:
+    struct Block {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    std::vector<Block> blocks;
+    size_t block;  // being allocated from
+    size_t offset; // into it
+};
+
+// a recorded command: its sort key, what kind it is and its payload in the recording buffer's arena,
+// valid until that buffer is reset
+struct Command {
+    uint64_t key;
+    unsigned int type;
+    const void* data;
+};
+
+enum CommandType {
+    COMMAND_MODEL_INSTANCE = 0
+};
+
+// The commands one thread records in a frame. Payloads are plain structs placed in the buffer's own
+// arena and never destructed, reset() drops them all at once.
+class CommandBuffer
+{
+public:
+    template <typename T>
+    T& record(unsigned int type, uint64_t key)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "command payloads are never destructed");
+        T* data = new (arena.allocate(sizeof(T), alignof(T))) T;
+        Command command = { key, type, data };
+        commands.push_back(command);
+        return *data;
+    }
+
+    const std::vector<Command>& recorded() const
+    {
+        return commands;
+    }
+
+    void reset()
+    {
+        arena.reset();
+        commands.clear();
+    }
+
+private:
+    CommandArena arena;
+    std::vector<Command> commands;
+};
+
+// plays back a merged and sorted frame of commands; the commands say what is drawn, the backend how
+class CommandBackend
+{
+public:
+    virtual ~CommandBackend()
+    {
+    }
+
+    virtual void execute(const Command* commands, size_t count) = 0;
+};
+
+// Worker threads record into buffers of their own, which the context thread merges by key and hands to
+// a backend. Each job gets the buffer of its index, so no two threads ever share one and the merged
+// order does not depend on which thread happened to run which job.
+//
+//   recorder.begin(view, zNear, zFar, jobs);
+//   jobPool().parallelFor(jobs, [&](size_t job) { recorder.buffer(job).record<...>(type, key); });
+//   recorder.submit(backend);
+class CommandRecorder
+{
+public:
+    CommandRecorder() : active(0), view(1.0f), nearPlane(0.1f), farPlane(100.0f)
+    {
+    }
+
+    // start a frame with jobs empty buffers; depth keys are taken along the view direction between the clip planes
+    void begin(const glm::mat4& viewMatrix, float zNear, float zFar, size_t jobs)
+    {
+        view = viewMatrix;
+        nearPlane = zNear;
+        farPlane = zFar;
+        while (buffers.size() < jobs)
+            buffers.push_back(std::unique_ptr<CommandBuffer>(new CommandBuffer()));
+        for (size_t i = 0; i < buffers.size(); i++)
+            buffers[i]->reset();
+        active = jobs;
+    }
+
+    size_t jobCount() const
+    {
+        return active;
+    }
+
+    CommandBuffer& buffer(size_t job)
+    {
+        return *buffers[job];
+    }
+
+    // distance of a world position in front of the camera, quantized to 24 bits; safe from any thread
+    uint64_t depthBits(const glm::vec3& position) const
+    {
+        glm::vec4 viewPos = view * glm::vec4(position, 1.0f);
+        float depth = (-viewPos.z - nearPlane) / (farPlane - nearPlane);
+        depth = depth < 0.0f ? 0.0f : (depth > 1.0f ? 1.0f : depth);
+        return static_cast<uint64_t>(depth * 16777215.0f);
+    }
+
+    // merge the frame's buffers, sort them by key and play them back; from the context thread, after
+    // every job has finished recording
+    void submit(CommandBackend& backend)
+    {
+        merged.clear();
+        for (size_t i = 0; i < active; i++)
+            merged.insert(merged.end(), buffers[i]->recorded().begin(), buffers[i]->recorded().end());
+        sortByKey(merged, scratch);
+        backend.execute(merged.data(), merged.size());
+    }
+
+    // play the commands merged by the last submit() back again, e.g. once more after a depth pre-pass
+    void replay(CommandBackend& backend)
+    {
+        backend.execute(merged.data(), merged.size());
+    }
+
+    // commands merged by the last submit()
+    size_t size() const
+    {
+        return merged.size();
+    }
+
+private:
+    std::vector<std::unique_ptr<CommandBuffer> > buffers; // kept with their arenas from frame to frame
+    size_t active;
+    std::vector<Command> merged, scratch;
+    glm::mat4 view;
+    float nearPlane, farPlane;
+};
+
+// one instance of the meshes [firstMesh, firstMesh + meshCount) of a model at a level of detail
+struct ModelInstanceCommand {
+    Model* model;
+    unsigned int firstMesh;
+    unsigned int meshCount;
+    unsigned int lod;
+    glm::mat4 transform;
+
+    // 63..32 id of the mesh range | 31..28 level | 27..4 view depth, so each run of one range and level
+    // is one upload and one instanced draw per mesh, with its instances front-to-back
+    static uint64_t key(unsigned int rangeId, unsigned int lod, uint64_t depthBits)
+    {
+        return (static_cast<uint64_t>(rangeId) << 32) | (static_cast<uint64_t>(lod & 0xF) << 28) | ((depthBits & 0xFFFFFF) << 4);
+    }
+};
+
+// Plays commands back with GL on the context thread: the transforms of every run of ModelInstanceCommands
+// of one mesh range and level are uploaded once to the model's instance buffer, and each mesh of the range
+// draws them with a single Mesh::DrawUploadedInstances with program, whose vertex shader reads the
+// instance matrix.
+class GLCommandBackend : public CommandBackend
+{
+public:
+    Shader* program;
+
+    GLCommandBackend() : program(NULL), samplerProgram(0)
+    {
+    }
+
+    void execute(const Command* commands, size_t count)
+    {
+        if (count == 0 || !program)
+            return;
+        program->use();
+        if (samplerProgram != program->ID)
+        {
+            Mesh::SetSamplerUnits(*program);
+            samplerProgram = program->ID;
+        }
+        size_t i = 0;
+        while (i < count)
+        {
+            if (commands[i].type != COMMAND_MODEL_INSTANCE)
+            {
+                i++;
+                continue;
+            }
+            const ModelInstanceCommand& first = *static_cast<const ModelInstanceCommand*>(commands[i].data);
+            uint64_t batch = commands[i].key >> 28;
+            transforms.clear();
+            for (; i < count && commands[i].type == COMMAND_MODEL_INSTANCE && commands[i].key >> 28 == batch; i++)
+                transforms.push_back(static_cast<const ModelInstanceCommand*>(commands[i].data)->transform);
+            first.model->Instances().upload(transforms.data(), transforms.size());
+            for (unsigned int m = first.firstMesh; m < first.firstMesh + first.meshCount; m++)
+                first.model->meshes[m].DrawUploadedInstances(*program, transforms.size(), first.lod);
+        }
+    }
+
+private:
+    std::vector<glm::mat4> transforms;
+    unsigned int samplerProgram;
+};
+
+#endif
@@ -0,0 +1,334 @@
+#ifndef COMPRESSED_TEXTURE_H
+#define COMPRESSED_TEXTURE_H
+
+#include <glad/glad.h>
+
+#include </OpenGl programming/Sandbox/gl_extensions.h>
+
+#include <sys/stat.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Pre-compressed textures with their whole mip chain, read from DDS (legacy FourCC or DX10 header)
+// or KTX2 (no supercompression) files. Only the block formats the renderer uploads are accepted:
+// BC1, BC3, BC4, BC5 and BC7, 2D and single layer. TextureConverter writes them from the PNG/JPG
+// sources; the TextureLoader picks them up next to the source image.
+
+struct CompressedLevel {
+    unsigned int width;
+    unsigned int height;
+    size_t offset; // into CompressedTexture::data
+    size_t size;
+};
+
+struct CompressedTexture {
+    GLenum internalFormat; // 0 while nothing is loaded
+    std::vector<CompressedLevel> levels;
+    std::vector<unsigned char> data;
+
+    CompressedTexture() : internalFormat(0)
+    {
+    }
+};
+
+enum BlockFormat {
+    BLOCK_NONE, BLOCK_BC1, BLOCK_BC3, BLOCK_BC4, BLOCK_BC5, BLOCK_BC7
+};
+
+inline size_t blockBytes(BlockFormat format)
+{
+    return format == BLOCK_BC1 || format == BLOCK_BC4 ? 8 : 16;
+}
+
+// the GL format of a block format, sRGB is honoured where the format has an sRGB variant
+inline GLenum blockFormatToGL(BlockFormat format, bool srgb)
+{
+    switch (format)
+    {
+    case BLOCK_BC1: return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+    case BLOCK_BC3: return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case BLOCK_BC4: return GL_COMPRESSED_RED_RGTC1;
+    case BLOCK_BC5: return GL_COMPRESSED_RG_RGTC2;
+    case BLOCK_BC7: return srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+    default: return 0;
+    }
+}
+
+// whether the current context can sample the format, needs loadGLExtensions to have run
+inline bool compressedFormatSupported(GLenum internalFormat)
+{
+    const GLCapabilities& caps = glCaps();
+    switch (internalFormat)
+    {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        return caps.textureCompressionS3TC;
+    case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+        return caps.textureCompressionS3TCsRGB;
+    case GL_COMPRESSED_RED_RGTC1:
+    case GL_COMPRESSED_RG_RGTC2:
+        return true;
+    case GL_COMPRESSED_RGBA_BPTC_UNORM:
+    case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+        return caps.textureCompressionBPTC;
+    default:
+        return false;
+    }
+}
+
+namespace compressed_detail
+{
+    inline uint32_t read32(const unsigned char* p)
+    {
+        return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+    }
+    inline uint64_t read64(const unsigned char* p)
+    {
+        return uint64_t(read32(p)) | uint64_t(read32(p + 4)) << 32;
+    }
+    inline uint32_t fourCC(const char* code)
+    {
+        return uint32_t((unsigned char)code[0]) | uint32_t((unsigned char)code[1]) << 8 |
+               uint32_t((unsigned char)code[2]) << 16 | uint32_t((unsigned char)code[3]) << 24;
+    }
+
+    inline bool readFile(const std::string& path, std::vector<unsigned char>& bytes)
+    {
+        FILE* file = std::fopen(path.c_str(), "rb");
+        if (!file)
+            return false;
+        std::fseek(file, 0, SEEK_END);
+        long size = std::ftell(file);
+        std::fseek(file, 0, SEEK_SET);
+        bool ok = size > 0;
+        if (ok)
+        {
+            bytes.resize(static_cast<size_t>(size));
+            ok = std::fread(bytes.data(), 1, bytes.size(), file) == bytes.size();
+        }
+        std::fclose(file);
+        return ok;
+    }
+
+    // lay out a tightly packed mip chain starting at offset, false if it does not fit in fileSize
+    inline bool packedLevels(BlockFormat format, unsigned int width, unsigned int height, unsigned int count,
+                             size_t offset, size_t fileSize, std::vector<CompressedLevel>& levels)
+    {
+        for (unsigned int i = 0; i < count; i++)
+        {
+            CompressedLevel level;
+            level.width = width;
+            level.height = height;
+            level.offset = offset;
+            level.size = size_t((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+            if (level.size > fileSize || offset > fileSize - level.size)
+                return false;
+            levels.push_back(level);
+            offset += level.size;
+            width = width > 1 ? width / 2 : 1;
+            height = height > 1 ? height / 2 : 1;
+        }
+        return true;
+    }
+
+    inline BlockFormat dxgiBlockFormat(uint32_t dxgi)
+    {
+        switch (dxgi)
+        {
+        case 71: case 72: return BLOCK_BC1; // DXGI_FORMAT_BC1_UNORM(_SRGB)
+        case 77: case 78: return BLOCK_BC3; // DXGI_FORMAT_BC3_UNORM(_SRGB)
+        case 80:          return BLOCK_BC4; // DXGI_FORMAT_BC4_UNORM
+        case 83:          return BLOCK_BC5; // DXGI_FORMAT_BC5_UNORM
+        case 98: case 99: return BLOCK_BC7; // DXGI_FORMAT_BC7_UNORM(_SRGB)
+        default:          return BLOCK_NONE;
+        }
+    }
+
+    inline BlockFormat vkBlockFormat(uint32_t vk)
+    {
+        switch (vk)
+        {
+        case 131: case 132: case 133: case 134: return BLOCK_BC1; // VK_FORMAT_BC1_RGB(A)_UNORM/SRGB_BLOCK
+        case 137: case 138:                     return BLOCK_BC3; // VK_FORMAT_BC3_UNORM/SRGB_BLOCK
+        case 139:                               return BLOCK_BC4; // VK_FORMAT_BC4_UNORM_BLOCK
+        case 141:                               return BLOCK_BC5; // VK_FORMAT_BC5_UNORM_BLOCK
+        case 145: case 146:                     return BLOCK_BC7; // VK_FORMAT_BC7_UNORM/SRGB_BLOCK
+        default:                                return BLOCK_NONE;
+        }
+    }
+
+    inline BlockFormat parseDDS(const std::vector<unsigned char>& file, unsigned int& width, unsigned int& height,
+                                unsigned int& levelCount, size_t& dataOffset, std::string& error)
+    {
+        // "DDS " + 124 byte DDS_HEADER, optionally followed by the 20 byte DDS_HEADER_DXT10
+        if (file.size() < 128 || read32(&file[0]) != fourCC("DDS ") || read32(&file[4]) != 124)
+        {
+            error = "not a DDS file";
+            return BLOCK_NONE;
+        }
+        const unsigned char* header = &file[4];
+        height = read32(header + 8);
+        width = read32(header + 12);
+        levelCount = read32(header + 24);
+        if (levelCount == 0)
+            levelCount = 1;
+        uint32_t pixelFlags = read32(header + 76);
+        uint32_t code = read32(header + 80);
+        uint32_t caps2 = read32(header + 108);
+        dataOffset = 128;
+
+        if (caps2 & 0x200) // DDSCAPS2_CUBEMAP
+        {
+            error = "cubemap DDS files are not supported, store one face per file";
+            return BLOCK_NONE;
+        }
+        if (!(pixelFlags & 0x4)) // DDPF_FOURCC
+        {
+            error = "uncompressed DDS files are not supported";
+            return BLOCK_NONE;
+        }
+        if (code == fourCC("DX10"))
+        {
+            if (file.size() < 148)
+            {
+                error = "truncated DX10 header";
+                return BLOCK_NONE;
+            }
+            uint32_t dxgi = read32(&file[128]);
+            uint32_t dimension = read32(&file[132]);
+            uint32_t arraySize = read32(&file[140]);
+            dataOffset = 148;
+            if (dimension != 3 || arraySize > 1) // D3D10_RESOURCE_DIMENSION_TEXTURE2D
+            {
+                error = "only single 2D textures are supported";
+                return BLOCK_NONE;
+            }
+            BlockFormat format = dxgiBlockFormat(dxgi);
+            if (format == BLOCK_NONE)
+                error = "unsupported DXGI format " + std::to_string(dxgi);
+            return format;
+        }
+        if (code == fourCC("DXT1"))
+            return BLOCK_BC1;
+        if (code == fourCC("DXT5"))
+            return BLOCK_BC3;
+        if (code == fourCC("ATI1") || code == fourCC("BC4U"))
+            return BLOCK_BC4;
+        if (code == fourCC("ATI2") || code == fourCC("BC5U"))
+            return BLOCK_BC5;
+        error = "unsupported FourCC";
+        return BLOCK_NONE;
+    }
+}
+
+// reads a .dds or .ktx2 file, srgb selects the sRGB variant of colour formats. samplers still
+// have to check compressedFormatSupported(texture.internalFormat) before uploading it
+inline bool loadCompressedTexture(const std::string& path, bool srgb, CompressedTexture& texture, std::string& error)
+{
+    using namespace compressed_detail;
+    texture = CompressedTexture();
+
+    std::vector<unsigned char> file;
+    if (!readFile(path, file))
+    {
+        error = "cannot read file";
+        return false;
+    }
+
+    static const unsigned char ktx2Identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+    BlockFormat format;
+    std::vector<CompressedLevel> levels;
+    if (file.size() >= 80 && std::memcmp(&file[0], ktx2Identifier, sizeof(ktx2Identifier)) == 0)
+    {
+        const unsigned char* header = &file[12];
+        format = vkBlockFormat(read32(header));
+        unsigned int width = read32(header + 8), height = read32(header + 12);
+        uint32_t depth = read32(header + 16), layers = read32(header + 20), faces = read32(header + 24);
+        uint32_t levelCount = read32(header + 28), supercompression = read32(header + 32);
+        if (levelCount == 0)
+            levelCount = 1;
+        if (format == BLOCK_NONE)
+        {
+            error = "unsupported vkFormat";
+            return false;
+        }
+        if (supercompression != 0 || depth > 0 || layers > 0 || faces != 1)
+        {
+            error = "only single 2D textures without supercompression are supported";
+            return false;
+        }
+        if (file.size() < 80 + size_t(levelCount) * 24)
+        {
+            error = "truncated level index";
+            return false;
+        }
+        // the level index lists every mip level's offset and length, smallest levels usually come first in the file
+        for (uint32_t i = 0; i < levelCount; i++)
+        {
+            const unsigned char* entry = &file[80 + i * 24];
+            CompressedLevel level;
+            level.width = width >> i ? width >> i : 1;
+            level.height = height >> i ? height >> i : 1;
+            uint64_t offset = read64(entry), length = read64(entry + 8);
+            size_t expected = size_t((level.width + 3) / 4) * ((level.height + 3) / 4) * blockBytes(format);
+            if (length != expected || offset > file.size() || length > file.size() - offset)
+            {
+                error = "level " + std::to_string(i) + " is out of range";
+                return false;
+            }
+            level.offset = static_cast<size_t>(offset);
+            level.size = expected;
+            levels.push_back(level);
+        }
+    }
+    else
+    {
+        unsigned int width, height, levelCount;
+        size_t dataOffset;
+        format = parseDDS(file, width, height, levelCount, dataOffset, error);
+        if (format == BLOCK_NONE)
+            return false;
+        if (!packedLevels(format, width, height, levelCount, dataOffset, file.size(), levels))
+        {
+            error = "mip chain does not fit in the file";
+            return false;
+        }
+    }
+
+    texture.internalFormat = blockFormatToGL(format, srgb);
+    texture.levels = levels;
+    texture.data.swap(file);
+    return true;
+}
+
+// a converted .ktx2/.dds next to an image source (same name, other extension) that is at least as
+// new as the source, or the path itself if it already names one. empty if there is none
+inline std::string findCompressedTexture(const std::string& path)
+{
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return std::string();
+    std::string extension = path.substr(dot);
+    if (extension == ".dds" || extension == ".DDS" || extension == ".ktx2" || extension == ".KTX2")
+        return path;
+
+    struct stat source;
+    bool haveSource = stat(path.c_str(), &source) == 0;
+    const char* candidates[] = { ".ktx2", ".dds" };
+    for (int i = 0; i < 2; i++)
+    {
+        std::string candidate = path.substr(0, dot) + candidates[i];
+        struct stat converted;
+        if (stat(candidate.c_str(), &converted) == 0 && (!haveSource || converted.st_mtime >= source.st_mtime))
+            return candidate;
+    }
+    return std::string();
+}
+
+#endif
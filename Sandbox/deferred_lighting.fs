@@ -0,0 +1,87 @@
+#version 430 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+// must match ClusteredLighting
+const uvec3 CLUSTERS = uvec3(16, 9, 24);
+const uint MAX_LIGHTS_PER_CLUSTER = 128u;
+
+struct PointLight {
+    vec4 positionRadius;
+    vec4 colorIntensity;
+};
+layout (std430, binding = 0) readonly buffer LightBuffer {
+    PointLight lights[];
+};
+layout (std430, binding = 2) readonly buffer ClusterLightCounts {
+    uint lightCounts[];
+};
+layout (std430, binding = 3) readonly buffer ClusterLightIndices {
+    uint lightIndices[];
+};
+
+#include <FrameData>
+
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+
+uniform mat4 inverseProjection;
+uniform mat4 inverseView;
+uniform float zNear;
+uniform float zFar;
+uniform vec2 screenSize;
+// the part of the G-buffer rendered to this frame
+uniform vec2 uvScale;
+
+void main()
+{
+    vec2 uv = TexCoords * uvScale;
+    float depth = texture(gDepth, uv).r;
+    // nothing was drawn here, keep the clear color and depth for the skybox
+    if (depth == 1.0)
+        discard;
+
+    // rebuild the position from depth
+    vec4 viewPos = inverseProjection * vec4(TexCoords * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    viewPos /= viewPos.w;
+    vec3 fragPos = (inverseView * viewPos).xyz;
+
+    vec4 albedoSpecular = texture(gAlbedoSpecular, uv);
+    vec3 color = albedoSpecular.rgb;
+    vec3 normal = normalize(texture(gNormal, uv).xyz);
+    vec3 viewDir = normalize(cameraPos - fragPos);
+
+    // the cluster this pixel falls in, same slicing as cluster_bounds.comp
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / screenSize * vec2(CLUSTERS.xy)), CLUSTERS.xy - 1u);
+    float slice = log(-viewPos.z / zNear) * float(CLUSTERS.z) / log(zFar / zNear);
+    uint z = min(uint(max(slice, 0.0)), CLUSTERS.z - 1u);
+    uint cluster = tile.x + tile.y * CLUSTERS.x + z * CLUSTERS.x * CLUSTERS.y;
+
+    // ambient
+    vec3 lighting = 0.1 * color;
+    uint count = lightCounts[cluster];
+    for (uint i = 0u; i < count; i++)
+    {
+        PointLight light = lights[lightIndices[cluster * MAX_LIGHTS_PER_CLUSTER + i]];
+        vec3 toLight = light.positionRadius.xyz - fragPos;
+        float lightDistance = length(toLight);
+        float radius = light.positionRadius.w;
+        if (lightDistance >= radius)
+            continue;
+        vec3 lightDir = toLight / lightDistance;
+        // inverse square falloff windowed to reach exactly zero at the radius the light was culled with
+        float window = clamp(1.0 - pow(lightDistance / radius, 4.0), 0.0, 1.0);
+        float attenuation = window * window / (1.0 + lightDistance * lightDistance);
+        vec3 radiance = light.colorIntensity.rgb * light.colorIntensity.a * attenuation;
+
+        // Blinn-Phong, as in the forward parallax shader
+        float diff = max(dot(lightDir, normal), 0.0);
+        vec3 halfwayDir = normalize(lightDir + viewDir);
+        float spec = pow(max(dot(normal, halfwayDir), 0.0), 32.0);
+        lighting += (diff * color + albedoSpecular.a * spec) * radiance;
+    }
+    FragColor = vec4(lighting, 1.0);
+    gl_FragDepth = depth;
+}
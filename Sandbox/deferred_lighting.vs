@@ -0,0 +1,10 @@
+#version 430 core
+out vec2 TexCoords;
+
+void main()
+{
+    // one triangle covering the screen, made from the vertex id so no vertex buffer is needed
+    vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    TexCoords = position;
+    gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,14 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+#include <FrameData>
+
+uniform mat4 model;
+
+// the same expression as flagr.vs, invariant so every program rounds it the same way
+invariant gl_Position;
+
+void main()
+{
+    gl_Position = projection * view * model * vec4(aPos, 1.0);
+}
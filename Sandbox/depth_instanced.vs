@@ -0,0 +1,17 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 7) in mat4 aInstanceModel;
+
+#include <FrameData>
+
+// dequantization of VERTEX_QUANTIZED positions, set by Mesh around its draws; identity for everything else
+uniform vec3 positionScale = vec3(1.0);
+uniform vec3 positionBias = vec3(0.0);
+
+// the same expression as shader.vs and reflect.vs, invariant so every program rounds it the same way
+invariant gl_Position;
+
+void main()
+{
+    gl_Position = projection * view * aInstanceModel * vec4(aPos * positionScale + positionBias, 1.0);
+}
@@ -0,0 +1,265 @@
+#ifndef ENVIRONMENT_PROBE_H
+#define ENVIRONMENT_PROBE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include </OpenGl programming/Sandbox/gl_state_cache.h>
+#include </OpenGl programming/Sandbox/shader_s.h>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+
+// A small cubemap whose mip levels hold the environment blurred for increasingly rough surfaces: level 0
+// is a plain copy of the source, level n the reflection at roughness n / (LEVELS - 1). Shaders pick the
+// level with textureLod (see reflect.fs), so a sharp mirror and a rough one cost the same single fetch.
+//
+// prefilter() renders every face of every level with fullscreen.vs + prefilter.fs. Each level is built
+// from the one above it rather than from the source, which is half the resolution and already blurred,
+// so a few dozen GGX samples per pixel are enough; the lobe added per level is chosen so the widths add
+// up to the level's roughness, which is close to, if a little wider than, convolving the source directly.
+class EnvironmentMap
+{
+public:
+    static const int SIZE = 128;
+    static const int LEVELS = 6;        // 128 down to 4 texels a side
+    static const int SAMPLE_COUNT = 32; // per pixel for the blurred levels
+
+    unsigned int texture;
+
+    EnvironmentMap() : texture(0), FBO(0), emptyVAO(0)
+    {
+    }
+
+    // rebuild every level from the source cubemap; the source is only read at its base level
+    void prefilter(Shader& program, unsigned int source)
+    {
+        create();
+        GLStateCache& state = glState();
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        program.use();
+        program.setInt("source", 0);
+        state.bindVertexArray(emptyVAO);
+        glDisable(GL_DEPTH_TEST);
+        float previousAlpha = 0.0f;
+        for (int level = 0; level < LEVELS; level++)
+        {
+            float roughness = (float)level / (LEVELS - 1);
+            // GGX alpha is roughness squared, and the squared alphas of two blurs add up roughly
+            float alpha = roughness * roughness;
+            float addedAlpha = std::sqrt(std::max(alpha * alpha - previousAlpha * previousAlpha, 0.0f));
+            previousAlpha = alpha;
+            if (level == 0)
+                state.bindTexture(0, GL_TEXTURE_CUBE_MAP, source);
+            else
+            {
+                // only the level above may be sampled while this one is rendered to, or it is a feedback loop
+                state.bindTexture(0, GL_TEXTURE_CUBE_MAP, texture);
+                glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, level - 1);
+                glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, level - 1);
+            }
+            program.setFloat("roughness", std::sqrt(addedAlpha));
+            program.setInt("sampleCount", level == 0 ? 1 : SAMPLE_COUNT);
+            int size = SIZE >> level;
+            glViewport(0, 0, size, size);
+            for (int face = 0; face < 6; face++)
+            {
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, texture, level);
+                program.setInt("face", face);
+                glDrawArrays(GL_TRIANGLES, 0, 3);
+                state.countDraw();
+            }
+        }
+        state.bindTexture(0, GL_TEXTURE_CUBE_MAP, texture);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, LEVELS - 1);
+        glEnable(GL_DEPTH_TEST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // allocate the levels, prefilter() does it on first use; until then the texture name is 0
+    void create()
+    {
+        if (texture)
+            return;
+        glGenTextures(1, &texture);
+        glState().bindTexture(0, GL_TEXTURE_CUBE_MAP, texture);
+        for (int level = 0; level < LEVELS; level++)
+            for (int face = 0; face < 6; face++)
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_RGBA16F, SIZE >> level, SIZE >> level, 0, GL_RGBA, GL_HALF_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, LEVELS - 1);
+        glGenFramebuffers(1, &FBO);
+        glGenVertexArrays(1, &emptyVAO);
+    }
+
+    void release()
+    {
+        if (texture)
+        {
+            glState().forgetTexture(texture);
+            glDeleteTextures(1, &texture);
+        }
+        if (FBO)
+            glDeleteFramebuffers(1, &FBO);
+        if (emptyVAO)
+        {
+            glState().forgetVertexArray(emptyVAO);
+            glDeleteVertexArrays(1, &emptyVAO);
+        }
+        texture = FBO = emptyVAO = 0;
+    }
+
+private:
+    unsigned int FBO;
+    unsigned int emptyVAO; // the fullscreen triangle is generated from gl_VertexID, core still wants a VAO bound
+};
+
+// A cubemap of the scene as seen from a point, filtered into an EnvironmentMap for the reflective
+// objects near it. Capturing costs six scene renders, so it is spread out: while the probe is out of
+// date, update() renders one face per frame and prefilters once the sixth is done. Reflections keep
+// showing the previous capture until then, and a probe nothing marked dirty costs nothing at all.
+// Only what does not move belongs in a capture; anything animated would keep the probe dirty forever.
+class ReflectionProbe
+{
+public:
+    static const int SIZE = 128;
+    // renders the scene with this view and projection into the bound framebuffer, which is cleared already
+    typedef std::function<void(const glm::mat4& view, const glm::mat4& projection)> RenderFace;
+
+    glm::vec3 position;
+    float zNear, zFar;
+    EnvironmentMap environment;
+
+    explicit ReflectionProbe(const glm::vec3& position, float zNear = 0.1f, float zFar = 100.0f) : position(position), zNear(zNear), zFar(zFar),
+        capture(0), FBO(0), depth(0), dirty(true), captured(false), nextFace(0)
+    {
+    }
+
+    // the surroundings changed; capturing starts over, faces rendered before the change are stale
+    void markDirty()
+    {
+        dirty = true;
+        nextFace = 0;
+    }
+
+    bool needsUpdate() const
+    {
+        return dirty;
+    }
+
+    // true once environment holds a complete capture
+    bool ready() const
+    {
+        return captured;
+    }
+
+    // render the next face when out of date; the caller binds its own framebuffer and viewport again afterwards
+    void update(Shader& prefilterProgram, const RenderFace& renderFace)
+    {
+        if (!dirty || !create())
+            return;
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + nextFace, capture, 0);
+        glViewport(0, 0, SIZE, SIZE);
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        renderFace(faceView(nextFace), faceProjection());
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        if (++nextFace < 6)
+            return;
+        environment.prefilter(prefilterProgram, capture);
+        nextFace = 0;
+        dirty = false;
+        captured = true;
+    }
+
+    // the view looking down a face, oriented the way GL lays out cubemap faces
+    glm::mat4 faceView(int face) const
+    {
+        static const glm::vec3 directions[6] = {
+            glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+            glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+            glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)
+        };
+        static const glm::vec3 ups[6] = {
+            glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+            glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f),
+            glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)
+        };
+        return glm::lookAt(position, position + directions[face], ups[face]);
+    }
+
+    glm::mat4 faceProjection() const
+    {
+        return glm::perspective(glm::radians(90.0f), 1.0f, zNear, zFar);
+    }
+
+    void release()
+    {
+        environment.release();
+        if (capture)
+        {
+            glState().forgetTexture(capture);
+            glDeleteTextures(1, &capture);
+        }
+        if (depth)
+            glDeleteRenderbuffers(1, &depth);
+        if (FBO)
+            glDeleteFramebuffers(1, &FBO);
+        capture = depth = FBO = 0;
+        captured = false;
+    }
+
+private:
+    unsigned int capture; // RGBA16F, the faces are rendered here and only read by prefilter()
+    unsigned int FBO;
+    unsigned int depth;
+    bool dirty;
+    bool captured;
+    int nextFace;
+
+    bool create()
+    {
+        if (FBO)
+            return true;
+        glGenTextures(1, &capture);
+        glState().bindTexture(0, GL_TEXTURE_CUBE_MAP, capture);
+        for (int face = 0; face < 6; face++)
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGBA16F, SIZE, SIZE, 0, GL_RGBA, GL_HALF_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, 0);
+
+        glGenFramebuffers(1, &FBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glGenRenderbuffers(1, &depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, SIZE, SIZE);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X, capture, 0);
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (!complete)
+        {
+            std::cout << "ReflectionProbe: framebuffer not complete" << std::endl;
+            release();
+            dirty = false;
+        }
+        return complete;
+    }
+};
+
+#endif
@@ -1,3 +1,14 @@
-version https://git-lfs.github.com/spec/v1
-oid sha256:0c938500b81b08c7f875090936a9fb6661f23982f978cb648b9363fb055a3fe7
-size 209
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+#include <FrameData>
+
+uniform mat4 model;
+
+// must come out bit-identical in depth.vs for the GL_EQUAL pass after the depth pre-pass
+invariant gl_Position;
+
+void main()
+{
+    gl_Position = projection * view * model * vec4(aPos, 1.0);
+}
@@ -0,0 +1,173 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define FRUSTUM_AVX 1
+#endif
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FRUSTUM_SSE 1
+#endif
+
+// The six planes of a view frustum, normals pointing inwards and normalized so w is a distance
+struct Frustum {
+    glm::vec4 planes[6]; // left, right, bottom, top, near, far
+
+    // Gribb/Hartmann: the planes are sums and differences of the rows of projection * view
+    static Frustum fromMatrix(const glm::mat4& viewProjection)
+    {
+        const glm::mat4& m = viewProjection;
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+        Frustum frustum;
+        frustum.planes[0] = row3 + row0;
+        frustum.planes[1] = row3 - row0;
+        frustum.planes[2] = row3 + row1;
+        frustum.planes[3] = row3 - row1;
+        frustum.planes[4] = row3 + row2;
+        frustum.planes[5] = row3 - row2;
+        for (int i = 0; i < 6; i++)
+            frustum.planes[i] /= glm::length(glm::vec3(frustum.planes[i]));
+        return frustum;
+    }
+
+    // conservative: boxes crossing a corner outside two planes still count as visible
+    bool intersects(const glm::vec3& center, const glm::vec3& extent) const
+    {
+        for (int i = 0; i < 6; i++)
+        {
+            const glm::vec4& p = planes[i];
+            float distance = p.x * center.x + p.y * center.y + p.z * center.z + p.w;
+            float radius = std::fabs(p.x) * extent.x + std::fabs(p.y) * extent.y + std::fabs(p.z) * extent.z;
+            if (distance + radius < 0.0f)
+                return false;
+        }
+        return true;
+    }
+};
+
+// world space center/half-extent box around an object space AABB moved by transform (Arvo)
+inline void transformBounds(const glm::mat4& transform, const glm::vec3& boundsMin, const glm::vec3& boundsMax, glm::vec3& center, glm::vec3& extent)
+{
+    glm::vec3 localCenter = (boundsMin + boundsMax) * 0.5f;
+    glm::vec3 localExtent = (boundsMax - boundsMin) * 0.5f;
+    center = glm::vec3(transform * glm::vec4(localCenter, 1.0f));
+    for (int row = 0; row < 3; row++)
+        extent[row] = std::fabs(transform[0][row]) * localExtent.x + std::fabs(transform[1][row]) * localExtent.y + std::fabs(transform[2][row]) * localExtent.z;
+}
+
+// Boxes stored as structure-of-arrays so the plane tests run on 8 (AVX) or 4 (SSE) boxes per
+// instruction. Fill it with the frame's candidates, then cull once; add() returns the index the
+// box's result is found at.
+class FrustumCuller
+{
+public:
+    void clear()
+    {
+        cx.clear(); cy.clear(); cz.clear();
+        ex.clear(); ey.clear(); ez.clear();
+    }
+
+    size_t size() const { return cx.size(); }
+
+    size_t add(const glm::vec3& center, const glm::vec3& extent)
+    {
+        cx.push_back(center.x); cy.push_back(center.y); cz.push_back(center.z);
+        ex.push_back(extent.x); ey.push_back(extent.y); ez.push_back(extent.z);
+        return cx.size() - 1;
+    }
+
+    size_t add(const glm::mat4& transform, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+    {
+        glm::vec3 center, extent;
+        transformBounds(transform, boundsMin, boundsMax, center, extent);
+        return add(center, extent);
+    }
+
+    // visible[i] becomes 1 for every box at least partly inside, returns how many are
+    size_t cull(const Frustum& frustum, std::vector<unsigned char>& visible) const
+    {
+        size_t n = cx.size();
+        visible.resize(n);
+        size_t i = 0;
+#ifdef FRUSTUM_AVX
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 outside = _mm256_setzero_ps();
+            __m256 x = _mm256_loadu_ps(&cx[i]), y = _mm256_loadu_ps(&cy[i]), z = _mm256_loadu_ps(&cz[i]);
+            __m256 hx = _mm256_loadu_ps(&ex[i]), hy = _mm256_loadu_ps(&ey[i]), hz = _mm256_loadu_ps(&ez[i]);
+            for (int p = 0; p < 6; p++)
+            {
+                const glm::vec4& plane = frustum.planes[p];
+                __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.x), x), _mm256_mul_ps(_mm256_set1_ps(plane.y), y)),
+                                                _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.z), z), _mm256_set1_ps(plane.w)));
+                __m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(std::fabs(plane.x)), hx), _mm256_mul_ps(_mm256_set1_ps(std::fabs(plane.y)), hy)),
+                                              _mm256_mul_ps(_mm256_set1_ps(std::fabs(plane.z)), hz));
+                outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(), _CMP_LT_OQ));
+            }
+            int mask = _mm256_movemask_ps(outside);
+            for (int k = 0; k < 8; k++)
+                visible[i + k] = (mask >> k) & 1 ? 0 : 1;
+        }
+#endif
+#ifdef FRUSTUM_SSE
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128 outside = _mm_setzero_ps();
+            __m128 x = _mm_loadu_ps(&cx[i]), y = _mm_loadu_ps(&cy[i]), z = _mm_loadu_ps(&cz[i]);
+            __m128 hx = _mm_loadu_ps(&ex[i]), hy = _mm_loadu_ps(&ey[i]), hz = _mm_loadu_ps(&ez[i]);
+            for (int p = 0; p < 6; p++)
+            {
+                const glm::vec4& plane = frustum.planes[p];
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), x), _mm_mul_ps(_mm_set1_ps(plane.y), y)),
+                                             _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), z), _mm_set1_ps(plane.w)));
+                __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::fabs(plane.x)), hx), _mm_mul_ps(_mm_set1_ps(std::fabs(plane.y)), hy)),
+                                           _mm_mul_ps(_mm_set1_ps(std::fabs(plane.z)), hz));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+            }
+            int mask = _mm_movemask_ps(outside);
+            for (int k = 0; k < 4; k++)
+                visible[i + k] = (mask >> k) & 1 ? 0 : 1;
+        }
+#endif
+        for (; i < n; i++)
+            visible[i] = frustum.intersects(glm::vec3(cx[i], cy[i], cz[i]), glm::vec3(ex[i], ey[i], ez[i])) ? 1 : 0;
+
+        size_t count = 0;
+        for (size_t v = 0; v < n; v++)
+            count += visible[v];
+        return count;
+    }
+
+private:
+    std::vector<float> cx, cy, cz; // centers
+    std::vector<float> ex, ey, ez; // half extents
+};
+
+// the transforms of the instances of one object (bounds in its object space) the frustum can see
+inline size_t cullInstances(FrustumCuller& culler, const Frustum& frustum, const glm::mat4* transforms, size_t count,
+                            const glm::vec3& boundsMin, const glm::vec3& boundsMax, std::vector<glm::mat4>& visible)
+{
+    std::vector<unsigned char> inside;
+    culler.clear();
+    for (size_t i = 0; i < count; i++)
+        culler.add(transforms[i], boundsMin, boundsMax);
+    culler.cull(frustum, inside);
+    visible.clear();
+    for (size_t i = 0; i < count; i++)
+        if (inside[i])
+            visible.push_back(transforms[i]);
+    return visible.size();
+}
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef GBUFFER_H
+#define GBUFFER_H
+
+#include <glad/glad.h>
+
+#include </OpenGl programming/Sandbox/gl_state_cache.h>
+
+#include <iostream>
+
+// render targets of the deferred path, read back by the lighting pass:
+//   albedoSpecular  RGBA8    diffuse color, specular strength in alpha
+//   normal          RGBA16F  world space normal, alpha unused
+//   depth           32F      hardware depth; positions are rebuilt from it, nothing stores them
+// Like the SceneTarget they are allocated once at the window's size and only the scaled rectangle the
+// scene target renders to is drawn to, so dynamic resolution does not reallocate them.
+class GBuffer
+{
+public:
+    unsigned int FBO;
+    unsigned int albedoSpecular;
+    unsigned int normal;
+    unsigned int depth;
+    int allocatedWidth, allocatedHeight;
+    int width, height;        // the part rendered to this frame
+
+    GBuffer() : FBO(0), albedoSpecular(0), normal(0), depth(0), allocatedWidth(0), allocatedHeight(0), width(0), height(0),
+        failed(false)
+    {
+    }
+
+    // (re)create the targets at this size, a no-op when it has not changed; a size that failed once is
+    // not tried again until it changes
+    bool resize(int w, int h)
+    {
+        if (w == allocatedWidth && h == allocatedHeight && (FBO || failed))
+            return FBO != 0;
+        release();
+        allocatedWidth = width = w;
+        allocatedHeight = height = h;
+
+        glGenFramebuffers(1, &FBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        albedoSpecular = createTarget(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+        normal = createTarget(GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT);
+        depth = createTarget(GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedoSpecular, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normal, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+        GLenum attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, attachments);
+
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        failed = !complete;
+        if (!complete)
+        {
+            std::cout << "GBuffer: framebuffer not complete at " << w << "x" << h << std::endl;
+            release();
+        }
+        return complete;
+    }
+
+    // render to this part of the targets from now on, clamped to the allocated size
+    void setViewport(int w, int h)
+    {
+        width = w < 1 ? 1 : (w > allocatedWidth ? allocatedWidth : w);
+        height = h < 1 ? 1 : (h > allocatedHeight ? allocatedHeight : h);
+    }
+
+    // bind and clear for the geometry pass; the caller binds framebuffer 0 again afterwards
+    void bind()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glViewport(0, 0, width, height);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+
+    // albedoSpecular, normal and depth on three consecutive units
+    void bindTextures(GLuint firstUnit)
+    {
+        glState().bindTexture(firstUnit, GL_TEXTURE_2D, albedoSpecular);
+        glState().bindTexture(firstUnit + 1, GL_TEXTURE_2D, normal);
+        glState().bindTexture(firstUnit + 2, GL_TEXTURE_2D, depth);
+    }
+
+    void release()
+    {
+        unsigned int textures[3] = { albedoSpecular, normal, depth };
+        for (int i = 0; i < 3; i++)
+            if (textures[i])
+                glState().forgetTexture(textures[i]);
+        if (albedoSpecular)
+            glDeleteTextures(3, textures);
+        if (FBO)
+            glDeleteFramebuffers(1, &FBO);
+        FBO = albedoSpecular = normal = depth = 0;
+    }
+
+private:
+    bool failed; // at width x height
+
+    unsigned int createTarget(GLenum internalFormat, GLenum format, GLenum type)
+    {
+        unsigned int id;
+        glGenTextures(1, &id);
+        glState().bindTexture(0, GL_TEXTURE_2D, id);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, allocatedWidth, allocatedHeight, 0, format, type, NULL);
+        // lighting reads one texel per pixel, never filtered
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        return id;
+    }
+};
+
+#endif
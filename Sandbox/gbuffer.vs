@@ -0,0 +1,35 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in vec3 aTangent;
+layout (location = 4) in vec3 aBitangent;
+
+out VS_OUT {
+    vec2 TexCoords;
+    vec3 TangentViewPos;
+    vec3 TangentFragPos;
+    mat3 TBN;
+} vs_out;
+
+#include <FrameData>
+
+uniform mat4 model;
+
+void main()
+{
+    vec3 fragPos = vec3(model * vec4(aPos, 1.0));
+    vs_out.TexCoords = aTexCoords;
+
+    vec3 T = normalize(mat3(model) * aTangent);
+    vec3 B = normalize(mat3(model) * aBitangent);
+    vec3 N = normalize(mat3(model) * aNormal);
+    // tangent to world; the parallax march itself still runs in tangent space
+    vs_out.TBN = mat3(T, B, N);
+
+    mat3 worldToTangent = transpose(vs_out.TBN);
+    vs_out.TangentViewPos = worldToTangent * cameraPos;
+    vs_out.TangentFragPos = worldToTangent * fragPos;
+
+    gl_Position = projection * view * vec4(fragPos, 1.0);
+}
@@ -0,0 +1,103 @@
+#version 330 core
+layout (location = 0) out vec4 gAlbedoSpecular;
+layout (location = 1) out vec4 gNormal;
+
+in VS_OUT {
+    vec2 TexCoords;
+    vec3 TangentViewPos;
+    vec3 TangentFragPos;
+    mat3 TBN;
+} fs_in;
+
+uniform sampler2D diffuseMap;
+uniform sampler2D normalMap;
+uniform sampler2D depthMap;
+
+uniform float heightScale;
+// the layer count adapts per pixel between these
+uniform float minLayers;
+uniform float maxLayers;
+
+// hard caps on the texture fetches of one march, whatever maxLayers is set to
+const int MAX_LAYER_STEPS = 64;
+const int REFINE_STEPS = 5;
+
+// the same march as parallax_mapping.fs, keep the two in step
+vec2 ParallaxMapping(vec2 texCoords, vec3 viewDir)
+{
+    // the amount to shift the texture coordinates over the full depth (from vector p)
+    vec2 P = viewDir.xy / viewDir.z * heightScale;
+    // derivatives are taken here, in uniform control flow, and reused by every fetch in the loops below
+    vec2 gradX = dFdx(texCoords);
+    vec2 gradY = dFdy(texCoords);
+    // one layer per pixel the shift crosses on screen: grazing views shift further and get more layers,
+    // distant (minified) surfaces cover fewer pixels and get fewer
+    float pixelSize = max(max(length(gradX), length(gradY)), 1e-6);
+    float numLayers = clamp(length(P) / pixelSize, minLayers, min(maxLayers, float(MAX_LAYER_STEPS)));
+
+    // calculate the size of each layer
+    float layerDepth = 1.0 / numLayers;
+    // depth of current layer
+    float currentLayerDepth = 0.0;
+    vec2 deltaTexCoords = P / numLayers;
+    // get initial values
+    vec2 currentTexCoords = texCoords;
+    float currentDepthMapValue = textureGrad(depthMap, currentTexCoords, gradX, gradY).r;
+
+    for (int i = 0; i < MAX_LAYER_STEPS && currentLayerDepth < currentDepthMapValue; i++)
+    {
+        // shift texture coordinates along direction of P
+        currentTexCoords -= deltaTexCoords;
+        // get depthmap value at current texture coordinates
+        currentDepthMapValue = textureGrad(depthMap, currentTexCoords, gradX, gradY).r;
+        // get depth of next layer
+        currentLayerDepth += layerDepth;
+    }
+    if (currentLayerDepth == 0.0)
+        return texCoords;
+
+    // binary search between the last layer above the surface and the first one below it
+    vec2 aboveTexCoords = currentTexCoords + deltaTexCoords;
+    float aboveDepth = currentLayerDepth - layerDepth;
+    vec2 belowTexCoords = currentTexCoords;
+    float belowDepth = currentLayerDepth;
+    for (int i = 0; i < REFINE_STEPS; i++)
+    {
+        vec2 middleTexCoords = (aboveTexCoords + belowTexCoords) * 0.5;
+        float middleDepth = (aboveDepth + belowDepth) * 0.5;
+        if (textureGrad(depthMap, middleTexCoords, gradX, gradY).r > middleDepth)
+        {
+            aboveTexCoords = middleTexCoords;
+            aboveDepth = middleDepth;
+        }
+        else
+        {
+            belowTexCoords = middleTexCoords;
+            belowDepth = middleDepth;
+        }
+    }
+
+    // depth after and before collision for linear interpolation within the last interval
+    float afterDepth = textureGrad(depthMap, belowTexCoords, gradX, gradY).r - belowDepth;
+    float beforeDepth = textureGrad(depthMap, aboveTexCoords, gradX, gradY).r - aboveDepth;
+    float difference = afterDepth - beforeDepth;
+    float weight = abs(difference) > 1e-6 ? afterDepth / difference : 0.0;
+    return aboveTexCoords * weight + belowTexCoords * (1.0 - weight);
+}
+
+void main()
+{
+    // offset texture coordinates with Parallax Mapping
+    vec3 viewDir = normalize(fs_in.TangentViewPos - fs_in.TangentFragPos);
+    vec2 texCoords = ParallaxMapping(fs_in.TexCoords, viewDir);
+    if(texCoords.x > 1.0 || texCoords.y > 1.0 || texCoords.x < 0.0 || texCoords.y < 0.0)
+        discard;
+
+    // only xy is read so a two channel (BC5) normal map works too, z is rebuilt from them
+    vec2 normalXY = texture(normalMap, texCoords).rg * 2.0 - 1.0;
+    vec3 normal = normalize(vec3(normalXY, sqrt(max(1.0 - dot(normalXY, normalXY), 0.0))));
+
+    // the lighting pass works in world space
+    gAlbedoSpecular = vec4(texture(diffuseMap, texCoords).rgb, 0.2);
+    gNormal = vec4(normalize(fs_in.TBN * normal), 0.0);
+}
@@ -0,0 +1,190 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+
+// The project's glad loader is generated for GL 3.3 core. The few newer entry points the renderer can use
+// on a 4.x context are declared and loaded here the same way glad does it; each block disappears when
+// glad is regenerated for that version.
+
+#ifndef GL_VERSION_4_0
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+typedef void (APIENTRYP PFNGLDRAWARRAYSINDIRECTPROC)(GLenum mode, const void* indirect);
+typedef void (APIENTRYP PFNGLDRAWELEMENTSINDIRECTPROC)(GLenum mode, GLenum type, const void* indirect);
+static PFNGLDRAWARRAYSINDIRECTPROC glad_glDrawArraysIndirect = NULL;
+static PFNGLDRAWELEMENTSINDIRECTPROC glad_glDrawElementsIndirect = NULL;
+#define glDrawArraysIndirect glad_glDrawArraysIndirect
+#define glDrawElementsIndirect glad_glDrawElementsIndirect
+#endif
+
+#ifndef GL_VERSION_4_1
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH           0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS      0x87FE
+typedef void (APIENTRYP PFNGLGETPROGRAMBINARYPROC)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void (APIENTRYP PFNGLPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void (APIENTRYP PFNGLPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+static PFNGLGETPROGRAMBINARYPROC glad_glGetProgramBinary = NULL;
+static PFNGLPROGRAMBINARYPROC glad_glProgramBinary = NULL;
+static PFNGLPROGRAMPARAMETERIPROC glad_glProgramParameteri = NULL;
+#define glGetProgramBinary glad_glGetProgramBinary
+#define glProgramBinary glad_glProgramBinary
+#define glProgramParameteri glad_glProgramParameteri
+#endif
+
+#ifndef GL_VERSION_4_2
+#define GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT 0x00000001
+#define GL_COMMAND_BARRIER_BIT             0x00000040
+typedef void (APIENTRYP PFNGLMEMORYBARRIERPROC)(GLbitfield barriers);
+static PFNGLMEMORYBARRIERPROC glad_glMemoryBarrier = NULL;
+#define glMemoryBarrier glad_glMemoryBarrier
+#endif
+
+#ifndef GL_VERSION_4_3
+#define GL_COMPUTE_SHADER             0x91B9
+#define GL_SHADER_STORAGE_BUFFER      0x90D2
+#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+#define GL_MAX_SHADER_STORAGE_BLOCK_SIZE          0x90DE
+#define GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT 0x90DF
+#define GL_MAX_SHADER_STORAGE_BUFFER_BINDINGS     0x90DD
+#define GL_MAX_VERTEX_SHADER_STORAGE_BLOCKS       0x90D6
+typedef void (APIENTRYP PFNGLMULTIDRAWELEMENTSINDIRECTPROC)(GLenum mode, GLenum type, const void* indirect, GLsizei drawcount, GLsizei stride);
+typedef void (APIENTRYP PFNGLDISPATCHCOMPUTEPROC)(GLuint num_groups_x, GLuint num_groups_y, GLuint num_groups_z);
+static PFNGLMULTIDRAWELEMENTSINDIRECTPROC glad_glMultiDrawElementsIndirect = NULL;
+static PFNGLDISPATCHCOMPUTEPROC glad_glDispatchCompute = NULL;
+#define glMultiDrawElementsIndirect glad_glMultiDrawElementsIndirect
+#define glDispatchCompute glad_glDispatchCompute
+#endif
+
+// KHR_parallel_shader_compile, ARB_parallel_shader_compile has the same entry point with an ARB suffix
+#ifndef GL_KHR_parallel_shader_compile
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+static PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glad_glMaxShaderCompilerThreadsKHR = NULL;
+#define glMaxShaderCompilerThreadsKHR glad_glMaxShaderCompilerThreadsKHR
+#endif
+
+// block compressed formats, BC4/BC5 (RGTC) are core since 3.0
+#ifndef GL_EXT_texture_compression_s3tc
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT  0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_EXT_texture_sRGB
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT       0x8C4C
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT 0x8C4D
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+#ifndef GL_VERSION_4_2
+#define GL_COMPRESSED_RGBA_BPTC_UNORM       0x8E8C
+#define GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM 0x8E8D
+#endif
+
+// what the current context can do beyond 3.3 core, filled in by loadGLExtensions
+struct GLCapabilities {
+    int major;
+    int minor;
+    bool multiDrawIndirect;
+    bool textureCompressionS3TC;     // BC1, BC3
+    bool textureCompressionS3TCsRGB; // their sRGB variants
+    bool textureCompressionBPTC;     // BC7
+    bool programBinary;              // glGetProgramBinary/glProgramBinary with at least one binary format
+    bool parallelShaderCompile;      // compiles and links run on driver threads, GL_COMPLETION_STATUS_KHR polls them
+    bool computeShaders;             // compute programs, shader storage buffers and glMemoryBarrier
+    bool drawIndirect;               // glDrawArraysIndirect/glDrawElementsIndirect from a GL_DRAW_INDIRECT_BUFFER
+    int maxShaderStorageBindings;    // 8 at least with computeShaders, 0 without
+    int maxVertexShaderStorageBlocks; // may well be 0, compute shaders only guarantee the fragment and compute stages
+};
+
+inline GLCapabilities& glCaps()
+{
+    static GLCapabilities caps = { 3, 3, false, false, false, false, false, false, false, false, 0, 0 };
+    return caps;
+}
+
+inline bool hasGLExtension(const char* name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (extension && std::strcmp(extension, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+inline bool glVersionAtLeast(int major, int minor)
+{
+    const GLCapabilities& caps = glCaps();
+    return caps.major > major || (caps.major == major && caps.minor >= minor);
+}
+
+// call once right after gladLoadGLLoader, with the same loader
+inline void loadGLExtensions(GLADloadproc load)
+{
+    GLCapabilities& caps = glCaps();
+    glGetIntegerv(GL_MAJOR_VERSION, &caps.major);
+    glGetIntegerv(GL_MINOR_VERSION, &caps.minor);
+
+#ifndef GL_VERSION_4_3
+    if (glVersionAtLeast(4, 3))
+    {
+        glad_glMultiDrawElementsIndirect = (PFNGLMULTIDRAWELEMENTSINDIRECTPROC)load("glMultiDrawElementsIndirect");
+        glad_glDispatchCompute = (PFNGLDISPATCHCOMPUTEPROC)load("glDispatchCompute");
+    }
+#endif
+#ifndef GL_VERSION_4_2
+    if (glVersionAtLeast(4, 2))
+        glad_glMemoryBarrier = (PFNGLMEMORYBARRIERPROC)load("glMemoryBarrier");
+#endif
+#ifndef GL_VERSION_4_0
+    if (glVersionAtLeast(4, 0))
+    {
+        glad_glDrawArraysIndirect = (PFNGLDRAWARRAYSINDIRECTPROC)load("glDrawArraysIndirect");
+        glad_glDrawElementsIndirect = (PFNGLDRAWELEMENTSINDIRECTPROC)load("glDrawElementsIndirect");
+    }
+#endif
+    caps.multiDrawIndirect = glVersionAtLeast(4, 3) && glMultiDrawElementsIndirect != NULL;
+    caps.computeShaders = glVersionAtLeast(4, 3) && glDispatchCompute != NULL && glMemoryBarrier != NULL;
+    caps.drawIndirect = glVersionAtLeast(4, 0) && glDrawArraysIndirect != NULL && glDrawElementsIndirect != NULL;
+    caps.maxShaderStorageBindings = caps.maxVertexShaderStorageBlocks = 0;
+    if (caps.computeShaders)
+    {
+        glGetIntegerv(GL_MAX_SHADER_STORAGE_BUFFER_BINDINGS, &caps.maxShaderStorageBindings);
+        glGetIntegerv(GL_MAX_VERTEX_SHADER_STORAGE_BLOCKS, &caps.maxVertexShaderStorageBlocks);
+    }
+    caps.textureCompressionS3TC = hasGLExtension("GL_EXT_texture_compression_s3tc");
+    caps.textureCompressionS3TCsRGB = caps.textureCompressionS3TC && hasGLExtension("GL_EXT_texture_sRGB");
+    caps.textureCompressionBPTC = glVersionAtLeast(4, 2) || hasGLExtension("GL_ARB_texture_compression_bptc");
+
+#ifndef GL_VERSION_4_1
+    if (glVersionAtLeast(4, 1) || hasGLExtension("GL_ARB_get_program_binary"))
+    {
+        glad_glGetProgramBinary = (PFNGLGETPROGRAMBINARYPROC)load("glGetProgramBinary");
+        glad_glProgramBinary = (PFNGLPROGRAMBINARYPROC)load("glProgramBinary");
+        glad_glProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)load("glProgramParameteri");
+    }
+#endif
+    // a driver may expose the entry points but no format it can actually save
+    GLint binaryFormats = 0;
+    if (glGetProgramBinary != NULL && glProgramBinary != NULL && glProgramParameteri != NULL)
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormats);
+    caps.programBinary = binaryFormats > 0;
+
+#ifndef GL_KHR_parallel_shader_compile
+    if (hasGLExtension("GL_KHR_parallel_shader_compile"))
+        glad_glMaxShaderCompilerThreadsKHR = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load("glMaxShaderCompilerThreadsKHR");
+    else if (hasGLExtension("GL_ARB_parallel_shader_compile"))
+        glad_glMaxShaderCompilerThreadsKHR = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load("glMaxShaderCompilerThreadsARB");
+#endif
+    caps.parallelShaderCompile = glMaxShaderCompilerThreadsKHR != NULL;
+    // 0xFFFFFFFF lets the driver pick how many threads it compiles on
+    if (caps.parallelShaderCompile)
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+}
+
+#endif
@@ -0,0 +1,172 @@
+#ifndef GL_STATE_CACHE_H
+#define GL_STATE_CACHE_H
+
+#include <glad/glad.h>
+
+// Thin shadow of the GL binding state. Every program/VAO/texture/depth-func change goes through here
+// so redundant calls are dropped before they reach the driver. The cache starts out "unknown", so the
+// first call of each kind is always issued; call invalidate() after touching this state behind its back.
+class GLStateCache
+{
+public:
+    static const unsigned int MAX_TEXTURE_UNITS = 32;
+
+    struct Stats {
+        unsigned int issued;
+        unsigned int elided;
+        unsigned int draws;
+    };
+
+    GLStateCache()
+    {
+        invalidate();
+        current.issued = current.elided = current.draws = 0;
+        last = current;
+    }
+
+    // forget everything we know, the next call of each kind is issued
+    void invalidate()
+    {
+        program = UNKNOWN;
+        vertexArray = UNKNOWN;
+        activeUnit = UNKNOWN;
+        depth = UNKNOWN;
+        for (unsigned int i = 0; i < MAX_TEXTURE_UNITS; i++)
+            for (unsigned int t = 0; t < TARGET_COUNT; t++)
+                textures[i][t] = UNKNOWN;
+    }
+
+    // rolls the per-frame counters over, call once at the start of every frame
+    void beginFrame()
+    {
+        last = current;
+        current.issued = current.elided = current.draws = 0;
+    }
+
+    // counters of the previous (completed) frame
+    const Stats& frameStats() const { return last; }
+    // counters of the frame in progress
+    const Stats& currentStats() const { return current; }
+
+    // not state, but counted here so one Stats covers everything the frame sent to the driver
+    void countDraw(unsigned int calls = 1) { current.draws += calls; }
+
+    void useProgram(GLuint id)
+    {
+        if (program == id)
+        {
+            current.elided++;
+            return;
+        }
+        glUseProgram(id);
+        program = id;
+        current.issued++;
+    }
+
+    void bindVertexArray(GLuint id)
+    {
+        if (vertexArray == id)
+        {
+            current.elided++;
+            return;
+        }
+        glBindVertexArray(id);
+        vertexArray = id;
+        current.issued++;
+    }
+
+    // binds texture to target on the given unit, only switching the active unit when a bind is needed
+    void bindTexture(GLuint unit, GLenum target, GLuint id)
+    {
+        int t = targetIndex(target);
+        if (t < 0 || unit >= MAX_TEXTURE_UNITS)
+        {
+            // not tracked, always issue and forget what the unit held
+            setActiveUnit(unit);
+            glBindTexture(target, id);
+            current.issued++;
+            return;
+        }
+        if (textures[unit][t] == id)
+        {
+            current.elided++;
+            return;
+        }
+        setActiveUnit(unit);
+        glBindTexture(target, id);
+        textures[unit][t] = id;
+        current.issued++;
+    }
+
+    void depthFunc(GLenum func)
+    {
+        if (depth == func)
+        {
+            current.elided++;
+            return;
+        }
+        glDepthFunc(func);
+        depth = func;
+        current.issued++;
+    }
+
+    // a deleted name may be recycled by the driver, so drop any binding we remember for it
+    void forgetTexture(GLuint id)
+    {
+        for (unsigned int i = 0; i < MAX_TEXTURE_UNITS; i++)
+            for (unsigned int t = 0; t < TARGET_COUNT; t++)
+                if (textures[i][t] == id)
+                    textures[i][t] = UNKNOWN;
+    }
+
+    void forgetVertexArray(GLuint id)
+    {
+        if (vertexArray == id)
+            vertexArray = UNKNOWN;
+    }
+
+    void forgetProgram(GLuint id)
+    {
+        if (program == id)
+            program = UNKNOWN;
+    }
+
+private:
+    static const GLuint UNKNOWN = 0xFFFFFFFFu;
+    enum { TARGET_2D, TARGET_CUBE_MAP, TARGET_COUNT };
+
+    GLuint program;
+    GLuint vertexArray;
+    GLuint activeUnit;
+    GLenum depth;
+    GLuint textures[MAX_TEXTURE_UNITS][TARGET_COUNT];
+    Stats current;
+    Stats last;
+
+    static int targetIndex(GLenum target)
+    {
+        if (target == GL_TEXTURE_2D)
+            return TARGET_2D;
+        if (target == GL_TEXTURE_CUBE_MAP)
+            return TARGET_CUBE_MAP;
+        return -1;
+    }
+
+    void setActiveUnit(GLuint unit)
+    {
+        if (activeUnit == unit)
+            return;
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeUnit = unit;
+        current.issued++;
+    }
+};
+
+// the one cache for the one context this application renders with
+inline GLStateCache& glState()
+{
+    static GLStateCache cache;
+    return cache;
+}
+
+#endif
@@ -0,0 +1,385 @@
+#ifndef GPU_EFFECTS_H
+#define GPU_EFFECTS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include </OpenGl programming/Sandbox/gl_extensions.h>
+#include </OpenGl programming/Sandbox/gl_state_cache.h>
+#include </OpenGl programming/Sandbox/shader_s.h>
+
+#include <iostream>
+#include <vector>
+
+// Effects whose elements live and move on the GPU only: their state sits in shader storage buffers, a
+// compute shader advances it every frame and one indirect draw renders each effect, so the CPU does the
+// same few calls whether an effect has a hundred elements or a hundred thousand. Both need
+// gpuEffectsSupported().
+
+// compute shaders and indirect draws, and storage blocks in the vertex stage, which compute shaders alone
+// do not guarantee: particles.vs reads two, at bindings up to PARTICLE_DRAW_BINDING
+inline bool gpuEffectsSupported()
+{
+    const GLCapabilities& caps = glCaps();
+    return caps.computeShaders && caps.drawIndirect && caps.maxVertexShaderStorageBlocks >= 2 &&
+        caps.maxShaderStorageBindings > (int)PARTICLE_DRAW_BINDING;
+}
+
+// Counts the fixed steps of STEP seconds a frame has come to, so the effects move at the same rate
+// whatever the frame rate; a frame longer than MAX_STEPS steps drops the rest.
+struct FixedSteps
+{
+    static constexpr float STEP = 1.0f / 120.0f;
+    static const unsigned int MAX_STEPS = 4;
+    float accumulated; // seconds not stepped yet
+
+    FixedSteps() : accumulated(0.0f)
+    {
+    }
+
+    unsigned int advance(float deltaTime)
+    {
+        accumulated += deltaTime;
+        unsigned int steps = 0;
+        while (accumulated >= STEP && steps < MAX_STEPS)
+        {
+            accumulated -= STEP;
+            steps++;
+        }
+        if (steps == MAX_STEPS)
+            accumulated = 0.0f;
+        return steps;
+    }
+};
+
+// A flag as a grid of particles held together by springs (cloth.comp), hanging in the xy plane from its
+// first column, which is pinned to the pole. Every step integrates gravity and a wind that pushes along
+// each particle's normal with Verlet, then relaxes the springs a number of times, every dispatch reading
+// one buffer and writing the other. cloth.vs reads the particles back by gl_VertexID to draw the grid.
+class GpuCloth
+{
+public:
+    static const unsigned int GROUP_SIZE = 64;  // cloth.comp local_size_x
+    static const unsigned int ITERATIONS = 16;  // spring relaxations per step
+    unsigned int columns, rows;
+    float stiffness;    // share of a spring's error corrected per relaxation
+    glm::vec3 wind;     // meters per second, set before simulate()
+
+    GpuCloth() : columns(0), rows(0), stiffness(0.9f), wind(4.0f, 0.0f, 0.0f), elementBuffer(0), commandBuffer(0), VAO(0),
+        current(0), restLength(0.0f)
+    {
+        buffers[0] = buffers[1] = 0;
+    }
+
+    // a w x h cloth of columnCount x rowCount particles centered on center, facing +z
+    bool create(const glm::vec3& center, float w, float h, unsigned int columnCount, unsigned int rowCount)
+    {
+        release();
+        if (columnCount < 3 || rowCount < 3)
+        {
+            std::cout << "GpuCloth: a " << columnCount << "x" << rowCount << " grid is too small for its bending springs" << std::endl;
+            return false;
+        }
+        columns = columnCount;
+        rows = rowCount;
+        restLength = glm::vec2(w / (columns - 1), h / (rows - 1));
+        glm::vec3 topLeft = center + glm::vec3(-0.5f * w, 0.5f * h, 0.0f);
+
+        // position.w is 0 for the pinned column and 1 for the rest; it starts at rest, previous == position
+        std::vector<glm::vec4> particles((size_t)columns * rows * 2);
+        for (unsigned int y = 0; y < rows; y++)
+            for (unsigned int x = 0; x < columns; x++)
+            {
+                glm::vec4 position(topLeft + glm::vec3(x * restLength.x, -(float)y * restLength.y, 0.0f), x == 0 ? 0.0f : 1.0f);
+                particles[(y * columns + x) * 2] = position;
+                particles[(y * columns + x) * 2 + 1] = position;
+            }
+        glGenBuffers(2, buffers);
+        for (int i = 0; i < 2; i++)
+        {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[i]);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, particles.size() * sizeof(glm::vec4), particles.data(), GL_DYNAMIC_COPY);
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        std::vector<unsigned int> indices;
+        indices.reserve((size_t)(columns - 1) * (rows - 1) * 6);
+        for (unsigned int y = 0; y + 1 < rows; y++)
+            for (unsigned int x = 0; x + 1 < columns; x++)
+            {
+                unsigned int i = y * columns + x;
+                unsigned int quad[6] = { i, i + columns, i + 1, i + 1, i + columns, i + columns + 1 };
+                indices.insert(indices.end(), quad, quad + 6);
+            }
+        // the vertices come from the storage buffer, the VAO only carries the index buffer
+        glGenVertexArrays(1, &VAO);
+        glState().bindVertexArray(VAO);
+        glGenBuffers(1, &elementBuffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+        glState().bindVertexArray(0);
+
+        // count, instanceCount, firstIndex, baseVertex, baseInstance
+        GLuint command[5] = { (GLuint)indices.size(), 1, 0, 0, 0 };
+        glGenBuffers(1, &commandBuffer);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(command), command, GL_STATIC_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        current = 0;
+        clock = FixedSteps();
+        return true;
+    }
+
+    // from onProgramChange of the cloth.comp program and of the one drawing it
+    void resolveStepUniforms(Shader& program)
+    {
+        step.columns = program.getUniform("columns");
+        step.rows = program.getUniform("rows");
+        step.restLength = program.getUniform("restLength");
+        step.mode = program.getUniform("mode");
+        step.deltaTime = program.getUniform("deltaTime");
+        step.stiffness = program.getUniform("stiffness");
+        step.wind = program.getUniform("wind");
+        step.time = program.getUniform("time");
+    }
+    void resolveDrawUniforms(Shader& shader)
+    {
+        drawColumns = shader.getUniform("columns");
+        drawRows = shader.getUniform("rows");
+    }
+
+    // run the fixed steps deltaTime seconds have come to
+    void simulate(Shader& program, float deltaTime, float time)
+    {
+        if (!VAO)
+            return;
+        unsigned int steps = clock.advance(deltaTime);
+        if (steps == 0)
+            return;
+
+        program.use();
+        program.setInt(step.columns, (int)columns);
+        program.setInt(step.rows, (int)rows);
+        program.setVec2(step.restLength, restLength);
+        program.setFloat(step.deltaTime, FixedSteps::STEP);
+        program.setFloat(step.stiffness, stiffness);
+        program.setVec3(step.wind, wind);
+        program.setFloat(step.time, time);
+        GLuint groups = (GLuint)((columns * rows + GROUP_SIZE - 1) / GROUP_SIZE);
+        for (unsigned int s = 0; s < steps; s++)
+            for (unsigned int pass = 0; pass <= ITERATIONS; pass++)
+            {
+                // pass 0 integrates, the others relax the springs
+                program.setInt(step.mode, pass == 0 ? 0 : 1);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLOTH_SOURCE_BINDING, buffers[current]);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLOTH_TARGET_BINDING, buffers[1 - current]);
+                glDispatchCompute(groups, 1, 1);
+                glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+                current = 1 - current;
+            }
+    }
+
+    // cloth.vs + cloth.fs, or any program reading the particles the same way
+    void draw(Shader& shader)
+    {
+        if (!VAO)
+            return;
+        shader.use();
+        shader.setInt(drawColumns, (int)columns);
+        shader.setInt(drawRows, (int)rows);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLOTH_SOURCE_BINDING, buffers[current]);
+        glState().bindVertexArray(VAO);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glState().countDraw();
+    }
+
+    void release()
+    {
+        if (buffers[0])
+            glDeleteBuffers(2, buffers);
+        if (elementBuffer)
+            glDeleteBuffers(1, &elementBuffer);
+        if (commandBuffer)
+            glDeleteBuffers(1, &commandBuffer);
+        if (VAO)
+        {
+            glState().forgetVertexArray(VAO);
+            glDeleteVertexArrays(1, &VAO);
+        }
+        buffers[0] = buffers[1] = elementBuffer = commandBuffer = VAO = 0;
+    }
+
+private:
+    unsigned int buffers[2]; // vec4 position, vec4 previous per particle
+    unsigned int elementBuffer;
+    unsigned int commandBuffer;
+    unsigned int VAO;
+    unsigned int current;    // the buffer holding the latest positions
+    FixedSteps clock;
+    glm::vec2 restLength;    // between neighbors along x and y
+    struct {
+        UniformHandle columns, rows, restLength, mode, deltaTime, stiffness, wind, time;
+    } step;
+    UniformHandle drawColumns, drawRows;
+};
+
+// Bursts of sparks from an emitter (particles.comp): every period seconds all particles start again
+// from the emitter in random directions and fall, slowed by drag, until their life runs out. They move in
+// the same fixed steps as the cloth; the last step of a frame appends every particle still alive to a
+// list and counts it into the instance count of the indirect draw command, so particles.vs only draws
+// those, one camera facing quad each.
+class GpuParticles
+{
+public:
+    static const unsigned int GROUP_SIZE = 256; // particles.comp local_size_x
+    unsigned int count;
+    glm::vec3 emitter;
+    float period;  // seconds between bursts, the longest life
+    float speed;   // fastest start, meters per second
+    float size;    // half the width of a fresh spark
+
+    GpuParticles() : count(0), emitter(0.0f), period(3.0f), speed(4.0f), size(0.03f), particleBuffer(0), aliveBuffer(0), commandBuffer(0),
+        emptyVAO(0)
+    {
+    }
+
+    bool create(unsigned int particleCount)
+    {
+        release();
+        count = particleCount;
+        if (count == 0)
+            return false;
+        // position.w is the life left, velocity.w the burst the particle was started by; -1 starts them all
+        // with the first burst
+        std::vector<glm::vec4> particles((size_t)count * 2, glm::vec4(0.0f));
+        for (unsigned int i = 0; i < count; i++)
+            particles[i * 2 + 1].w = -1.0f;
+        glGenBuffers(1, &particleBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, particleBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, particles.size() * sizeof(glm::vec4), particles.data(), GL_DYNAMIC_COPY);
+        glGenBuffers(1, &aliveBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, aliveBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (size_t)count * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        // count, instanceCount (written by the update), first, baseInstance; a quad as a strip per particle
+        GLuint command[4] = { 4, 0, 0, 0 };
+        glGenBuffers(1, &commandBuffer);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(command), command, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        clock = FixedSteps();
+        return true;
+    }
+
+    // from onProgramChange of the particles.comp program and of the one drawing it
+    void resolveStepUniforms(Shader& program)
+    {
+        step.particleCount = program.getUniform("particleCount");
+        step.time = program.getUniform("time");
+        step.deltaTime = program.getUniform("deltaTime");
+        step.period = program.getUniform("period");
+        step.speed = program.getUniform("speed");
+        step.emitter = program.getUniform("emitter");
+        step.listAlive = program.getUniform("listAlive");
+    }
+    void resolveDrawUniforms(Shader& shader)
+    {
+        drawSize = shader.getUniform("size");
+    }
+
+    // run the fixed steps deltaTime seconds have come to, the last of them ending at time
+    void simulate(Shader& program, float deltaTime, float time)
+    {
+        if (!particleBuffer)
+            return;
+        unsigned int steps = clock.advance(deltaTime);
+        // without a step the list and the count of the last one still hold
+        if (steps == 0)
+            return;
+        // the last step counts the living from zero again
+        GLuint zero = 0;
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, sizeof(GLuint), sizeof(GLuint), &zero);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+        program.use();
+        program.setInt(step.particleCount, (int)count);
+        program.setFloat(step.deltaTime, FixedSteps::STEP);
+        program.setFloat(step.period, period);
+        program.setFloat(step.speed, speed);
+        program.setVec3(step.emitter, emitter);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PARTICLE_BINDING, particleBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PARTICLE_ALIVE_BINDING, aliveBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PARTICLE_DRAW_BINDING, commandBuffer);
+        for (unsigned int s = 0; s < steps; s++)
+        {
+            bool last = s + 1 == steps;
+            program.setFloat(step.time, time - (steps - 1 - s) * FixedSteps::STEP);
+            program.setBool(step.listAlive, last);
+            glDispatchCompute((GLuint)((count + GROUP_SIZE - 1) / GROUP_SIZE), 1, 1);
+            glMemoryBarrier(last ? GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT : GL_SHADER_STORAGE_BARRIER_BIT);
+        }
+    }
+
+    // particles.vs + particles.fs, on top of the scene without writing depth. additive sets up adding the
+    // sparks' light to the target; without it the bound blend state is kept, e.g. the overdraw counter's.
+    void draw(Shader& shader, bool additive)
+    {
+        if (!particleBuffer)
+            return;
+        if (!emptyVAO)
+            glGenVertexArrays(1, &emptyVAO);
+        GLStateCache& state = glState();
+        shader.use();
+        shader.setFloat(drawSize, size);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PARTICLE_BINDING, particleBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PARTICLE_ALIVE_BINDING, aliveBuffer);
+        state.bindVertexArray(emptyVAO);
+        glDepthMask(GL_FALSE);
+        if (additive)
+        {
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_ONE, GL_ONE);
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glDrawArraysIndirect(GL_TRIANGLE_STRIP, 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        if (additive)
+            glDisable(GL_BLEND);
+        glDepthMask(GL_TRUE);
+        state.countDraw();
+    }
+
+    void release()
+    {
+        if (particleBuffer)
+            glDeleteBuffers(1, &particleBuffer);
+        if (aliveBuffer)
+            glDeleteBuffers(1, &aliveBuffer);
+        if (commandBuffer)
+            glDeleteBuffers(1, &commandBuffer);
+        if (emptyVAO)
+        {
+            glState().forgetVertexArray(emptyVAO);
+            glDeleteVertexArrays(1, &emptyVAO);
+        }
+        particleBuffer = aliveBuffer = commandBuffer = emptyVAO = 0;
+        count = 0;
+    }
+
+private:
+    unsigned int particleBuffer; // vec4 position, vec4 velocity per particle
+    unsigned int aliveBuffer;    // indices of the living, instanceCount of them
+    unsigned int commandBuffer;
+    unsigned int emptyVAO;       // the quads are generated from gl_VertexID, core still wants a VAO bound
+    FixedSteps clock;
+    struct {
+        UniformHandle particleCount, time, deltaTime, period, speed, emitter, listAlive;
+    } step;
+    UniformHandle drawSize;
+};
+
+#endif
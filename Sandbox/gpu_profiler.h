@@ -0,0 +1,370 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <glad/glad.h>
+
+#include </OpenGl programming/Sandbox/gl_state_cache.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Per-scope CPU and GPU timings of each frame. Every scope records a pair of GL_TIMESTAMP queries
+// (timestamps rather than GL_TIME_ELAPSED, which cannot nest inside the frame scope) into one of
+// FRAMES_IN_FLIGHT query sets, and a set is only read when it comes round again, by which time the
+// GPU has long finished with it; results that are still not there are dropped instead of waited on.
+//
+//   profiler.beginFrame();
+//   { ProfileScope scope(profiler, "skybox"); ... }
+//   profiler.endFrame();
+class GpuProfiler
+{
+public:
+    static const unsigned int FRAMES_IN_FLIGHT = 3;
+    static const unsigned int HISTORY = 240; // frames kept for the percentiles
+
+    // whole-frame timings of one resolved frame, gpuMs is negative when its queries were dropped
+    struct FrameTiming {
+        uint64_t frame;
+        float cpuMs;
+        float gpuMs;
+    };
+
+    GpuProfiler() : frame(0), frameOpen(false), keepFrames(false), csv(NULL), lastGpuMs(-1.0f)
+    {
+        lastStats.issued = lastStats.elided = lastStats.draws = 0;
+        scopeIndex("frame");
+    }
+    ~GpuProfiler()
+    {
+        closeCsv();
+    }
+
+    // call after glState().beginFrame(), whose counters of the previous frame are filed with it here
+    void beginFrame()
+    {
+        if (frame > 0)
+            slots[(frame - 1) % FRAMES_IN_FLIGHT].stats = glState().frameStats();
+        Slot& slot = slots[frame % FRAMES_IN_FLIGHT];
+        if (frame >= FRAMES_IN_FLIGHT)
+            resolve(slot);
+        slot.records.clear();
+        slot.frame = frame;
+        frameOpen = true;
+        begin("frame");
+    }
+
+    void endFrame()
+    {
+        if (!frameOpen)
+            return;
+        end();
+        frameOpen = false;
+        frame++;
+    }
+
+    // scopes nest; every begin needs its end before endFrame
+    void begin(const char* name)
+    {
+        Slot& slot = slots[frame % FRAMES_IN_FLIGHT];
+        Record record;
+        record.scope = scopeIndex(name);
+        record.depth = static_cast<unsigned int>(open.size());
+        record.query = static_cast<unsigned int>(slot.records.size()) * 2;
+        if (slot.queries.size() < record.query + 2)
+        {
+            size_t first = slot.queries.size();
+            slot.queries.resize(record.query + 2);
+            glGenQueries(static_cast<GLsizei>(slot.queries.size() - first), &slot.queries[first]);
+        }
+        glQueryCounter(slot.queries[record.query], GL_TIMESTAMP);
+        record.cpuBegin = now();
+        record.cpuEnd = record.cpuBegin;
+        open.push_back(slot.records.size());
+        slot.records.push_back(record);
+    }
+
+    void end()
+    {
+        if (open.empty())
+            return;
+        Slot& slot = slots[frame % FRAMES_IN_FLIGHT];
+        Record& record = slot.records[open.back()];
+        open.pop_back();
+        record.cpuEnd = now();
+        glQueryCounter(slot.queries[record.query + 1], GL_TIMESTAMP);
+    }
+
+    // index of the next (or currently open) frame
+    uint64_t frameIndex() const { return frame; }
+
+    // unsmoothed GPU time of the most recently resolved frame (FRAMES_IN_FLIGHT behind), negative until
+    // the first one is in or when its queries were dropped
+    float lastGpuFrameMs() const { return lastGpuMs; }
+
+    // wait for the GPU and resolve every frame still in flight, e.g. before reading takeFrames
+    void flush()
+    {
+        if (frameOpen || frame == 0)
+            return;
+        glFinish();
+        slots[(frame - 1) % FRAMES_IN_FLIGHT].stats = glState().currentStats();
+        uint64_t oldest = frame > FRAMES_IN_FLIGHT ? frame - FRAMES_IN_FLIGHT : 0;
+        for (uint64_t f = oldest; f < frame; f++)
+        {
+            Slot& slot = slots[f % FRAMES_IN_FLIGHT];
+            resolve(slot);
+            slot.records.clear();
+        }
+    }
+
+    // collect the timings of every resolved frame from now on, for takeFrames
+    void keepFrameTimings(bool keep)
+    {
+        keepFrames = keep;
+        if (!keep)
+            resolved.clear();
+    }
+
+    // hands over (and forgets) the frames resolved since the last call
+    void takeFrames(std::vector<FrameTiming>& out)
+    {
+        out.insert(out.end(), resolved.begin(), resolved.end());
+        resolved.clear();
+    }
+
+    // a time measured outside of any scope, e.g. from polling an input to presenting it; samples of one
+    // name are smoothed and kept HISTORY deep for the percentiles like the frame times. It goes with the
+    // frame that is open, or the one that just ended, and reaches the csv at once instead of on resolve.
+    void sample(const char* name, float ms)
+    {
+        std::unordered_map<std::string, unsigned int>::iterator it = sampleIndices.find(name);
+        unsigned int index;
+        if (it != sampleIndices.end())
+            index = it->second;
+        else
+        {
+            Sampled added;
+            added.name = name;
+            added.smoothed = ms;
+            added.count = 0;
+            samples.push_back(added);
+            index = static_cast<unsigned int>(samples.size() - 1);
+            sampleIndices[name] = index;
+        }
+        Sampled& sampled = samples[index];
+        sampled.smoothed += (ms - sampled.smoothed) * 0.1;
+        push(sampled.history, ms, sampled.count++);
+        if (csv)
+            std::fprintf(csv, "%llu,%s,-1,%.4f,,,,\n", (unsigned long long)(frameOpen || frame == 0 ? frame : frame - 1), name, ms);
+    }
+
+    // "frame 4.1 ms (p50 4.0 p99 6.3) gpu 2.2 ms | skybox 0.31/0.12 ... | input latency 21.3 ms (p99 30.2) | 9 draws, 14 state changes (21 elided)"
+    std::string summary() const
+    {
+        std::ostringstream out;
+        out.setf(std::ios::fixed);
+        out.precision(2);
+        out << "frame " << scopes[0].cpu << " ms (p50 " << percentile(cpuFrames, 0.5f) << " p99 " << percentile(cpuFrames, 0.99f)
+            << ") gpu " << scopes[0].gpu << " ms (p50 " << percentile(gpuFrames, 0.5f) << " p99 " << percentile(gpuFrames, 0.99f) << ")";
+        for (size_t i = 1; i < scopes.size(); i++)
+            out << " | " << scopes[i].name << " " << scopes[i].cpu << "/" << scopes[i].gpu;
+        for (size_t i = 0; i < samples.size(); i++)
+            out << " | " << samples[i].name << " " << samples[i].smoothed << " ms (p99 " << percentile(samples[i].history, 0.99f) << ")";
+        out << " | " << lastStats.draws << " draws, " << lastStats.issued << " state changes (" << lastStats.elided << " elided)";
+        return out.str();
+    }
+
+    // one row per scope per resolved frame, times in ms; sample() rows have a depth of -1 and only a cpu_ms
+    bool openCsv(const std::string& path)
+    {
+        closeCsv();
+        csv = std::fopen(path.c_str(), "w");
+        if (!csv)
+        {
+            std::cout << "GpuProfiler: cannot write " << path << std::endl;
+            return false;
+        }
+        std::fprintf(csv, "frame,scope,depth,cpu_ms,gpu_ms,draws,state_issued,state_elided\n");
+        return true;
+    }
+
+    void closeCsv()
+    {
+        if (csv)
+            std::fclose(csv);
+        csv = NULL;
+    }
+
+    // delete the queries, call before the context goes away
+    void shutdown()
+    {
+        for (unsigned int i = 0; i < FRAMES_IN_FLIGHT; i++)
+        {
+            if (!slots[i].queries.empty())
+                glDeleteQueries(static_cast<GLsizei>(slots[i].queries.size()), slots[i].queries.data());
+            slots[i].queries.clear();
+            slots[i].records.clear();
+        }
+        closeCsv();
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Record {
+        unsigned int scope;
+        unsigned int depth;
+        unsigned int query; // begin timestamp, the end one follows it
+        Clock::time_point cpuBegin, cpuEnd;
+    };
+    struct Slot {
+        Slot() : frame(0) { stats.issued = stats.elided = stats.draws = 0; }
+        std::vector<GLuint> queries;
+        std::vector<Record> records;
+        GLStateCache::Stats stats;
+        uint64_t frame;
+    };
+    // smoothed over the last frames so the readout does not flicker
+    struct Scope {
+        std::string name;
+        double cpu, gpu;
+    };
+
+    struct Sampled {
+        std::string name;
+        double smoothed;
+        std::vector<float> history;
+        uint64_t count;
+    };
+
+    Slot slots[FRAMES_IN_FLIGHT];
+    std::vector<size_t> open; // records of the current frame that have not ended yet
+    std::vector<Scope> scopes;
+    std::unordered_map<std::string, unsigned int> scopeIndices;
+    std::vector<float> cpuFrames, gpuFrames; // rings of HISTORY frame times
+    std::vector<Sampled> samples;
+    std::unordered_map<std::string, unsigned int> sampleIndices;
+    std::vector<FrameTiming> resolved;
+    GLStateCache::Stats lastStats;
+    uint64_t frame;
+    bool frameOpen;
+    bool keepFrames;
+    FILE* csv;
+    float lastGpuMs;
+
+    static Clock::time_point now() { return Clock::now(); }
+
+    unsigned int scopeIndex(const char* name)
+    {
+        std::unordered_map<std::string, unsigned int>::iterator it = scopeIndices.find(name);
+        if (it != scopeIndices.end())
+            return it->second;
+        Scope scope;
+        scope.name = name;
+        scope.cpu = scope.gpu = 0.0;
+        scopes.push_back(scope);
+        unsigned int index = static_cast<unsigned int>(scopes.size() - 1);
+        scopeIndices[name] = index;
+        return index;
+    }
+
+    void resolve(Slot& slot)
+    {
+        if (slot.records.empty())
+            return;
+        // the queries complete in order, so the last end timestamp being there means all of them are
+        GLint available = 0;
+        glGetQueryObjectiv(slot.queries[slot.records.back().query + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        GLint frameAvailable = 0;
+        glGetQueryObjectiv(slot.queries[slot.records.front().query + 1], GL_QUERY_RESULT_AVAILABLE, &frameAvailable);
+        bool gpu = available && frameAvailable;
+
+        lastStats = slot.stats;
+        std::vector<double> cpuTotals(scopes.size(), 0.0), gpuTotals(scopes.size(), 0.0);
+        std::vector<bool> seen(scopes.size(), false);
+        for (size_t i = 0; i < slot.records.size(); i++)
+        {
+            const Record& record = slot.records[i];
+            double cpuMs = std::chrono::duration<double, std::milli>(record.cpuEnd - record.cpuBegin).count();
+            double gpuMs = -1.0;
+            if (gpu)
+            {
+                GLuint64 begin = 0, end = 0;
+                glGetQueryObjectui64v(slot.queries[record.query], GL_QUERY_RESULT, &begin);
+                glGetQueryObjectui64v(slot.queries[record.query + 1], GL_QUERY_RESULT, &end);
+                gpuMs = end > begin ? (end - begin) / 1.0e6 : 0.0;
+                gpuTotals[record.scope] += gpuMs;
+            }
+            cpuTotals[record.scope] += cpuMs;
+            seen[record.scope] = true;
+            if (csv)
+                std::fprintf(csv, "%llu,%s,%u,%.4f,%.4f,%u,%u,%u\n", (unsigned long long)slot.frame, scopes[record.scope].name.c_str(), record.depth,
+                             cpuMs, gpuMs, slot.stats.draws, slot.stats.issued, slot.stats.elided);
+        }
+
+        const double blend = 0.1;
+        for (size_t s = 0; s < scopes.size(); s++)
+        {
+            if (!seen[s])
+                continue;
+            scopes[s].cpu += (cpuTotals[s] - scopes[s].cpu) * blend;
+            if (gpu)
+                scopes[s].gpu += (gpuTotals[s] - scopes[s].gpu) * blend;
+        }
+        push(cpuFrames, static_cast<float>(cpuTotals[0]), slot.frame);
+        if (gpu)
+            push(gpuFrames, static_cast<float>(gpuTotals[0]), slot.frame);
+        lastGpuMs = gpu ? static_cast<float>(gpuTotals[0]) : -1.0f;
+        if (keepFrames)
+        {
+            FrameTiming timing = { slot.frame, static_cast<float>(cpuTotals[0]), gpu ? static_cast<float>(gpuTotals[0]) : -1.0f };
+            resolved.push_back(timing);
+        }
+    }
+
+    static void push(std::vector<float>& ring, float value, uint64_t frame)
+    {
+        if (ring.size() < HISTORY)
+            ring.push_back(value);
+        else
+            ring[frame % HISTORY] = value;
+    }
+
+    static float percentile(const std::vector<float>& ring, float p)
+    {
+        if (ring.empty())
+            return 0.0f;
+        std::vector<float> sorted(ring);
+        size_t k = static_cast<size_t>(p * (sorted.size() - 1) + 0.5f);
+        std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+        return sorted[k];
+    }
+};
+
+// times everything until the end of the enclosing block
+class ProfileScope
+{
+public:
+    ProfileScope(GpuProfiler& profiler, const char* name) : profiler(profiler)
+    {
+        profiler.begin(name);
+    }
+    ~ProfileScope()
+    {
+        profiler.end();
+    }
+
+private:
+    GpuProfiler& profiler;
+    ProfileScope(const ProfileScope&);
+    ProfileScope& operator=(const ProfileScope&);
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef INSTANCE_BUFFER_H
+#define INSTANCE_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+// per-instance model matrices occupy attribute locations 7..10 (one vec4 column each):
+//     layout (location = 7) in mat4 aInstanceModel;
+#define INSTANCE_MATRIX_LOCATION 7
+
+// A streamed vertex buffer of per-instance model matrices, read with an attribute divisor of 1.
+// It grows to the largest batch it has seen and orphans its storage on every upload.
+class InstanceBuffer
+{
+public:
+    unsigned int ID;
+    size_t capacity;
+    size_t count;
+
+    InstanceBuffer() : ID(0), capacity(0), count(0)
+    {
+    }
+
+    // creates the buffer and hooks it up to the currently bound VAO
+    void attach(GLuint location = INSTANCE_MATRIX_LOCATION)
+    {
+        if (ID == 0)
+            glGenBuffers(1, &ID);
+        glBindBuffer(GL_ARRAY_BUFFER, ID);
+        for (GLuint i = 0; i < 4; i++)
+        {
+            glEnableVertexAttribArray(location + i);
+            glVertexAttribPointer(location + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(i * sizeof(glm::vec4)));
+            glVertexAttribDivisor(location + i, 1);
+        }
+    }
+
+    void upload(const glm::mat4* transforms, size_t n)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, ID);
+        if (n > capacity)
+            capacity = n;
+        glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+        if (n > 0)
+            glBufferSubData(GL_ARRAY_BUFFER, 0, n * sizeof(glm::mat4), transforms);
+        count = n;
+    }
+};
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef JOB_POOL_H
+#define JOB_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads for data parallel CPU work. parallelFor hands out indices one at a
+// time, so uneven jobs balance themselves, and the calling thread works along instead of idling.
+// One parallelFor runs at a time; jobs must not touch GL, which only the context thread may call.
+class JobPool
+{
+public:
+    JobPool() : stopping(false), job(NULL), next(0), total(0), busy(0), generation(0)
+    {
+    }
+    ~JobPool()
+    {
+        stop();
+    }
+
+    // threads that run jobs next to the caller
+    unsigned int workerCount()
+    {
+        start();
+        return static_cast<unsigned int>(workers.size());
+    }
+
+    // runs work(i) for every i in [0, count), returns once all of them are done
+    void parallelFor(size_t count, const std::function<void(size_t)>& work)
+    {
+        if (count == 0)
+            return;
+        std::lock_guard<std::mutex> batch(batchMutex);
+        start();
+        if (count == 1 || workers.empty())
+        {
+            for (size_t i = 0; i < count; i++)
+                work(i);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &work;
+            next = 0;
+            total = count;
+            busy = static_cast<unsigned int>(workers.size());
+            generation++;
+        }
+        wake.notify_all();
+
+        run();
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return busy == 0; });
+        job = NULL;
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+        workers.clear();
+        stopping = false;
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex batchMutex;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    bool stopping;
+
+    const std::function<void(size_t)>* job;
+    std::atomic<size_t> next;
+    size_t total;
+    unsigned int busy;       // workers that have not finished the current batch
+    uint64_t generation;     // bumped for every batch so workers know there is new work
+
+    void start()
+    {
+        if (!workers.empty())
+            return;
+        // the caller is the last participant, hardware_concurrency() may also report 0
+        unsigned int cores = std::thread::hardware_concurrency();
+        unsigned int count = cores > 1 ? cores - 1 : 0;
+        for (unsigned int i = 0; i < count; i++)
+            workers.push_back(std::thread(&JobPool::work, this));
+    }
+
+    void run()
+    {
+        for (size_t i = next++; i < total; i = next++)
+            (*job)(i);
+    }
+
+    void work()
+    {
+        uint64_t seen = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this, seen] { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+            }
+            run();
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--busy == 0)
+                done.notify_all();
+        }
+    }
+};
+
+inline JobPool& jobPool()
+{
+    static JobPool pool;
+    return pool;
+}
+
+#endif
@@ -6,10 +6,32 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include </OpenGl programming/Sandbox/gl_extensions.h>
+#include </OpenGl programming/Sandbox/gl_state_cache.h>
 #include </OpenGl programming/Sandbox/shader_s.h>
+#include </OpenGl programming/Sandbox/shader_library.h>
 #include </OpenGl programming/Sandbox/camera.h>
 #include </OpenGl programming/Sandbox/model.h>
+#include </OpenGl programming/Sandbox/uniform_buffer.h>
+#include </OpenGl programming/Sandbox/render_queue.h>
+#include </OpenGl programming/Sandbox/instance_buffer.h>
+#include </OpenGl programming/Sandbox/texture_loader.h>
+#include </OpenGl programming/Sandbox/texture_cache.h>
+#include </OpenGl programming/Sandbox/gpu_profiler.h>
+#include </OpenGl programming/Sandbox/benchmark.h>
+#include </OpenGl programming/Sandbox/frustum.h>
+#include </OpenGl programming/Sandbox/scene.h>
+#include </OpenGl programming/Sandbox/gbuffer.h>
+#include </OpenGl programming/Sandbox/clustered_lighting.h>
+#include </OpenGl programming/Sandbox/overdraw.h>
+#include </OpenGl programming/Sandbox/render_target.h>
+#include </OpenGl programming/Sandbox/environment_probe.h>
+#include </OpenGl programming/Sandbox/skinning.h>
+#include </OpenGl programming/Sandbox/simulation.h>
+#include </OpenGl programming/Sandbox/gpu_effects.h>
 #include <iostream>
+#include <memory>
+#include <algorithm>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
@@ -18,6 +40,8 @@ void processInput(GLFWwindow* window);
 unsigned int loadTexture(const char* path, bool gammaCorrection);
 unsigned int loadCubemap(std::vector<std::string> faces);
 void renderQuad();
+unsigned int getQuadVAO();
+void animatePointLights(std::vector<PointLight>& lights, const glm::vec3& keyLight, float time);
 
 // settings
 const unsigned int SCR_WIDTH = 800;
@@ -27,19 +51,39 @@ Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
 float lastX = (float)SCR_WIDTH / 2.0;
 float lastY = (float)SCR_HEIGHT / 2.0;
 bool firstMouse = true;
+// the callbacks add up the mouse here until processInput hands it to the simulation thread
+InputState pendingInput;
+Simulation simulation;
 float heightScale = 0.1f;
+// head-on and distant parallax pixels march with no fewer layers than this
+const float PARALLAX_MIN_LAYERS = 8.0f;
+
+// F5 starts and stops recording the camera into camera_path.txt, to be replayed with --benchmark --camera
+CameraPath recordedPath;
+bool recordingPath = false;
+
+// F6 toggles the depth pre-pass, F7 shows how many fragments every pixel was written with instead of the scene
+bool depthPrepass = false;
+bool showOverdraw = false;
+// F8 toggles the dynamic resolution, off it always renders at the window's size
+bool dynamicResolution = true;
 
 // timing
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
 
-int main()
+int main(int argc, char** argv)
 {
+    BenchmarkOptions benchmark;
+    if (!parseBenchmarkOptions(argc, argv, benchmark))
+        return -1;
+
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    // ask for 4.3 core first (multi-draw indirect), the renderer falls back to 3.3 core paths otherwise
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
@@ -47,12 +91,21 @@ int main()
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
-    glfwWindowHint(GLFW_SAMPLES, 4);
+    // no window multisampling: the scene renders into its own MSAA target and only the resolved image reaches the window
+    // benchmarks render at the fixed SCR_WIDTH x SCR_HEIGHT into a window that is never shown
+    if (benchmark.enabled)
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
     // glfw window creation
     // --------------------
     GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Sandbox", NULL, NULL);
     if (window == NULL)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Sandbox", NULL, NULL);
+    }
+    if (window == NULL)
     {
         std::cout << "Failed to create GLFW window" << std::endl;
         glfwTerminate();
@@ -60,10 +113,17 @@ int main()
     }
     glfwMakeContextCurrent(window);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
-
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    if (benchmark.enabled)
+    {
+        // measure what the renderer can do, not the display's refresh rate
+        glfwSwapInterval(0);
+    }
+    else
+    {
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    }
     // glad: load all OpenGL function pointers
     // ---------------------------------------
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
@@ -71,20 +131,61 @@ int main()
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    loadGLExtensions((GLADloadproc)glfwGetProcAddress);
 
     // configure global opengl state
     // -----------------------------
     glEnable(GL_DEPTH_TEST);
+    glState().depthFunc(GL_LESS);
     glEnable(GL_MULTISAMPLE);
+    // the prefiltered environment levels are small, filtering across face edges keeps their seams away
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
     // build and compile our shader zprogram
     // ------------------------------------
-    Shader shader("shader.vs", "shader.fs");
-    Shader skyboxShader("skybox.vs", "skybox.fs");
-    Shader reflectShader("reflect.vs", "reflect.fs");
-    Shader redflag("flagr.vs", "flagr.fs");
-    Shader parallax("parallax_mapping.vs", "parallax_mapping.fs");
+    // all of them are started before any is waited on, so the driver can compile them in parallel;
+    // each one finishes on its first use. The library rebuilds them whenever a source file is saved.
+    ShaderLibrary shaders;
+    Shader& shader = shaders.load("shader", "shader.vs", "shader.fs");
+    Shader& skyboxShader = shaders.load("skybox", "skybox.vs", "skybox.fs");
+    Shader& reflectShader = shaders.load("reflect", "reflect.vs", "reflect.fs");
+    Shader& redflag = shaders.load("redflag", "flagr.vs", "flagr.fs");
+    Shader& parallax = shaders.load("parallax", "parallax_mapping.vs", "parallax_mapping.fs");
+    Shader& depthInstanced = shaders.load("depth_instanced", "depth_instanced.vs", "depth_only.fs");
+    Shader& depthShader = shaders.load("depth", "depth.vs", "depth_only.fs");
+    Shader& overdrawShader = shaders.load("overdraw", "fullscreen.vs", "overdraw.fs");
+    Shader& upscaleShader = shaders.load("upscale", "fullscreen.vs", "upscale.fs");
+    Shader& prefilterShader = shaders.load("prefilter", "fullscreen.vs", "prefilter.fs");
+    // the deferred path culls its lights with compute shaders; without them everything stays forward
+    Shader* gbufferParallax = NULL;
+    Shader* clusterBounds = NULL;
+    Shader* lightCull = NULL;
+    Shader* deferredShading = NULL;
+    // animated benchmark models are skinned in a compute shader as well, they stay in their bind pose without
+    Shader* skinningProgram = NULL;
+    const bool deferred = glCaps().computeShaders;
+    if (deferred)
+    {
+        gbufferParallax = &shaders.load("gbuffer_parallax", "gbuffer.vs", "gbuffer_parallax.fs");
+        clusterBounds = &shaders.loadCompute("cluster_bounds", "cluster_bounds.comp");
+        lightCull = &shaders.loadCompute("light_cull", "light_cull.comp");
+        deferredShading = &shaders.load("deferred_lighting", "deferred_lighting.vs", "deferred_lighting.fs");
+        skinningProgram = &shaders.loadCompute("skinning", "skinning.comp");
+    }
+    // the flag's cloth and the sparks are simulated on the GPU as well; without that the flag stays a flat quad
+    Shader* clothProgram = NULL;
+    Shader* clothShader = NULL;
+    Shader* sparksProgram = NULL;
+    Shader* sparksShader = NULL;
+    const bool gpuEffects = gpuEffectsSupported();
+    if (gpuEffects)
+    {
+        clothProgram = &shaders.loadCompute("cloth_step", "cloth.comp");
+        clothShader = &shaders.load("cloth", "cloth.vs", "cloth.fs");
+        sparksProgram = &shaders.loadCompute("particles_step", "particles.comp");
+        sparksShader = &shaders.load("particles", "particles.vs", "particles.fs");
+    }
+    shaders.watch();
 
-    //Shader explosion("basic.vs", "basic.fs", "geometry.gs");
     // set up vertex data (and buffer(s)) and configure vertex attributes
     // ------------------------------------------------------------------
     float pyramidVertices[] = {
@@ -178,7 +279,7 @@ int main()
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
     glGenBuffers(1, &EBO);
-    glBindVertexArray(VAO);
+    glState().bindVertexArray(VAO);
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(pyramidVertices), &pyramidVertices, GL_STATIC_DRAW);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
@@ -188,12 +289,50 @@ int main()
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE,  6 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-    glBindVertexArray(0);
+    InstanceBuffer pyramidInstances;
+    pyramidInstances.attach();
+
+    // the reflective pyramids share the geometry but stream their own instance transforms
+    unsigned int reflectVAO;
+    glGenVertexArrays(1, &reflectVAO);
+    glState().bindVertexArray(reflectVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+    InstanceBuffer reflectInstances;
+    reflectInstances.attach();
+
+    // position-only stream of the same pyramids for the depth pre-pass, one VAO per instance buffer
+    float pyramidPositions[5 * 3];
+    for (int i = 0; i < 5; i++)
+        for (int c = 0; c < 3; c++)
+            pyramidPositions[i * 3 + c] = pyramidVertices[i * 6 + c];
+    unsigned int pyramidPositionVBO, pyramidDepthVAO, reflectDepthVAO;
+    glGenBuffers(1, &pyramidPositionVBO);
+    glGenVertexArrays(1, &pyramidDepthVAO);
+    glGenVertexArrays(1, &reflectDepthVAO);
+    unsigned int depthVAOs[2] = { pyramidDepthVAO, reflectDepthVAO };
+    InstanceBuffer* depthInstances[2] = { &pyramidInstances, &reflectInstances };
+    for (int i = 0; i < 2; i++)
+    {
+        glState().bindVertexArray(depthVAOs[i]);
+        glBindBuffer(GL_ARRAY_BUFFER, pyramidPositionVBO);
+        if (i == 0)
+            glBufferData(GL_ARRAY_BUFFER, sizeof(pyramidPositions), &pyramidPositions, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        depthInstances[i]->attach();
+    }
+    glState().bindVertexArray(0);
 
     unsigned int skyVAO, skyVBO;
     glGenVertexArrays(1, &skyVAO);
     glGenBuffers(1, &skyVBO);
-    glBindVertexArray(skyVAO);
+    glState().bindVertexArray(skyVAO);
     glBindBuffer(GL_ARRAY_BUFFER, skyVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
@@ -202,11 +341,20 @@ int main()
     unsigned int bayraqVAO, bayraqVBO;
     glGenVertexArrays(1, &bayraqVAO);
     glGenBuffers(1, &bayraqVBO);
-    glBindVertexArray(bayraqVAO);
+    glState().bindVertexArray(bayraqVAO);
     glBindBuffer(GL_ARRAY_BUFFER, bayraqVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(rectangleVertices), &rectangleVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    // the same flag as cloth, where the quad hangs; and a burst of sparks every few seconds
+    GpuCloth flagCloth;
+    GpuParticles sparks;
+    if (gpuEffects)
+    {
+        flagCloth.create(glm::vec3(3.0f, 0.0f, 4.0f), 1.0f, 1.0f, 48, 48);
+        sparks.emitter = glm::vec3(-3.0f, 0.5f, 1.0f);
+        sparks.create(32768);
+    }
 
     vector<std::string> faces
     {
@@ -229,125 +377,617 @@ int main()
     skyboxShader.setInt("skybox", 0);
 
     reflectShader.use();
-    reflectShader.setInt("skybox", 0);
+    reflectShader.setInt("environment", 0);
     parallax.use();
     parallax.setInt("diffuseMap", 0);
     parallax.setInt("normalMap", 1);
     parallax.setInt("depthMap", 2);
+    if (deferred)
+    {
+        gbufferParallax->use();
+        gbufferParallax->setInt("diffuseMap", 0);
+        gbufferParallax->setInt("normalMap", 1);
+        gbufferParallax->setInt("depthMap", 2);
+        deferredShading->use();
+        deferredShading->setInt("gAlbedoSpecular", 0);
+        deferredShading->setInt("gNormal", 1);
+        deferredShading->setInt("gDepth", 2);
+    }
 
     // lighting info
     // -------------
     glm::vec3 lightPos(3.2, 4.0, 4.2);
 
+    // per-frame data (projection, view, camera and light) is uploaded once into the FrameData block,
+    // every program declaring it was bound to FRAME_DATA_BINDING when it was linked
+    // ------------------------------------------------------------------------------------------------
+    UniformBuffer<FrameData> frameUBO(FRAME_DATA_BINDING);
+    FrameData frameData;
+    frameData.lightPos = lightPos;
+    // the deferred path lights the scene with many point lights, the first one sits at lightPos
+    GBuffer gbuffer;
+    ClusteredLighting clusteredLighting;
+    std::vector<PointLight> pointLights(deferred ? 1024 : 0);
+
+    // resolve per-object uniforms once so the render loop does no name lookups
+    // ------------------------------------------------------------------------
+    // (and again whenever the program is hot-reloaded, locations can move between builds)
+    UniformHandle redflagModel, parallaxModel, parallaxHeightScale, parallaxMinLayers, parallaxMaxLayers, depthModel;
+    shaders.onProgramChange("redflag", [&](Shader& program) {
+        redflagModel = program.getUniform("model");
+    });
+    shaders.onProgramChange("depth", [&](Shader& program) {
+        depthModel = program.getUniform("model");
+    });
+    shaders.onProgramChange("parallax", [&](Shader& program) {
+        parallaxModel = program.getUniform("model");
+        parallaxHeightScale = program.getUniform("heightScale");
+        parallaxMinLayers = program.getUniform("minLayers");
+        parallaxMaxLayers = program.getUniform("maxLayers");
+    });
+    UniformHandle reflectRoughness, reflectEnvironmentSize, reflectMaxLod;
+    shaders.onProgramChange("reflect", [&](Shader& program) {
+        reflectRoughness = program.getUniform("roughness");
+        reflectEnvironmentSize = program.getUniform("environmentSize");
+        reflectMaxLod = program.getUniform("maxLod");
+    });
+    UniformHandle gbufferModel, gbufferHeightScale, gbufferMinLayers, gbufferMaxLayers;
+    if (deferred)
+    {
+        shaders.onProgramChange("gbuffer_parallax", [&](Shader& program) {
+            gbufferModel = program.getUniform("model");
+            gbufferHeightScale = program.getUniform("heightScale");
+            gbufferMinLayers = program.getUniform("minLayers");
+            gbufferMaxLayers = program.getUniform("maxLayers");
+        });
+    }
+    if (gpuEffects)
+    {
+        shaders.onProgramChange("cloth_step", [&](Shader& program) { flagCloth.resolveStepUniforms(program); });
+        shaders.onProgramChange("cloth", [&](Shader& program) { flagCloth.resolveDrawUniforms(program); });
+        shaders.onProgramChange("particles_step", [&](Shader& program) { sparks.resolveStepUniforms(program); });
+        shaders.onProgramChange("particles", [&](Shader& program) { sparks.resolveDrawUniforms(program); });
+    }
+
+    // materials are registered with the render queue once and referenced by id from then on
+    // ---------------------------------------------------------------------------------------
+    RenderQueue queue;
+    MaterialTexture skyboxTextures[] = {
+        { 0, GL_TEXTURE_CUBE_MAP, cubemapTexture }
+    };
+    unsigned int skyboxMaterial = queue.addMaterial(skyboxTextures, 1);
+    MaterialTexture toyboxTextures[] = {
+        { 0, GL_TEXTURE_2D, toyboxTexture },
+        { 1, GL_TEXTURE_2D, toyboxNormalTexture },
+        { 2, GL_TEXTURE_2D, toybox_d }
+    };
+    unsigned int toyboxMaterial = queue.addMaterial(toyboxTextures, 3);
+
+    // reflections read prefiltered environments with textureLod: the sky's, and the probe's capture of the
+    // still scene around the reflective pyramids once it has one. The sky is filtered again when the
+    // streamed in faces replace the placeholder, the probe recaptures when what it sees changes.
+    // ---------------------------------------------------------------------------------------------------
+    EnvironmentMap skyEnvironment;
+    skyEnvironment.prefilter(prefilterShader, cubemapTexture);
+    bool skyEnvironmentStale = true;
+    ReflectionProbe probe(glm::vec3(1.0f, 1.0f, 2.0f));
+    probe.environment.create();
+    MaterialTexture skyEnvironmentTextures[] = {
+        { 0, GL_TEXTURE_CUBE_MAP, skyEnvironment.texture }
+    };
+    unsigned int skyEnvironmentMaterial = queue.addMaterial(skyEnvironmentTextures, 1);
+    MaterialTexture probeTextures[] = {
+        { 0, GL_TEXTURE_CUBE_MAP, probe.environment.texture }
+    };
+    unsigned int probeMaterial = queue.addMaterial(probeTextures, 1);
+    // the probe draws its faces through a queue of its own, sorted with its own view
+    RenderQueue probeQueue;
+    unsigned int probeSkyboxMaterial = probeQueue.addMaterial(skyboxTextures, 1);
+    std::vector<int> probeNodes;
+    const char* capturedPrograms[] = { "shader", "skybox", "redflag" };
+    for (size_t i = 0; i < sizeof(capturedPrograms) / sizeof(capturedPrograms[0]); i++)
+        shaders.onProgramChange(capturedPrograms[i], [&](Shader&) { probe.markDirty(); });
+    shaders.onProgramChange("prefilter", [&](Shader&) {
+        skyEnvironmentStale = true;
+        probe.markDirty();
+    });
+
+    // frame timings go to the window title twice a second and to profile.csv every frame
+    // ------------------------------------------------------------------------------------
+    GpuProfiler profiler;
+    profiler.openCsv("profile.csv");
+    float lastTitleUpdate = 0.0f;
+    OverdrawCounter overdraw;
+    depthPrepass = benchmark.depthPrepass;
+    // benchmarks always measure the full resolution
+    SceneTarget sceneTarget;
+    DynamicResolution resolution;
+    if (benchmark.enabled)
+        dynamicResolution = false;
+
+    // what the scene renders; the interactive mode keeps the defaults, benchmark scenarios change them
+    // --------------------------------------------------------------------------------------------------
+    unsigned int pyramidPairs = 1;
+    // the parallax march picks its layer count per pixel, up to this many
+    float parallaxLayers = 32.0f;
+    std::vector<glm::mat4> pyramidModels;
+    std::unique_ptr<Model> benchmarkModel;
+    std::string benchmarkModelPath;
+    // the benchmark model's instances, culled through the scene's BVH
+    Scene scene;
+    std::vector<int> visibleNodes;
+    LodSelector lodSelector;
+    // the visible nodes are culled, given their level and recorded on the job pool, four slices a thread
+    // so uneven slices even out, then drawn from the context thread
+    CommandRecorder sceneCommands;
+    GLCommandBackend glBackend;
+    const size_t recordJobs = (jobPool().workerCount() + 1) * 4;
+    // instances of an animated benchmark model: posed on the job pool, skinned once per frame on the GPU
+    GpuSkinning characters;
+    if (skinningProgram)
+        shaders.onProgramChange("skinning", [&](Shader& program) { characters.resolveUniforms(program); });
+    AnimationSampler animationSampler;
+    std::vector<AnimationState> characterStates;
+
+    // object space bounds of the hand-made geometry, for frustum culling; the flag's vertex shader
+    // waves it along z, so its box is given some depth
+    const glm::vec3 pyramidMin(-0.5f, 0.0f, -0.5f), pyramidMax(0.5f, 1.0f, 0.5f);
+    const glm::vec3 flagMin(-0.5f, -0.5f, -0.25f), flagMax(0.5f, 0.5f, 0.25f);
+    const glm::vec3 quadMin(-1.0f, -1.0f, 0.0f), quadMax(1.0f, 1.0f, 0.0f);
+    FrustumCuller culler;
+    std::vector<glm::mat4> visibleInstances;
+
+    BenchmarkRunner runner;
+    if (benchmark.enabled)
+    {
+        if (benchmark.scenarioFile.empty())
+            runner.scenarios = defaultBenchmarkScenarios();
+        else if (!loadBenchmarkScenarios(benchmark.scenarioFile, runner.scenarios))
+            return -1;
+        if (benchmark.cameraFile.empty())
+            runner.path = CameraPath::orbit();
+        else if (!runner.path.load(benchmark.cameraFile))
+            return -1;
+        // nothing may still be streaming in while frames are timed
+        textureLoader().finish();
+    }
+    // benchmarks step the clock and the camera themselves, once a frame and exactly the same every run
+    FramePacing pacing;
+    SimulationState shownState;
+    if (!benchmark.enabled)
+        simulation.start(camera);
+
     // render loop
     // -----------
     while (!glfwWindowShouldClose(window))
     {
 
         float currentFrame = static_cast<float>(glfwGetTime());
+        if (benchmark.enabled)
+        {
+            if (runner.finished())
+                break;
+            if (runner.scenarioStarting())
+            {
+                const BenchmarkScenario& scenario = runner.scenario();
+                pyramidPairs = scenario.pyramids;
+                parallaxLayers = scenario.parallaxLayers;
+                scene.clear();
+                characters.release();
+                characterStates.clear();
+                if (scenario.models > 0)
+                {
+                    std::string path = scenario.modelPath.empty() ? "D:/OpenGl programming/OpenGl_FirstProject/resources/textures/backpack/backpack.obj" : scenario.modelPath;
+                    if (!benchmarkModel || benchmarkModelPath != path)
+                    {
+                        if (benchmarkModel)
+                            benchmarkModel->ReleaseTextures();
+                        ModelOptions options;
+                        options.lodLevels = MAX_MESH_LODS;
+                        options.animated = skinningProgram != NULL;
+                        benchmarkModel.reset(new Model(path, options));
+                        benchmarkModelPath = path;
+                        textureLoader().finish();
+                    }
+                    unsigned int side = static_cast<unsigned int>(ceil(sqrt((float)scenario.models)));
+                    // an animated model plays its first clip on every instance, each a little further in
+                    bool animate = !benchmarkModel->skeleton.empty() && characters.resize(*benchmarkModel, scenario.models);
+                    for (unsigned int i = 0; i < scenario.models; i++)
+                    {
+                        glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3((i % side) * 3.0f - side * 1.5f, 0.0f, -6.0f - (i / side) * 3.0f));
+                        if (animate)
+                        {
+                            AnimationState state = { 0, i * 0.37f, transform };
+                            characterStates.push_back(state);
+                        }
+                        else
+                            scene.addModel(*benchmarkModel, transform);
+                    }
+                }
+                probe.markDirty();
+            }
+            // simulated time advances by exactly one timestep per frame
+            runner.beginFrame(camera, profiler);
+            currentFrame = runner.time();
+            lastFrame = currentFrame - runner.timestep;
+        }
+        else
+        {
+            // the simulation thread moves the camera and the clock, the frame draws where they were one step ago
+            processInput(window);
+            shownState = simulation.sample();
+            camera.SetPose(shownState.cameraPosition, shownState.yaw, shownState.pitch);
+            camera.Zoom = shownState.zoom;
+            currentFrame = static_cast<float>(shownState.time);
+        }
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
+        glState().beginFrame();
+        profiler.beginFrame();
+        textureLoader().update();
+        shaders.update();
 
-        processInput(window);
+        if (recordingPath)
+            recordedPath.record(currentFrame, camera);
         
         //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
         // render
         // ------
+        // refresh the reflections' environments before the frame's own FrameData goes up
+        if (skyEnvironmentStale && textureLoader().done())
+        {
+            ProfileScope scope(profiler, "prefilter sky");
+            skyEnvironment.prefilter(prefilterShader, cubemapTexture);
+            skyEnvironmentStale = false;
+            probe.markDirty();
+        }
+        if (probe.needsUpdate())
+        {
+            // one face a frame, of everything that stays put: the sky, the flag and the scene's models
+            ProfileScope scope(profiler, "probe");
+            probe.update(prefilterShader, [&](const glm::mat4& faceView, const glm::mat4& faceProjection) {
+                FrameData probeFrame = frameData;
+                probeFrame.projection = faceProjection;
+                probeFrame.view = faceView;
+                probeFrame.cameraPos = probe.position;
+                probeFrame.time = currentFrame;
+                frameUBO.update(probeFrame);
+
+                probeQueue.begin(faceView, probe.zNear, probe.zFar);
+                // the cloth flag moves, so it is left out of the capture
+                DrawItem probeFlag = { &redflag, redflagModel, glm::translate(glm::mat4(1.0f), glm::vec3(3.0, 0.0, 4.0)), 0, bayraqVAO, GL_TRIANGLES, 6, false, 0, "flag", NULL, UniformHandle(), 0 };
+                if (!gpuEffects)
+                    probeQueue.submit(PASS_OPAQUE, probeFlag);
+                DrawItem probeSkybox = { &skyboxShader, UniformHandle(), glm::mat4(1.0f), probeSkyboxMaterial, skyVAO, GL_TRIANGLES, 36, false, 0, "skybox", NULL, UniformHandle(), 0 };
+                probeQueue.submit(PASS_BACKGROUND, probeSkybox);
+                probeQueue.sort();
+                probeQueue.execute();
+
+                scene.update();
+                scene.queryFrustum(Frustum::fromMatrix(faceProjection * faceView), probeNodes);
+                if (!probeNodes.empty())
+                {
+                    shader.use();
+                    scene.drawInstanced(shader, probeNodes);
+                }
+            });
+        }
+
+        // the scene renders offscreen at the share of the window's resolution the GPU keeps up with and is
+        // upscaled to the window at the end; the targets follow the window's size from here
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        resolution.enabled = dynamicResolution;
+        resolution.update(profiler.lastGpuFrameMs());
+        // without its offscreen target the scene is drawn natively into the window, with nothing to upscale
+        bool offscreen = sceneTarget.resize(framebufferWidth, framebufferHeight);
+        sceneTarget.setScale(resolution.scale);
+        // the deferred path needs its G-buffer, allocated like the scene target and drawn to through the
+        // same viewport; without one the frame is drawn forward
+        bool deferredFrame = deferred && gbuffer.resize(sceneTarget.allocatedWidth, sceneTarget.allocatedHeight);
+        gbuffer.setViewport(sceneTarget.width, sceneTarget.height);
+        sceneTarget.bind();
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        shader.use();
+        // the scene renders into the overdraw counter instead while it is shown
+        bool countOverdraw = showOverdraw && overdraw.resize(sceneTarget.allocatedWidth, sceneTarget.allocatedHeight);
+        overdraw.setViewport(sceneTarget.width, sceneTarget.height);
 
         glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
         glm::mat4 view = camera.GetViewMatrix();
+        frameData.projection = projection;
+        frameData.view = view;
+        frameData.cameraPos = camera.Position;
+        frameData.time = currentFrame;
+        frameData.deltaTime = deltaTime;
+        frameUBO.update(frameData);
+        Frustum frustum = Frustum::fromMatrix(projection * view);
+
+        // collect this frame's draws; the queue sorts them by pass/program/material/VAO/depth before drawing
+        queue.begin(view, 0.1f, 100.0f);
+
+        // the upright and upside-down pyramid of each program are one instanced draw; further pairs
+        // (benchmark scenarios) are laid out on a grid behind the first
+        unsigned int pyramidGrid = static_cast<unsigned int>(ceil(sqrt((float)pyramidPairs)));
+        pyramidModels.resize(pyramidPairs * 2);
         glm::mat4 model = glm::mat4(1.0f);
-        model = glm::rotate(model, (float)glfwGetTime() * glm::radians(50.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        shader.setMat4("projection", projection);
-        shader.setMat4("view", view);
-        shader.setMat4("model", model);
-
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 18, GL_UNSIGNED_INT, 0);
-        
+        for (unsigned int i = 0; i < pyramidPairs; i++)
+        {
+            glm::vec3 offset((float)(i % pyramidGrid) * -3.0f, 0.0f, (float)(i / pyramidGrid) * -3.0f);
+            model = glm::translate(glm::mat4(1.0f), offset);
+            model = glm::rotate(model, currentFrame * glm::radians(50.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+            pyramidModels[i * 2] = model;
+
+            glm::mat4 upsideDownModel = glm::mat4(1.0f);
+            upsideDownModel = glm::translate(upsideDownModel, offset + glm::vec3(0.0f, 2.0f, 0.0f));
+            upsideDownModel = glm::scale(upsideDownModel, glm::vec3(1.0f, -1.0f, 1.0f));
+            upsideDownModel = glm::rotate(upsideDownModel, currentFrame * glm::radians(50.0f), glm::vec3(0.0f, -1.0f, 0.0f));
+            pyramidModels[i * 2 + 1] = upsideDownModel;
+        }
+        cullInstances(culler, frustum, pyramidModels.data(), pyramidModels.size(), pyramidMin, pyramidMax, visibleInstances);
+        model = visibleInstances.empty() ? glm::mat4(1.0f) : visibleInstances[0];
+        pyramidInstances.upload(visibleInstances.data(), visibleInstances.size());
 
-        glm::mat4 upsideDownModel = glm::mat4(1.0f);
-        upsideDownModel = glm::translate(upsideDownModel, glm::vec3(0.0f, 2.0f, 0.0f));
-        upsideDownModel = glm::scale(upsideDownModel, glm::vec3(1.0f, -1.0f, 1.0f));
-        upsideDownModel = glm::rotate(upsideDownModel, (float)glfwGetTime() * glm::radians(50.0f), glm::vec3(0.0f, -1.0f, 0.0f));
-        shader.setMat4("model", upsideDownModel);
-        glDrawElements(GL_TRIANGLES, 18, GL_UNSIGNED_INT, 0);
+        DrawItem pyramids = { &shader, UniformHandle(), model, 0, VAO, GL_TRIANGLES, 18, true, (GLsizei)visibleInstances.size(), "pyramids",
+                              &depthInstanced, UniformHandle(), pyramidDepthVAO };
+        if (!visibleInstances.empty())
+            queue.submit(PASS_OPAQUE, pyramids);
 
         //glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
-        reflectShader.use();
         glm::mat4 reflectModel = glm::mat4(1.0f);
-        reflectModel = glm::translate(reflectModel, glm::vec3(1.0f, 0.0f, 2.0f));
-        reflectModel = glm::rotate(reflectModel, (float)glfwGetTime() * glm::radians(50.0f), glm::vec3(0.0f, -1.0f, 0.0f));
-        reflectShader.setMat4("model", reflectModel);
-        reflectShader.setMat4("projection", projection);
-        reflectShader.setMat4("view", view);
-        reflectShader.setVec3("cameraPos", camera.Position);
-        glBindVertexArray(VAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glDrawElements(GL_TRIANGLES, 18, GL_UNSIGNED_INT, 0);
-
-        glm::mat4 upsideDownModel2 = glm::mat4(1.0f);
-        upsideDownModel2 = glm::translate(upsideDownModel2, glm::vec3(1.0f, 2.0f, 2.0f));
-        upsideDownModel2 = glm::scale(upsideDownModel2, glm::vec3(1.0f, -1.0f, 1.0f));
-        upsideDownModel2 = glm::rotate(upsideDownModel2, (float)glfwGetTime() * glm::radians(50.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        reflectShader.setMat4("model", upsideDownModel2);
-        glDrawElements(GL_TRIANGLES, 18, GL_UNSIGNED_INT, 0);
-
-        redflag.use();
+        for (unsigned int i = 0; i < pyramidPairs; i++)
+        {
+            glm::vec3 offset((float)(i % pyramidGrid) * 3.0f, 0.0f, (float)(i / pyramidGrid) * -3.0f);
+            reflectModel = glm::translate(glm::mat4(1.0f), offset + glm::vec3(1.0f, 0.0f, 2.0f));
+            reflectModel = glm::rotate(reflectModel, currentFrame * glm::radians(50.0f), glm::vec3(0.0f, -1.0f, 0.0f));
+            pyramidModels[i * 2] = reflectModel;
+
+            glm::mat4 upsideDownModel2 = glm::mat4(1.0f);
+            upsideDownModel2 = glm::translate(upsideDownModel2, offset + glm::vec3(1.0f, 2.0f, 2.0f));
+            upsideDownModel2 = glm::scale(upsideDownModel2, glm::vec3(1.0f, -1.0f, 1.0f));
+            upsideDownModel2 = glm::rotate(upsideDownModel2, currentFrame * glm::radians(50.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+            pyramidModels[i * 2 + 1] = upsideDownModel2;
+        }
+        cullInstances(culler, frustum, pyramidModels.data(), pyramidModels.size(), pyramidMin, pyramidMax, visibleInstances);
+        reflectModel = visibleInstances.empty() ? glm::mat4(1.0f) : visibleInstances[0];
+        reflectInstances.upload(visibleInstances.data(), visibleInstances.size());
+
+        DrawItem reflectPyramids = { &reflectShader, UniformHandle(), reflectModel, probe.ready() ? probeMaterial : skyEnvironmentMaterial, reflectVAO, GL_TRIANGLES, 18, true, (GLsizei)visibleInstances.size(), "reflect",
+                                     &depthInstanced, UniformHandle(), reflectDepthVAO };
+        if (!visibleInstances.empty())
+            queue.submit(PASS_OPAQUE, reflectPyramids);
+
         glm::mat4 redflag1 = glm::mat4(1.0f);
         redflag1 = glm::translate(redflag1, glm::vec3(3.0, 0.0, 4.0));
-        redflag.setMat4("model", redflag1);
-        redflag.setMat4("view", view);
-        redflag.setMat4("projection", projection);
-        glBindVertexArray(bayraqVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        // the flag's vertices are positions only already
+        DrawItem flag = { &redflag, redflagModel, redflag1, 0, bayraqVAO, GL_TRIANGLES, 6, false, 0, "flag", &depthShader, depthModel, bayraqVAO };
+        glm::vec3 center, extent;
+        transformBounds(redflag1, flagMin, flagMax, center, extent);
+        if (!gpuEffects && frustum.intersects(center, extent))
+            queue.submit(PASS_OPAQUE, flag);
 
-        parallax.use();
-        parallax.setMat4("projection", projection);
-        parallax.setMat4("view", view);
         glm::mat4 parm = glm::mat4(1.0f);
         parm = glm::translate(parm, glm::vec3(3.0, 4.0, 4.0));
-        parm = glm::rotate(parm, glm::radians((float)glfwGetTime() * -10.0f), glm::normalize(glm::vec3(1.0, 0.0, 1.0)));
-        parallax.setMat4("model", parm);
-        parallax.setVec3("viewPos", camera.Position);
-        parallax.setVec3("lightPos", lightPos);
-        parallax.setFloat("heightScale", heightScale);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, toyboxTexture);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, toyboxNormalTexture);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, toybox_d);
-        renderQuad();
-
-        glBindVertexArray(skyVAO);
-        glDepthFunc(GL_LEQUAL);
-        skyboxShader.use();
-        view = glm::mat4(glm::mat3(camera.GetViewMatrix()));
-        skyboxShader.setMat4("view", view);
-        skyboxShader.setMat4("projection", projection);
-        
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        glDepthFunc(GL_LESS);
+        parm = glm::rotate(parm, glm::radians(currentFrame * -10.0f), glm::normalize(glm::vec3(1.0, 0.0, 1.0)));
+        // parallax_mapping.fs discards texels marched off the quad, so the toybox stays out of the depth pre-pass
+        DrawItem toybox = { &parallax, parallaxModel, parm, toyboxMaterial, getQuadVAO(), GL_TRIANGLE_STRIP, 6, false, 0, "parallax", NULL, UniformHandle(), 0 };
+        if (deferredFrame)
+        {
+            toybox.shader = gbufferParallax;
+            toybox.modelLocation = gbufferModel;
+        }
+        transformBounds(parm, quadMin, quadMax, center, extent);
+        if (frustum.intersects(center, extent))
+            queue.submit(deferredFrame ? PASS_GBUFFER : PASS_OPAQUE, toybox);
+
+        // the skybox surrounds the camera and is never culled
+        DrawItem skybox = { &skyboxShader, UniformHandle(), glm::mat4(1.0f), skyboxMaterial, skyVAO, GL_TRIANGLES, 36, false, 0, "skybox", NULL, UniformHandle(), 0 };
+        queue.submit(PASS_BACKGROUND, skybox);
+
+        // per-program uniforms that are the same for every draw of that program
+        reflectShader.use();
+        reflectShader.setFloat(reflectRoughness, 0.1f);
+        reflectShader.setFloat(reflectEnvironmentSize, (float)EnvironmentMap::SIZE);
+        reflectShader.setFloat(reflectMaxLod, (float)(EnvironmentMap::LEVELS - 1));
+        parallax.use();
+        parallax.setFloat(parallaxHeightScale, heightScale);
+        float parallaxMin = std::min(PARALLAX_MIN_LAYERS, parallaxLayers);
+        parallax.setFloat(parallaxMinLayers, parallaxMin);
+        parallax.setFloat(parallaxMaxLayers, parallaxLayers);
+        if (deferred)
+        {
+            gbufferParallax->use();
+            gbufferParallax->setFloat(gbufferHeightScale, heightScale);
+            gbufferParallax->setFloat(gbufferMinLayers, parallaxMin);
+            gbufferParallax->setFloat(gbufferMaxLayers, parallaxLayers);
+        }
+
+        {
+            ProfileScope scope(profiler, "sort");
+            queue.sort();
+        }
+        // deferred geometry first, then lit into the scene target along with its depth so the
+        // forward passes after it are occluded correctly
+        if (deferredFrame && queue.hasPass(PASS_GBUFFER))
+        {
+            {
+                ProfileScope scope(profiler, "gbuffer");
+                gbuffer.bind();
+                queue.execute(&profiler, PASS_GBUFFER, PASS_GBUFFER);
+                sceneTarget.bind();
+            }
+            // the G-buffer pass itself is not counted, blending would overwrite its targets
+            if (countOverdraw)
+                overdraw.begin();
+            {
+                ProfileScope scope(profiler, "light cull");
+                animatePointLights(pointLights, lightPos, currentFrame);
+                clusteredLighting.setLights(pointLights.data(), (unsigned int)pointLights.size());
+                clusteredLighting.cull(*clusterBounds, *lightCull, projection, 0.1f, 100.0f);
+            }
+            {
+                ProfileScope scope(profiler, "lighting");
+                clusteredLighting.shade(*deferredShading, gbuffer, projection, view, 0.1f, 100.0f);
+            }
+        }
+        else if (countOverdraw)
+            overdraw.begin();
+        // the scene models are recorded first so the depth pre-pass can take them along with the queue
+        scene.update();
+        scene.queryFrustum(frustum, visibleNodes);
+        if (!visibleNodes.empty())
+        {
+            ProfileScope record(profiler, "record");
+            lodSelector.setView(camera.Position, camera.Zoom, (float)sceneTarget.height);
+            sceneCommands.begin(view, 0.1f, 100.0f, recordJobs);
+            scene.recordInstanced(sceneCommands, visibleNodes, &lodSelector);
+        }
+        if (depthPrepass)
+        {
+            queue.executeDepthPrepass(&profiler);
+            // depth_instanced.vs reads the same instance matrices as shader.vs, which never discards
+            if (!visibleNodes.empty())
+            {
+                ProfileScope scope(profiler, "models prepass");
+                glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+                glBackend.program = &depthInstanced;
+                sceneCommands.submit(glBackend);
+                glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            }
+        }
+        // the skybox waits for every opaque draw below, so it only shades the pixels they leave empty
+        queue.execute(&profiler, PASS_OPAQUE, PASS_OPAQUE);
+
+        if (!visibleNodes.empty())
+        {
+            ProfileScope scope(profiler, "models");
+            glBackend.program = &shader;
+            if (depthPrepass)
+            {
+                glState().depthFunc(GL_EQUAL);
+                sceneCommands.replay(glBackend);
+                glState().depthFunc(GL_LESS);
+            }
+            else
+                sceneCommands.submit(glBackend);
+        }
+        if (!characterStates.empty())
+        {
+            ProfileScope scope(profiler, "characters");
+            std::vector<AnimationState>::iterator state;
+            for (state = characterStates.begin(); state != characterStates.end(); ++state)
+                state->time += deltaTime;
+            animationSampler.sample(benchmarkModel->nodes, benchmarkModel->skeleton, benchmarkModel->animations, characterStates.data(), characterStates.size());
+            characters.skin(*skinningProgram, animationSampler.palettes);
+            // every pass draws the same skinned vertices, the depth pre-pass included
+            if (depthPrepass)
+            {
+                glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+                depthInstanced.use();
+                characters.draw(depthInstanced);
+                glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+                glState().depthFunc(GL_EQUAL);
+            }
+            shader.use();
+            characters.draw(shader);
+            glState().depthFunc(GL_LESS);
+        }
+        if (gpuEffects)
+        {
+            // a few dispatches and one indirect draw per effect, however many elements they have
+            ProfileScope scope(profiler, "effects");
+            flagCloth.wind = glm::vec3(4.0f + 1.5f * sin(currentFrame * 0.7f), 0.0f, sin(currentFrame * 0.31f));
+            flagCloth.simulate(*clothProgram, deltaTime, currentFrame);
+            sparks.simulate(*sparksProgram, deltaTime, currentFrame);
+            flagCloth.draw(*clothShader);
+        }
+        queue.execute(&profiler, PASS_BACKGROUND, PASS_BACKGROUND);
+        if (gpuEffects)
+        {
+            // the sparks go last, they are blended over everything, the sky included, and write no depth
+            ProfileScope scope(profiler, "sparks");
+            sparks.draw(*sparksShader, !countOverdraw);
+        }
+        if (countOverdraw)
+        {
+            overdraw.end();
+            glViewport(0, 0, framebufferWidth, framebufferHeight);
+            overdraw.present(overdrawShader);
+        }
+        else if (offscreen)
+        {
+            ProfileScope scope(profiler, "upscale");
+            if (sceneTarget.width == framebufferWidth && sceneTarget.height == framebufferHeight)
+                sceneTarget.resolveToWindow();
+            else
+            {
+                sceneTarget.resolve();
+                sceneTarget.present(upscaleShader, framebufferWidth, framebufferHeight, 0.6f);
+            }
+        }
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
         glfwSwapBuffers(window);
+        if (!benchmark.enabled)
+            pacing.presented(shownState, profiler);
         glfwPollEvents();
+        profiler.endFrame();
+        if (benchmark.enabled)
+            runner.endFrame(profiler);
+
+        if (currentFrame - lastTitleUpdate > 0.5f)
+        {
+            std::string title = profiler.summary();
+            if (countOverdraw)
+            {
+                float coverage = 0.0f;
+                float average = overdraw.average(&coverage);
+                char text[96];
+                std::snprintf(text, sizeof(text), " | overdraw %.2fx over %.0f%% of the screen", average, coverage * 100.0f);
+                title += text;
+            }
+            if (sceneTarget.width != framebufferWidth)
+            {
+                char text[64];
+                std::snprintf(text, sizeof(text), " | rendering at %dx%d", sceneTarget.width, sceneTarget.height);
+                title += text;
+            }
+            glfwSetWindowTitle(window, title.c_str());
+            lastTitleUpdate = currentFrame;
+        }
     }
 
+    simulation.stop();
     glDeleteVertexArrays(1, &VAO);
+    glDeleteVertexArrays(1, &reflectVAO);
+    glDeleteBuffers(1, &pyramidInstances.ID);
+    glDeleteBuffers(1, &reflectInstances.ID);
     glDeleteVertexArrays(1, &skyVAO);
     glDeleteBuffers(1, &VBO);
     glDeleteBuffers(1, &skyVBO);
+    glDeleteVertexArrays(1, &pyramidDepthVAO);
+    glDeleteVertexArrays(1, &reflectDepthVAO);
+    glDeleteBuffers(1, &pyramidPositionVBO);
+    glDeleteBuffers(1, &frameUBO.ID);
+    overdraw.release();
+    sceneTarget.release();
+    gbuffer.release();
+    clusteredLighting.release();
+    characters.release();
+    flagCloth.release();
+    sparks.release();
+    skyEnvironment.release();
+    probe.release();
+    if (benchmark.enabled)
+        runner.writeJson(benchmark.output);
+    if (benchmarkModel)
+        benchmarkModel->ReleaseTextures();
+    shaders.clear();
+    profiler.shutdown();
+    textureLoader().shutdown();
+    textureCache().clear();
 
     // optional: de-allocate all resources once they've outlived their purpose:
     // ------------------------------------------------------------------------
@@ -361,6 +1001,14 @@ int main()
 unsigned int quadVAO = 0;
 unsigned int quadVBO;
 void renderQuad()
+{
+    glState().bindVertexArray(getQuadVAO());
+    glState().countDraw();
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 6);
+}
+
+// creates the tangent-space quad on first use
+unsigned int getQuadVAO()
 {
     if (quadVAO == 0)
     {
@@ -426,7 +1074,7 @@ void renderQuad()
 
         glGenVertexArrays(1, &quadVAO);
         glGenBuffers(1, &quadVBO);
-        glBindVertexArray(quadVAO);
+        glState().bindVertexArray(quadVAO);
         glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
         glEnableVertexAttribArray(0);
@@ -440,9 +1088,30 @@ void renderQuad()
         glEnableVertexAttribArray(4);
         glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(11 * sizeof(float)));
     }
-    glBindVertexArray(quadVAO);
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 6);
-    glBindVertexArray(0);
+    return quadVAO;
+}
+
+// places the deferred path's point lights for this frame: light 0 at the key light, the rest on slow
+// orbits spread over the scene, each with its own color, height and speed
+void animatePointLights(std::vector<PointLight>& lights, const glm::vec3& keyLight, float time)
+{
+    if (lights.empty())
+        return;
+    lights[0].positionRadius = glm::vec4(keyLight, 12.0f);
+    lights[0].colorIntensity = glm::vec4(1.0f, 1.0f, 1.0f, 4.0f);
+    float count = (float)lights.size();
+    for (size_t i = 1; i < lights.size(); i++)
+    {
+        float f = (float)i;
+        // golden angle spiral so the lights cover the disc evenly whatever their number
+        float ring = 1.0f + 7.0f * sqrt(f / count);
+        float speed = 0.1f + 0.3f * glm::fract(f * 0.618034f);
+        float angle = f * 2.399963f + time * speed;
+        float height = 0.25f + 4.5f * glm::fract(f * 0.754878f);
+        glm::vec3 color(0.5f + 0.5f * cos(f * 0.9f), 0.5f + 0.5f * cos(f * 0.9f + 2.094f), 0.5f + 0.5f * cos(f * 0.9f + 4.189f));
+        lights[i].positionRadius = glm::vec4(ring * cos(angle) + 0.5f, height, ring * sin(angle), 1.5f + 1.5f * glm::fract(f * 0.569840f));
+        lights[i].colorIntensity = glm::vec4(color, 1.5f);
+    }
 }
 
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
@@ -454,6 +1123,7 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
     // make sure the viewport matches the new window dimensions; note that width and 
     // height will be significantly larger than specified on retina displays.
+    // the render loop reads the new size itself and resizes the offscreen scene target to it
     glViewport(0, 0, width, height);
 }
 
@@ -477,7 +1147,8 @@ void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
     lastX = xpos;
     lastY = ypos;
 
-    camera.ProcessMouseMovement(xoffset, yoffset);
+    pendingInput.mouseX += xoffset;
+    pendingInput.mouseY += yoffset;
 }
 
 void processInput(GLFWwindow* window)
@@ -485,18 +1156,49 @@ void processInput(GLFWwindow* window)
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        camera.ProcessKeyboard(FORWARD, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        camera.ProcessKeyboard(BACKWARD, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        camera.ProcessKeyboard(LEFT, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        camera.ProcessKeyboard(RIGHT, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
-        camera.ProcessKeyboard(DOWN, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
-        camera.ProcessKeyboard(UP, deltaTime);
+    // the movement keys are applied by the simulation at its own rate, they are only polled here
+    const int movementKeys[] = { GLFW_KEY_W, GLFW_KEY_S, GLFW_KEY_A, GLFW_KEY_D, GLFW_KEY_E, GLFW_KEY_Q };
+    pendingInput.keys = 0;
+    for (int direction = FORWARD; direction <= DOWN; direction++)
+        if (glfwGetKey(window, movementKeys[direction]) == GLFW_PRESS)
+            pendingInput.keys |= 1u << direction;
+    pendingInput.sampled = SimulationClock::now();
+    simulation.submit(pendingInput);
+    pendingInput.mouseX = pendingInput.mouseY = pendingInput.scroll = 0.0f;
+
+    static bool recordKeyDown = false;
+    bool recordKey = glfwGetKey(window, GLFW_KEY_F5) == GLFW_PRESS;
+    if (recordKey && !recordKeyDown)
+    {
+        recordingPath = !recordingPath;
+        if (recordingPath)
+            recordedPath.keys.clear();
+        else if (recordedPath.save("camera_path.txt"))
+            std::cout << "camera path of " << recordedPath.keys.size() << " keys written to camera_path.txt" << std::endl;
+    }
+    recordKeyDown = recordKey;
+
+    static bool prepassKeyDown = false, overdrawKeyDown = false;
+    bool prepassKey = glfwGetKey(window, GLFW_KEY_F6) == GLFW_PRESS;
+    bool overdrawKey = glfwGetKey(window, GLFW_KEY_F7) == GLFW_PRESS;
+    if (prepassKey && !prepassKeyDown)
+    {
+        depthPrepass = !depthPrepass;
+        std::cout << "depth pre-pass " << (depthPrepass ? "on" : "off") << std::endl;
+    }
+    if (overdrawKey && !overdrawKeyDown)
+        showOverdraw = !showOverdraw;
+    prepassKeyDown = prepassKey;
+    overdrawKeyDown = overdrawKey;
+
+    static bool resolutionKeyDown = false;
+    bool resolutionKey = glfwGetKey(window, GLFW_KEY_F8) == GLFW_PRESS;
+    if (resolutionKey && !resolutionKeyDown)
+    {
+        dynamicResolution = !dynamicResolution;
+        std::cout << "dynamic resolution " << (dynamicResolution ? "on" : "off") << std::endl;
+    }
+    resolutionKeyDown = resolutionKey;
 
     if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS)
     {
@@ -518,83 +1220,17 @@ void processInput(GLFWwindow* window)
 // ----------------------------------------------------------------------
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
-    camera.ProcessMouseScroll(static_cast<float>(yoffset));
+    pendingInput.scroll += static_cast<float>(yoffset);
 }
 
+// both loaders return at once, the images are decoded on worker threads and streamed in by
+// textureLoader().update() in the render loop. Files already in the TextureCache are not loaded again
 unsigned int loadTexture(char const* path, bool gammaCorrection)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum internalFormat;
-        GLenum dataFormat;
-        if (nrComponents == 1)
-        {
-            internalFormat = dataFormat = GL_RED;
-        }
-        else if (nrComponents == 3)
-        {
-            internalFormat = gammaCorrection ? GL_SRGB : GL_RGB;
-            dataFormat = GL_RGB;
-        }
-        else if (nrComponents == 4)
-        {
-            internalFormat = gammaCorrection ? GL_SRGB_ALPHA : GL_RGBA;
-            dataFormat = GL_RGBA;
-        }
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, dataFormat, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    return textureCache().acquire(path, gammaCorrection);
 }
 
 unsigned int loadCubemap(std::vector<std::string> faces)
 {
-    unsigned int cubemapTexture;
-    glGenTextures(1, &cubemapTexture);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-
-    int width, height, nrChannels;
-    for (unsigned int i = 0; i < faces.size(); i++)
-    {
-        unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data)
-        {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-            stbi_image_free(data);
-        }
-        else
-        {
-            std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
-        }
-
-    }
-
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-    return cubemapTexture;
-}
\ No newline at end of file
+    return textureCache().acquireCubemap(faces);
+}
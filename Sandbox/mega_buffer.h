@@ -0,0 +1,118 @@
+#ifndef MEGA_BUFFER_H
+#define MEGA_BUFFER_H
+
+#include <glad/glad.h>
+
+#include </OpenGl programming/Sandbox/vertex.h>
+#include </OpenGl programming/Sandbox/gl_state_cache.h>
+#include </OpenGl programming/Sandbox/instance_buffer.h>
+
+#include <algorithm>
+#include <vector>
+
+// where a mesh lives inside a MegaBuffer
+struct MeshRange {
+    GLint baseVertex;
+    GLuint firstIndex;
+    GLsizei indexCount;
+};
+
+// layout of one glMultiDrawElementsIndirect command, as the GL spec defines it
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint  baseVertex;
+    GLuint baseInstance;
+};
+
+// One VBO/EBO pair with a single VAO that many meshes of the Vertex layout are sub-allocated into,
+// so they can all be drawn without switching vertex arrays. Storage grows by doubling; existing
+// ranges keep their offsets when it does.
+class MegaBuffer
+{
+public:
+    unsigned int VAO;
+    InstanceBuffer instances;
+
+    MegaBuffer(size_t initialVertices = 65536, size_t initialIndices = 196608)
+        : VBO(0), EBO(0), vertexCapacity(0), indexCapacity(0), vertexCount(0), indexCount(0)
+    {
+        glGenVertexArrays(1, &VAO);
+        reserve(initialVertices, initialIndices);
+    }
+
+    // append a mesh's geometry, its indices stay relative to its own first vertex
+    MeshRange add(const Vertex* vertices, size_t numVertices, const unsigned int* indices, size_t numIndices)
+    {
+        // a buffer reserved empty has nothing to double, start it at one
+        size_t neededVertices = std::max<size_t>(vertexCapacity, 1), neededIndices = std::max<size_t>(indexCapacity, 1);
+        while (vertexCount + numVertices > neededVertices)
+            neededVertices *= 2;
+        while (indexCount + numIndices > neededIndices)
+            neededIndices *= 2;
+        if (neededVertices != vertexCapacity || neededIndices != indexCapacity)
+            reserve(neededVertices, neededIndices);
+
+        MeshRange range;
+        range.baseVertex = static_cast<GLint>(vertexCount);
+        range.firstIndex = static_cast<GLuint>(indexCount);
+        range.indexCount = static_cast<GLsizei>(numIndices);
+
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferSubData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), numVertices * sizeof(Vertex), vertices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, indexCount * sizeof(unsigned int), numIndices * sizeof(unsigned int), indices);
+
+        vertexCount += numVertices;
+        indexCount += numIndices;
+        return range;
+    }
+    MeshRange add(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices)
+    {
+        return add(vertices.data(), vertices.size(), indices.data(), indices.size());
+    }
+
+private:
+    unsigned int VBO, EBO;
+    size_t vertexCapacity, indexCapacity;
+    size_t vertexCount, indexCount;
+
+    // (re)allocate both buffers, copying what is already stored, and point the VAO at the new ones
+    void reserve(size_t vertices, size_t indices)
+    {
+        unsigned int newVBO = resize(VBO, vertexCount * sizeof(Vertex), vertices * sizeof(Vertex));
+        unsigned int newEBO = resize(EBO, indexCount * sizeof(unsigned int), indices * sizeof(unsigned int));
+        VBO = newVBO;
+        EBO = newEBO;
+        vertexCapacity = vertices;
+        indexCapacity = indices;
+
+        glState().bindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        setupVertexAttributes();
+        instances.attach();
+        glState().bindVertexArray(0);
+    }
+
+    static unsigned int resize(unsigned int oldBuffer, size_t usedBytes, size_t newBytes)
+    {
+        unsigned int buffer;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, newBytes, NULL, GL_STATIC_DRAW);
+        if (oldBuffer != 0)
+        {
+            if (usedBytes > 0)
+            {
+                glBindBuffer(GL_COPY_READ_BUFFER, oldBuffer);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes);
+            }
+            glDeleteBuffers(1, &oldBuffer);
+        }
+        return buffer;
+    }
+};
+
+#endif
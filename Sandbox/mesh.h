@@ -6,141 +6,359 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
-#include <learnopengl/shader.h>
+#include </OpenGl programming/Sandbox/shader_s.h>
+#include </OpenGl programming/Sandbox/gl_state_cache.h>
+#include </OpenGl programming/Sandbox/instance_buffer.h>
+#include </OpenGl programming/Sandbox/vertex.h>
+#include </OpenGl programming/Sandbox/mega_buffer.h>
+#include </OpenGl programming/Sandbox/mesh_lod.h>
 
+#include <algorithm>
 #include <string>
 #include <vector>
+#include <iostream>
 using namespace std;
 
-#define MAX_BONE_INFLUENCE 4
-
-struct Vertex {
-    // position
-    glm::vec3 Position;
-    // normal
-    glm::vec3 Normal;
-    // texCoords
-    glm::vec2 TexCoords;
-    // tangent
-    glm::vec3 Tangent;
-    // bitangent
-    glm::vec3 Bitangent;
-    //bone indexes which will influence this vertex
-    int m_BoneIDs[MAX_BONE_INFLUENCE];
-    //weights from each bone
-    float m_Weights[MAX_BONE_INFLUENCE];
-};
-
 struct Texture {
     unsigned int id;
     string type;
     string path;
 };
 
+// every sampler name gets a fixed texture unit, so the sampler uniforms only have to be set once per
+// program and a mesh's material is just a list of {unit, texture} pairs:
+//   texture_diffuse1..4 -> units 0..3, texture_specular1..4 -> units 4..7,
+//   texture_normal1..4  -> units 8..11, texture_height1..4  -> units 12..15
+#define MAX_TEXTURES_PER_TYPE 4
+
+static const char* const TEXTURE_TYPE_NAMES[] = { "texture_diffuse", "texture_specular", "texture_normal", "texture_height" };
+static const unsigned int TEXTURE_TYPE_COUNT = sizeof(TEXTURE_TYPE_NAMES) / sizeof(TEXTURE_TYPE_NAMES[0]);
+
+struct TextureBinding {
+    unsigned int unit;
+    unsigned int id;
+};
+
 class Mesh {
 public:
     // mesh Data
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
     vector<Texture>      textures;
+    vector<TextureBinding> bindings;
     unsigned int VAO;
+    // set when the geometry is sub-allocated in a shared MegaBuffer instead of owning its buffers
+    MegaBuffer* megaBuffer;
+    MeshRange range;
+    // vertices in the GPU copy, kept when the CPU copy is released
+    size_t vertexCount;
+    // VertexFormatFlags the GPU copy is stored in, and the position dequantization of VERTEX_QUANTIZED
+    unsigned int vertexFormat;
+    glm::vec3 positionScale;
+    glm::vec3 positionBias;
+    // object space bounds, kept even when the CPU copy of the geometry is released
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    // levels of detail as ranges of the index buffer (which then holds all of them back to back),
+    // finest first; empty for a mesh with just its one index list. range always covers level 0.
+    vector<MeshLod> lods;
 
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // constructor, a compact vertexFormat is only used for meshes that own their buffers.
+    // the data is moved in, pass std::move()'d vectors to avoid copying them at all; with
+    // keepCpuData false the vertices and indices are freed once they are on the GPU. With lods
+    // (see buildLodChain) the indices are the concatenated levels.
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, MegaBuffer* pool = NULL, unsigned int format = VERTEX_FULL, bool keepCpuData = true,
+         vector<MeshLod> lods = vector<MeshLod>())
+        : megaBuffer(pool), vertexFormat(pool ? (unsigned int)VERTEX_FULL : format), positionScale(1.0f), positionBias(0.0f), sharedInstances(NULL),
+          dequantizationProgram(0)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        this->textures = std::move(textures);
+        this->lods = std::move(lods);
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        computeBounds();
+        setupMesh(this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size());
+        setupMaterial();
+
+        if (!keepCpuData)
+            ReleaseCpuData();
+    }
+    // constructor for geometry that already sits in memory in its final layout (e.g. a mapped model
+    // cache), it is uploaded straight from the pointers and only copied when keepCpuData is set
+    Mesh(const Vertex* vertexData, size_t vertexCount, const unsigned int* indexData, size_t indexCount, vector<Texture> textures,
+         glm::vec3 boundsMin, glm::vec3 boundsMax, MegaBuffer* pool = NULL, unsigned int format = VERTEX_FULL, bool keepCpuData = true,
+         vector<MeshLod> lods = vector<MeshLod>())
+        : megaBuffer(pool), vertexFormat(pool ? (unsigned int)VERTEX_FULL : format), positionScale(1.0f), positionBias(0.0f), boundsMin(boundsMin), boundsMax(boundsMax),
+          sharedInstances(NULL), dequantizationProgram(0)
+    {
+        this->textures = std::move(textures);
+        this->lods = std::move(lods);
+        if (keepCpuData)
+        {
+            vertices.assign(vertexData, vertexData + vertexCount);
+            indices.assign(indexData, indexData + indexCount);
+        }
+        setupMesh(vertexData, vertexCount, indexData, indexCount);
+        setupMaterial();
     }
 
-    // render the mesh
-    void Draw(Shader& shader)
+    // the buffers of a mesh that owns them, 0 when it lives in a MegaBuffer
+    unsigned int VertexBuffer() const
     {
-        // bind appropriate textures
-        unsigned int diffuseNr = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr = 1;
-        unsigned int heightNr = 1;
-        for (unsigned int i = 0; i < textures.size(); i++)
+        return VBO;
+    }
+    unsigned int ElementBuffer() const
+    {
+        return EBO;
+    }
+
+    // drop the CPU copy of the geometry, drawing only needs range and the GPU buffers
+    void ReleaseCpuData()
+    {
+        vector<Vertex>().swap(vertices);
+        vector<unsigned int>().swap(indices);
+    }
+
+    // point every texture_<type>N sampler of the (bound) program at its fixed unit
+    static void SetSamplerUnits(Shader& shader)
+    {
+        for (unsigned int type = 0; type < TEXTURE_TYPE_COUNT; type++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if (name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if (name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to string
-            else if (name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to string
-            else if (name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to string
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            for (unsigned int n = 0; n < MAX_TEXTURES_PER_TYPE; n++)
+            {
+                string name = TEXTURE_TYPE_NAMES[type] + std::to_string(n + 1);
+                shader.setInt(name, type * MAX_TEXTURES_PER_TYPE + n);
+            }
         }
+    }
+
+    unsigned int LodCount() const
+    {
+        return lods.empty() ? 1 : static_cast<unsigned int>(lods.size());
+    }
+
+    // render the mesh once at transform, the program's sampler units must have been set with
+    // SetSamplerUnits. The model programs read their matrix from the instance attribute only, so it goes
+    // through Instances() like any other instance. lod is clamped to the levels the mesh has
+    void Draw(Shader& shader, const glm::mat4& transform = glm::mat4(1.0f), unsigned int lod = 0)
+    {
+        Instances().upload(&transform, 1);
+        DrawUploadedInstances(shader, 1, lod);
+    }
+
+    // bind appropriate textures, the state cache skips whatever is already bound
+    void BindTextures()
+    {
+        GLStateCache& state = glState();
+        for (size_t i = 0; i < bindings.size(); i++)
+            state.bindTexture(bindings[i].unit, GL_TEXTURE_2D, bindings[i].id);
+    }
+
+    // true when both meshes bind exactly the same textures, i.e. can share one multi-draw
+    bool SameMaterial(const Mesh& other) const
+    {
+        if (bindings.size() != other.bindings.size())
+            return false;
+        for (size_t i = 0; i < bindings.size(); i++)
+            if (bindings[i].unit != other.bindings[i].unit || bindings[i].id != other.bindings[i].id)
+                return false;
+        return true;
+    }
+
+    // the buffer the VAO reads its instance matrices from: the pool's for a mesh in a MegaBuffer, the
+    // one set with ShareInstances, or else one of its own
+    InstanceBuffer& Instances()
+    {
+        if (megaBuffer)
+            return megaBuffer->instances;
+        if (sharedInstances)
+            return *sharedInstances;
+        if (instances.ID == 0)
+        {
+            glState().bindVertexArray(VAO);
+            instances.attach();
+        }
+        return instances;
+    }
 
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+    // read the instance matrices from shared, e.g. the one buffer a whole Model uploads its transforms
+    // to, instead of a buffer of its own; shared has to outlive the mesh
+    void ShareInstances(InstanceBuffer& shared)
+    {
+        if (megaBuffer)
+            return;
+        glState().bindVertexArray(VAO);
+        shared.attach();
+        glState().bindVertexArray(0);
+        sharedInstances = &shared;
+    }
+
+    // render count copies of the mesh in one draw call, the vertex shader reads its model matrix
+    // from the per-instance attribute at INSTANCE_MATRIX_LOCATION instead of the model uniform
+    void DrawInstanced(Shader& shader, const glm::mat4* transforms, size_t count, unsigned int lod = 0)
+    {
+        if (count == 0)
+            return;
+        Instances().upload(transforms, count);
+        DrawUploadedInstances(shader, count, lod);
+    }
+    void DrawInstanced(Shader& shader, const vector<glm::mat4>& transforms, unsigned int lod = 0)
+    {
+        DrawInstanced(shader, transforms.data(), transforms.size(), lod);
+    }
 
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+    // the same with the first count matrices already uploaded to Instances(), so meshes sharing the
+    // buffer all draw from a single upload
+    void DrawUploadedInstances(Shader& shader, size_t count, unsigned int lod = 0)
+    {
+        if (count == 0)
+            return;
+        BindTextures();
+        bool quantized = beginDequantization(shader);
+
+        GLuint first;
+        GLsizei indexCount;
+        lodRange(lod, first, indexCount);
+        glState().bindVertexArray(VAO);
+        glState().countDraw();
+        if (megaBuffer)
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, (void*)(first * sizeof(unsigned int)), static_cast<GLsizei>(count), range.baseVertex);
+        else
+            glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, (void*)(first * sizeof(unsigned int)), static_cast<GLsizei>(count));
+        if (quantized)
+            endDequantization(shader);
     }
 
 private:
     // render data 
     unsigned int VBO, EBO;
+    InstanceBuffer instances;
+    InstanceBuffer* sharedInstances;
+    // positionScale/positionBias of the program last drawn with, resolved again when it changes
+    unsigned int dequantizationProgram;
+    UniformHandle positionScaleLocation, positionBiasLocation;
+
+    // first index (in the whole bound index buffer) and count of a level
+    void lodRange(unsigned int lod, GLuint& first, GLsizei& count) const
+    {
+        if (lods.empty())
+        {
+            first = range.firstIndex;
+            count = range.indexCount;
+            return;
+        }
+        const MeshLod& level = lods[std::min(lod, static_cast<unsigned int>(lods.size() - 1))];
+        first = range.firstIndex + level.firstIndex;
+        count = static_cast<GLsizei>(level.indexCount);
+    }
+
+    // quantized positions are stored in [0, 1] over the mesh bounds, the vertex shader maps them back.
+    // The programs' own default is the identity, and every quantized draw puts it back afterwards, so
+    // nothing else drawn with them has to set it; false for a mesh that is not quantized
+    bool beginDequantization(Shader& shader)
+    {
+        if (!(vertexFormat & VERTEX_QUANTIZED))
+            return false;
+        if (dequantizationProgram != shader.ID)
+        {
+            positionScaleLocation = shader.getUniform("positionScale");
+            positionBiasLocation = shader.getUniform("positionBias");
+            dequantizationProgram = shader.ID;
+        }
+        shader.setVec3(positionScaleLocation, positionScale);
+        shader.setVec3(positionBiasLocation, positionBias);
+        return true;
+    }
+    void endDequantization(Shader& shader)
+    {
+        shader.setVec3(positionScaleLocation, glm::vec3(1.0f));
+        shader.setVec3(positionBiasLocation, glm::vec3(0.0f));
+    }
+
+    void computeBounds()
+    {
+        boundsMin = boundsMax = vertices.empty() ? glm::vec3(0.0f) : vertices[0].Position;
+        for (size_t i = 1; i < vertices.size(); i++)
+        {
+            boundsMin = glm::min(boundsMin, vertices[i].Position);
+            boundsMax = glm::max(boundsMax, vertices[i].Position);
+        }
+    }
+
+    // resolves each texture to its fixed unit once, so Draw never has to look at type strings
+    void setupMaterial()
+    {
+        unsigned int typeCounts[TEXTURE_TYPE_COUNT] = {};
+        bindings.clear();
+        bindings.reserve(textures.size());
+        for (unsigned int i = 0; i < textures.size(); i++)
+        {
+            unsigned int type = 0;
+            while (type < TEXTURE_TYPE_COUNT && textures[i].type != TEXTURE_TYPE_NAMES[type])
+                type++;
+            if (type == TEXTURE_TYPE_COUNT || typeCounts[type] == MAX_TEXTURES_PER_TYPE)
+            {
+                std::cout << "Mesh: no sampler unit left for texture " << textures[i].path << " of type " << textures[i].type << std::endl;
+                continue;
+            }
+            TextureBinding binding;
+            binding.unit = type * MAX_TEXTURES_PER_TYPE + typeCounts[type]++;
+            binding.id = textures[i].id;
+            bindings.push_back(binding);
+        }
+    }
 
     // initializes all the buffer objects/arrays
-    void setupMesh()
+    void setupMesh(const Vertex* vertexData, size_t vertexCount, const unsigned int* indexData, size_t indexCount)
     {
+        this->vertexCount = vertexCount;
+        if (megaBuffer)
+        {
+            // sub-allocate into the shared buffers, there is no VAO of our own to set up
+            range = megaBuffer->add(vertexData, vertexCount, indexData, indexCount);
+            if (!lods.empty())
+                range.indexCount = static_cast<GLsizei>(lods[0].indexCount);
+            VAO = megaBuffer->VAO;
+            VBO = EBO = 0;
+            return;
+        }
+        range.baseVertex = 0;
+        range.firstIndex = 0;
+        range.indexCount = static_cast<GLsizei>(lods.empty() ? indexCount : lods[0].indexCount);
+
         // create buffers/arrays
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
         glGenBuffers(1, &EBO);
 
-        glBindVertexArray(VAO);
+        glState().bindVertexArray(VAO);
         // load data into vertex buffers
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        if (vertexFormat != VERTEX_FULL)
+        {
+            vector<unsigned char> packed = packVertices(vertexData, vertexCount, vertexFormat, positionScale, positionBias);
+            glBufferData(GL_ARRAY_BUFFER, packed.size(), packed.data(), GL_STATIC_DRAW);
+
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indexData, GL_STATIC_DRAW);
+
+            setupPackedVertexAttributes(vertexFormat);
+            glState().bindVertexArray(0);
+            return;
+        }
         // A great thing about structs is that their memory layout is sequential for all its items.
         // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
         // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), vertexData, GL_STATIC_DRAW);
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indexData, GL_STATIC_DRAW);
 
         // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-        // ids
-        glEnableVertexAttribArray(5);
-        glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
-
-        // weights
-        glEnableVertexAttribArray(6);
-        glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
-        glBindVertexArray(0);
+        setupVertexAttributes();
+        glState().bindVertexArray(0);
     }
 };
 #endif
\ No newline at end of file
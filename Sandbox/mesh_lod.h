@@ -0,0 +1,476 @@
+#ifndef MESH_LOD_H
+#define MESH_LOD_H
+
+#include <glm/glm.hpp>
+
+#include </OpenGl programming/Sandbox/vertex.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// Import-time level of detail for meshes. Every level is an index list over the mesh's one, unchanged
+// vertex buffer: the simplifier only collapses vertices onto existing neighbours, so the levels can
+// be concatenated into a single index buffer and drawn as sub-ranges of it. All of this is CPU only
+// and safe on any thread.
+
+#define MAX_MESH_LODS 4
+
+// one level inside a mesh's index buffer
+struct MeshLod {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error; // object space distance the level may deviate from the full mesh
+};
+
+// --- vertex cache and overdraw ordering ------------------------------------------------------------
+
+// Tipsify (Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced
+// Overdraw", 2007): fans around the vertex that is still in a simulated FIFO cache of cacheSize and
+// keeps the most triangles waiting. The points where it has to jump to a vertex out of the cache cut
+// the list into clusters, which are then ordered outside-facing first, so a cluster tends to be drawn
+// before the ones it occludes whatever the view.
+inline void optimizeTriangleOrder(std::vector<unsigned int>& indices, const Vertex* vertices, size_t vertexCount, unsigned int cacheSize = 16)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount < 2)
+        return;
+
+    // vertex -> triangles
+    std::vector<unsigned int> offsets(vertexCount + 1, 0), live(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        live[indices[i]]++;
+    for (size_t v = 0; v < vertexCount; v++)
+        offsets[v + 1] = offsets[v] + live[v];
+    std::vector<unsigned int> adjacency(offsets[vertexCount]), fill(offsets.begin(), offsets.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++)
+        for (int c = 0; c < 3; c++)
+            adjacency[fill[indices[t * 3 + c]]++] = static_cast<unsigned int>(t);
+
+    std::vector<unsigned int> cacheTime(vertexCount, 0), deadEnd, candidates;
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<unsigned int> order;
+    std::vector<size_t> clusterStarts(1, 0);
+    order.reserve(triangleCount);
+    unsigned int time = cacheSize + 1;
+    size_t cursor = 0;
+    int fan = indices[0];
+    while (fan >= 0)
+    {
+        candidates.clear();
+        for (unsigned int a = offsets[fan]; a < offsets[fan + 1]; a++)
+        {
+            unsigned int t = adjacency[a];
+            if (emitted[t])
+                continue;
+            emitted[t] = true;
+            order.push_back(t);
+            for (int c = 0; c < 3; c++)
+            {
+                unsigned int v = indices[t * 3 + c];
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - cacheTime[v] > cacheSize)
+                    cacheTime[v] = time++;
+            }
+        }
+
+        // the candidate still in the cache after fanning it, and with the most waiting triangles
+        int next = -1, bestPriority = -1;
+        for (size_t i = 0; i < candidates.size(); i++)
+        {
+            unsigned int v = candidates[i];
+            if (live[v] == 0)
+                continue;
+            int priority = 0;
+            if (time - cacheTime[v] + 2 * live[v] <= cacheSize)
+                priority = static_cast<int>(time - cacheTime[v]);
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                next = static_cast<int>(v);
+            }
+        }
+        if (next < 0)
+        {
+            while (!deadEnd.empty() && next < 0)
+            {
+                if (live[deadEnd.back()] > 0)
+                    next = static_cast<int>(deadEnd.back());
+                deadEnd.pop_back();
+            }
+            for (; next < 0 && cursor < vertexCount; cursor++)
+                if (live[cursor] > 0)
+                    next = static_cast<int>(cursor);
+            if (next >= 0 && order.size() < triangleCount)
+                clusterStarts.push_back(order.size());
+        }
+        fan = next;
+    }
+    clusterStarts.push_back(order.size());
+
+    // view independent overdraw order: clusters facing away from the mesh center go first
+    glm::vec3 meshCenter(0.0f);
+    double meshArea = 0.0;
+    std::vector<glm::vec3> centers(triangleCount), normals(triangleCount);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        const glm::vec3& a = vertices[indices[t * 3]].Position;
+        const glm::vec3& b = vertices[indices[t * 3 + 1]].Position;
+        const glm::vec3& c = vertices[indices[t * 3 + 2]].Position;
+        normals[t] = glm::cross(b - a, c - a); // length is twice the area
+        centers[t] = (a + b + c) * (1.0f / 3.0f);
+        float area = glm::length(normals[t]);
+        meshCenter += centers[t] * area;
+        meshArea += area;
+    }
+    if (meshArea > 0.0)
+        meshCenter /= static_cast<float>(meshArea);
+
+    size_t clusterCount = clusterStarts.size() - 1;
+    std::vector<std::pair<float, size_t> > clusters(clusterCount);
+    for (size_t k = 0; k < clusterCount; k++)
+    {
+        glm::vec3 center(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (size_t i = clusterStarts[k]; i < clusterStarts[k + 1]; i++)
+        {
+            float a = glm::length(normals[order[i]]);
+            center += centers[order[i]] * a;
+            normal += normals[order[i]];
+            area += a;
+        }
+        float facing = 0.0f;
+        if (area > 0.0f && glm::dot(normal, normal) > 0.0f)
+            facing = glm::dot(center / area - meshCenter, glm::normalize(normal));
+        clusters[k] = std::make_pair(-facing, k);
+    }
+    std::stable_sort(clusters.begin(), clusters.end());
+
+    std::vector<unsigned int> sorted;
+    sorted.reserve(triangleCount * 3);
+    for (size_t k = 0; k < clusterCount; k++)
+    {
+        size_t cluster = clusters[k].second;
+        for (size_t i = clusterStarts[cluster]; i < clusterStarts[cluster + 1]; i++)
+            sorted.insert(sorted.end(), indices.begin() + order[i] * 3, indices.begin() + order[i] * 3 + 3);
+    }
+    indices.swap(sorted);
+}
+
+// average vertex cache misses per triangle of the list in a FIFO cache of cacheSize, 0.5..3
+inline float averageCacheMissRatio(const std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize = 16)
+{
+    if (indices.size() < 3)
+        return 0.0f;
+    std::vector<unsigned int> inserted(vertexCount, 0);
+    unsigned int time = cacheSize + 1, misses = 0;
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        if (time - inserted[indices[i]] > cacheSize)
+        {
+            inserted[indices[i]] = time++;
+            misses++;
+        }
+    }
+    return static_cast<float>(misses) / (indices.size() / 3);
+}
+
+// --- simplification ----------------------------------------------------------------------------------
+
+// sum of squared distances to a set of planes (Garland and Heckbert), the symmetric 4x4 matrix as 10 terms
+struct Quadric {
+    double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+
+    Quadric() : a2(0), ab(0), ac(0), ad(0), b2(0), bc(0), bd(0), c2(0), cd(0), d2(0) {}
+
+    void addPlane(const glm::vec3& n, float d)
+    {
+        a2 += n.x * n.x; ab += n.x * n.y; ac += n.x * n.z; ad += n.x * d;
+        b2 += n.y * n.y; bc += n.y * n.z; bd += n.y * d;
+        c2 += n.z * n.z; cd += n.z * d;
+        d2 += d * d;
+    }
+    Quadric& operator+=(const Quadric& q)
+    {
+        a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad; b2 += q.b2;
+        bc += q.bc; bd += q.bd; c2 += q.c2; cd += q.cd; d2 += q.d2;
+        return *this;
+    }
+    double error(const glm::vec3& p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        return x * x * a2 + 2 * x * y * ab + 2 * x * z * ac + 2 * x * ad
+             + y * y * b2 + 2 * y * z * bc + 2 * y * bd
+             + z * z * c2 + 2 * z * cd + d2;
+    }
+};
+
+// Reduces the triangle list towards targetIndexCount by collapsing vertices onto a neighbour, cheapest
+// quadric error first, never beyond maxError (object units). Vertices on a UV/normal seam (several
+// vertices at one position) or an open border are never moved, so the result has no cracks and keeps
+// its silhouette; collapses that would turn a triangle (nearly) over are skipped. Works in passes of
+// independent collapses, each pass rebuilding its adjacency instead of maintaining a heap with updates.
+// Returns the new list, error becomes the largest deviation it introduced.
+inline std::vector<unsigned int> simplifyMesh(const Vertex* vertices, size_t vertexCount, const std::vector<unsigned int>& source,
+                                               size_t targetIndexCount, float maxError, float& error)
+{
+    error = 0.0f;
+    std::vector<unsigned int> indices(source);
+    if (indices.size() <= targetIndexCount)
+        return indices;
+
+    // one canonical vertex per distinct position
+    struct PositionHash {
+        size_t operator()(const glm::vec3& p) const
+        {
+            uint32_t bits[3];
+            std::memcpy(bits, &p[0], sizeof(bits));
+            return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+        }
+    };
+    std::unordered_map<glm::vec3, unsigned int, PositionHash> positions;
+    positions.reserve(vertexCount);
+    std::vector<unsigned int> canonical(vertexCount);
+    std::vector<unsigned char> locked(vertexCount, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        std::pair<std::unordered_map<glm::vec3, unsigned int, PositionHash>::iterator, bool> inserted =
+            positions.insert(std::make_pair(vertices[v].Position, static_cast<unsigned int>(v)));
+        canonical[v] = inserted.first->second;
+    }
+    // a position referenced through more than one vertex is a seam
+    std::vector<int> user(vertexCount, -1);
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        unsigned int v = indices[i], c = canonical[v];
+        if (user[c] < 0)
+            user[c] = static_cast<int>(v);
+        else if (user[c] != static_cast<int>(v))
+            locked[c] = 1;
+    }
+    // an edge used by a single triangle (counted over positions, so seams do not look open) is a border
+    {
+        std::unordered_map<uint64_t, int> edges;
+        edges.reserve(indices.size());
+        for (size_t t = 0; t + 2 < indices.size(); t += 3)
+            for (int e = 0; e < 3; e++)
+            {
+                uint64_t a = canonical[indices[t + e]], b = canonical[indices[t + (e + 1) % 3]];
+                edges[a < b ? (a << 32 | b) : (b << 32 | a)]++;
+            }
+        for (std::unordered_map<uint64_t, int>::iterator it = edges.begin(); it != edges.end(); ++it)
+            if (it->second == 1)
+            {
+                locked[static_cast<unsigned int>(it->first >> 32)] = 1;
+                locked[static_cast<unsigned int>(it->first & 0xFFFFFFFFu)] = 1;
+            }
+    }
+
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t t = 0; t + 2 < indices.size(); t += 3)
+    {
+        const glm::vec3& a = vertices[indices[t]].Position;
+        glm::vec3 n = glm::cross(vertices[indices[t + 1]].Position - a, vertices[indices[t + 2]].Position - a);
+        float length = glm::length(n);
+        if (length <= 0.0f)
+            continue;
+        n /= length;
+        float d = -glm::dot(n, a);
+        for (int c = 0; c < 3; c++)
+            quadrics[canonical[indices[t + c]]].addPlane(n, d);
+    }
+
+    struct Collapse {
+        double cost;
+        unsigned int from, to;
+        bool operator<(const Collapse& other) const { return cost < other.cost; }
+    };
+    std::vector<Collapse> collapses;
+    std::vector<unsigned int> remap(vertexCount), offsets(vertexCount + 1), adjacency, fill;
+    std::vector<unsigned char> touched(vertexCount);
+    double maxCost = static_cast<double>(maxError) * maxError;
+    double worst = 0.0;
+
+    while (indices.size() > targetIndexCount)
+    {
+        // candidate half edge collapses of this pass; only a vertex that is the sole user of its
+        // position can move, onto the vertex across one of its edges
+        collapses.clear();
+        for (size_t t = 0; t + 2 < indices.size(); t += 3)
+            for (int e = 0; e < 3; e++)
+            {
+                unsigned int from = indices[t + e], to = indices[t + (e + 1) % 3];
+                for (int direction = 0; direction < 2; direction++, std::swap(from, to))
+                {
+                    if (locked[canonical[from]])
+                        continue;
+                    Quadric q = quadrics[canonical[from]];
+                    q += quadrics[canonical[to]];
+                    Collapse collapse = { std::max(q.error(vertices[to].Position), 0.0), from, to };
+                    if (collapse.cost <= maxCost)
+                        collapses.push_back(collapse);
+                }
+            }
+        if (collapses.empty())
+            break;
+        std::sort(collapses.begin(), collapses.end());
+
+        std::fill(offsets.begin(), offsets.end(), 0);
+        for (size_t i = 0; i < indices.size(); i++)
+            offsets[indices[i] + 1]++;
+        for (size_t v = 0; v < vertexCount; v++)
+            offsets[v + 1] += offsets[v];
+        adjacency.resize(indices.size());
+        fill.assign(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++)
+            adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+
+        for (size_t v = 0; v < vertexCount; v++)
+            remap[v] = static_cast<unsigned int>(v);
+        std::fill(touched.begin(), touched.end(), 0);
+
+        // each collapse removes about two triangles; stop the pass where the target would be reached
+        size_t wanted = (indices.size() - targetIndexCount) / 6 + 1, done = 0;
+        for (size_t c = 0; c < collapses.size() && done < wanted; c++)
+        {
+            const Collapse& collapse = collapses[c];
+            unsigned int from = collapse.from, to = collapse.to;
+            if (touched[from] || touched[to])
+                continue;
+
+            bool flips = false;
+            for (unsigned int a = offsets[from]; a < offsets[from + 1] && !flips; a++)
+            {
+                const unsigned int* triangle = &indices[adjacency[a] * 3];
+                if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+                    continue; // removed by the collapse
+                glm::vec3 corners[3], moved[3];
+                for (int k = 0; k < 3; k++)
+                {
+                    corners[k] = vertices[triangle[k]].Position;
+                    moved[k] = triangle[k] == from ? vertices[to].Position : corners[k];
+                }
+                glm::vec3 before = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+                glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+                // more than ~75 degrees of turn counts as well, a few such steps would flip it over time
+                flips = glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after);
+            }
+            if (flips)
+                continue;
+
+            remap[from] = to;
+            quadrics[canonical[to]] += quadrics[canonical[from]];
+            worst = std::max(worst, collapse.cost);
+            // the neighbourhood's adjacency is stale for the rest of the pass
+            for (unsigned int a = offsets[from]; a < offsets[from + 1]; a++)
+                for (int k = 0; k < 3; k++)
+                    touched[indices[adjacency[a] * 3 + k]] = 1;
+            done++;
+        }
+        if (done == 0)
+            break;
+
+        size_t write = 0;
+        for (size_t t = 0; t + 2 < indices.size(); t += 3)
+        {
+            unsigned int a = remap[indices[t]], b = remap[indices[t + 1]], c = remap[indices[t + 2]];
+            if (canonical[a] == canonical[b] || canonical[b] == canonical[c] || canonical[a] == canonical[c])
+                continue;
+            indices[write++] = a;
+            indices[write++] = b;
+            indices[write++] = c;
+        }
+        indices.resize(write);
+    }
+    error = static_cast<float>(std::sqrt(worst));
+    return indices;
+}
+
+// The full list and up to levels - 1 coarser ones, each about reduction times the triangles of the one
+// before, all reordered for the vertex cache and concatenated into indices (the input list is replaced).
+// A level that cannot get below 80% of the previous one (within maxError, relative to the mesh size)
+// ends the chain.
+inline std::vector<MeshLod> buildLodChain(const Vertex* vertices, size_t vertexCount, std::vector<unsigned int>& indices,
+                                          unsigned int levels = MAX_MESH_LODS, float reduction = 0.5f, float maxError = 0.05f)
+{
+    std::vector<MeshLod> lods;
+    if (indices.empty())
+        return lods;
+    levels = std::max(1u, std::min(levels, static_cast<unsigned int>(MAX_MESH_LODS)));
+
+    glm::vec3 boundsMin(vertices[indices[0]].Position), boundsMax(boundsMin);
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        boundsMin = glm::min(boundsMin, vertices[indices[i]].Position);
+        boundsMax = glm::max(boundsMax, vertices[indices[i]].Position);
+    }
+    float errorLimit = maxError * glm::length(boundsMax - boundsMin);
+
+    std::vector<unsigned int> level(indices), chain;
+    float levelError = 0.0f;
+    for (unsigned int l = 0; l < levels; l++)
+    {
+        if (l > 0)
+        {
+            size_t target = static_cast<size_t>(level.size() / 3 * reduction) * 3;
+            float passError;
+            std::vector<unsigned int> simplified = simplifyMesh(vertices, vertexCount, level, target, errorLimit, passError);
+            if (simplified.empty() || simplified.size() > level.size() * 8 / 10)
+                break;
+            level.swap(simplified);
+            // each level is simplified from the one before, so the deviations add up
+            levelError += passError;
+        }
+        optimizeTriangleOrder(level, vertices, vertexCount);
+        MeshLod lod = { static_cast<uint32_t>(chain.size()), static_cast<uint32_t>(level.size()), levelError };
+        lods.push_back(lod);
+        chain.insert(chain.end(), level.begin(), level.end());
+    }
+    indices.swap(chain);
+    return lods;
+}
+
+// --- selection ---------------------------------------------------------------------------------------
+
+// Picks levels from how large their error appears on screen: the coarsest level whose error, at the
+// object's distance, projects to at most threshold pixels. A coarser level is only taken once its error
+// is a hysteresis fraction below the threshold, while a finer one is taken as soon as the current one
+// crosses it, so objects near a switching distance do not pop back and forth.
+struct LodSelector {
+    glm::vec3 eye;
+    float pixelsPerUnit; // at distance 1
+    float threshold;
+    float hysteresis;
+
+    LodSelector() : eye(0.0f), pixelsPerUnit(1.0f), threshold(1.0f), hysteresis(0.25f) {}
+
+    // per frame, from the camera position, vertical field of view (degrees) and viewport height
+    void setView(const glm::vec3& position, float fovyDegrees, float viewportHeight)
+    {
+        eye = position;
+        pixelsPerUnit = viewportHeight / (2.0f * std::tan(glm::radians(fovyDegrees) * 0.5f));
+    }
+
+    // errors[i] is the world space error of level i (non-decreasing), current the level drawn last frame
+    unsigned int select(const float* errors, unsigned int count, float distance, unsigned int current) const
+    {
+        if (count <= 1)
+            return 0;
+        current = std::min(current, count - 1);
+        float pixelsPerError = pixelsPerUnit / std::max(distance, 1e-3f);
+        unsigned int level = current;
+        while (level > 0 && errors[level] * pixelsPerError > threshold)
+            level--;
+        if (level == current)
+            while (level + 1 < count && errors[level + 1] * pixelsPerError <= threshold * (1.0f - hysteresis))
+                level++;
+        return level;
+    }
+};
+
+#endif
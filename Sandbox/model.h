@@ -7,58 +7,351 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <stb/stb_image.h>
 
-#include </OpenGl programming/OpenGl_FirstProject/shader_s.h>
+#include </OpenGl programming/Sandbox/shader_s.h>
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
-#include </OpenGl programming/OpenGl_FirstProject/mesh.h>
+#include </OpenGl programming/Sandbox/mesh.h>
+#include </OpenGl programming/Sandbox/gl_extensions.h>
+#include </OpenGl programming/Sandbox/mega_buffer.h>
+#include </OpenGl programming/Sandbox/model_cache.h>
+#include </OpenGl programming/Sandbox/texture_cache.h>
+#include </OpenGl programming/Sandbox/job_pool.h>
+#include </OpenGl programming/Sandbox/frustum.h>
+#include </OpenGl programming/Sandbox/animation.h>
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <unordered_map>
 #include <vector>
 using namespace std;
 
 unsigned int TextureFromFile(const char* path, const string& directory, bool gamma = false);
 
+// how a Model is loaded and stored, the defaults match the plain Model(path) behaviour
+struct ModelOptions {
+    bool gammaCorrection;
+    // when given, every mesh is sub-allocated into this shared buffer and the model is drawn
+    // with one glMultiDrawElementsIndirect per material on GL 4.3+ (base-vertex draws otherwise)
+    MegaBuffer* megaBuffer;
+    // VertexFormatFlags for the meshes' GPU copies, ignored with a megaBuffer (it stores full vertices)
+    unsigned int vertexFormat;
+    // free each mesh's vertices/indices after upload, only the GPU buffers, ranges and bounds stay
+    bool keepCpuGeometry;
+    // reserve room for every mesh of the scene up front instead of growing meshes while loading
+    bool preallocateMeshes;
+    // load from / write to the binary <path>.cache (see model_cache.h) instead of importing through Assimp every time
+    bool useCache;
+    // convert the aiMeshes to vertex/index arrays on the jobPool(), the meshes keep processNode's order
+    bool parallelLoad;
+    // simplify every mesh into up to this many levels of detail (see mesh_lod.h) while importing, 0 or 1 for none
+    unsigned int lodLevels;
+    // import the bones, their vertex weights and the animations (see animation.h). The model cache stores
+    // none of them, so animated loads always import the file; they only write the cache for files that
+    // turn out to have neither, for the static loads after them.
+    bool animated;
+
+    ModelOptions() : gammaCorrection(false), megaBuffer(NULL), vertexFormat(VERTEX_FULL), keepCpuGeometry(true), preallocateMeshes(true), useCache(true),
+                     parallelLoad(false), lodLevels(0), animated(false)
+    {
+    }
+};
+
 class Model
 {
 public:
 
     vector<Texture> textures_loaded;
     vector<Mesh>    meshes;
+    // the imported node hierarchy in pre-order, each node owning a contiguous range of meshes
+    vector<ModelNode> nodes;
     string directory;
     bool gammaCorrection;
-    Model(string const& path, bool gamma = false) : gammaCorrection(gamma)
+    MegaBuffer* megaBuffer;
+    unsigned int vertexFormat;
+    bool keepCpuGeometry;
+    bool preallocateMeshes;
+    bool useCache;
+    bool parallelLoad;
+    unsigned int lodLevels;
+    bool animated;
+    // filled for animated models only
+    Skeleton skeleton;
+    vector<AnimationClip> animations;
+    // object space bounds of all meshes together
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    Model(string const& path, bool gamma = false, MegaBuffer* pool = NULL)
+        : gammaCorrection(gamma), megaBuffer(pool), vertexFormat(VERTEX_FULL), keepCpuGeometry(true), preallocateMeshes(true), useCache(true),
+          parallelLoad(false), lodLevels(0), animated(false)
     {
         loadModel(path);
+        computeBounds();
+        shareInstances();
+    }
+    Model(string const& path, const ModelOptions& options)
+        : gammaCorrection(options.gammaCorrection), megaBuffer(options.megaBuffer), vertexFormat(options.vertexFormat),
+          keepCpuGeometry(options.keepCpuGeometry), preallocateMeshes(options.preallocateMeshes), useCache(options.useCache),
+          parallelLoad(options.parallelLoad), lodLevels(options.lodLevels > 1 ? options.lodLevels : 0), animated(options.animated)
+    {
+        loadModel(path);
+        computeBounds();
+        shareInstances();
+    }
+    // the meshes point at the model's instance buffer
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+    // draw the whole model once at transform, every mesh reads it as its one instance
+    void Draw(Shader& shader, const glm::mat4& transform = glm::mat4(1.0f))
+    {
+        // sampler units are fixed per name, so they only need setting when the program changes
+        if (samplerProgram != shader.ID)
+        {
+            Mesh::SetSamplerUnits(shader);
+            samplerProgram = shader.ID;
+        }
+        // the indirect commands draw instance 0 too, so both paths read the matrix uploaded here
+        Instances().upload(&transform, 1);
+        if (megaBuffer && glCaps().multiDrawIndirect)
+        {
+            drawIndirect();
+            return;
+        }
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].DrawUploadedInstances(shader, 1);
+    }
+    // draw only the meshes whose bounds, moved by transform, are in the frustum, each reading transform
+    // as its one instance. The multi-draw path can only take the model as a whole.
+    void Draw(Shader& shader, const Frustum& frustum, const glm::mat4& transform)
+    {
+        if (megaBuffer && glCaps().multiDrawIndirect)
+        {
+            glm::vec3 center, extent;
+            transformBounds(transform, boundsMin, boundsMax, center, extent);
+            if (frustum.intersects(center, extent))
+                Draw(shader, transform);
+            return;
+        }
+        if (samplerProgram != shader.ID)
+        {
+            Mesh::SetSamplerUnits(shader);
+            samplerProgram = shader.ID;
+        }
+        culler.clear();
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            culler.add(transform, meshes[i].boundsMin, meshes[i].boundsMax);
+        culler.cull(frustum, meshVisible);
+        Instances().upload(&transform, 1);
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            if (meshVisible[i])
+                meshes[i].DrawUploadedInstances(shader, 1);
     }
-    void Draw(Shader& shader)
+    // the transforms of the instances the frustum can see, for DrawInstanced
+    size_t CullInstances(const Frustum& frustum, const glm::mat4* transforms, size_t count, vector<glm::mat4>& visible)
     {
+        return cullInstances(culler, frustum, transforms, count, boundsMin, boundsMax, visible);
+    }
+    // draw the whole model once per transform, one instanced draw call per mesh, at level lod. The
+    // transforms are uploaded once, to the buffer every mesh reads its instances from.
+    void DrawInstanced(Shader& shader, const glm::mat4* transforms, size_t count, unsigned int lod = 0)
+    {
+        if (count == 0 || meshes.empty())
+            return;
+        if (samplerProgram != shader.ID)
+        {
+            Mesh::SetSamplerUnits(shader);
+            samplerProgram = shader.ID;
+        }
+        Instances().upload(transforms, count);
         for (unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+            meshes[i].DrawUploadedInstances(shader, count, lod);
+    }
+    void DrawInstanced(Shader& shader, const vector<glm::mat4>& transforms, unsigned int lod = 0)
+    {
+        DrawInstanced(shader, transforms.data(), transforms.size(), lod);
+    }
+    // where every mesh of the model reads its instance matrices from, the pool's with a megaBuffer
+    InstanceBuffer& Instances()
+    {
+        return megaBuffer ? megaBuffer->instances : instances;
+    }
+    // hand the model's textures back to the TextureCache, they are freed by its evictUnused()
+    void ReleaseTextures()
+    {
+        for (unsigned int i = 0; i < textures_loaded.size(); i++)
+            textureCache().release(textures_loaded[i].id);
+        textures_loaded.clear();
+        loadedIndex.clear();
     }
 private:
+    unsigned int samplerProgram = 0;
+    // shared by the VAOs of all meshes that own their buffers, see Instances()
+    InstanceBuffer instances;
+
+    void shareInstances()
+    {
+        if (megaBuffer)
+            return;
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].ShareInstances(instances);
+    }
+    // scratch of the culled draws, kept so they do not allocate every frame
+    FrustumCuller culler;
+    vector<unsigned char> meshVisible;
+
+    void computeBounds()
+    {
+        boundsMin = boundsMax = meshes.empty() ? glm::vec3(0.0f) : meshes[0].boundsMin;
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            boundsMin = glm::min(boundsMin, meshes[i].boundsMin);
+            boundsMax = glm::max(boundsMax, meshes[i].boundsMax);
+        }
+    }
+    // path -> position in textures_loaded
+    unordered_map<string, unsigned int> loadedIndex;
+
+    // a run of indirect commands whose meshes all bind the same textures
+    struct IndirectBatch {
+        unsigned int mesh;   // any mesh of the batch, for its texture bindings
+        GLsizei first;       // first command in the indirect buffer
+        GLsizei count;
+    };
+    unsigned int indirectBuffer = 0;
+    vector<IndirectBatch> batches;
+
+    // the command buffer never changes after loading, so it is built once on the first draw
+    void buildIndirectCommands()
+    {
+        // group meshes by material, keeping load order inside each group
+        vector<unsigned int> order;
+        vector<bool> taken(meshes.size(), false);
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            if (taken[i])
+                continue;
+            IndirectBatch batch;
+            batch.mesh = i;
+            batch.first = static_cast<GLsizei>(order.size());
+            for (unsigned int j = i; j < meshes.size(); j++)
+            {
+                if (!taken[j] && meshes[j].SameMaterial(meshes[i]))
+                {
+                    taken[j] = true;
+                    order.push_back(j);
+                }
+            }
+            batch.count = static_cast<GLsizei>(order.size()) - batch.first;
+            batches.push_back(batch);
+        }
+
+        vector<DrawElementsIndirectCommand> commands(order.size());
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            const MeshRange& range = meshes[order[i]].range;
+            commands[i].count = static_cast<GLuint>(range.indexCount);
+            commands[i].instanceCount = 1;
+            commands[i].firstIndex = range.firstIndex;
+            commands[i].baseVertex = range.baseVertex;
+            commands[i].baseInstance = 0;
+        }
+        glGenBuffers(1, &indirectBuffer);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STATIC_DRAW);
+    }
+
+    void drawIndirect()
+    {
+        if (indirectBuffer == 0)
+            buildIndirectCommands();
+        glState().bindVertexArray(megaBuffer->VAO);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+        for (size_t i = 0; i < batches.size(); i++)
+        {
+            meshes[batches[i].mesh].BindTextures();
+            glState().countDraw();
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(batches[i].first * sizeof(DrawElementsIndirectCommand)), batches[i].count, 0);
+        }
+    }
+
     void loadModel(string path)
     {
+        const unsigned int importFlags = aiProcess_Triangulate | aiProcess_FlipUVs;
+        directory = path.substr(0, path.find_last_of('/'));
+        // the cache has no bones, weights or animations, even for a file that has them
+        if (useCache && !animated && loadCache(path, importFlags))
+            return;
+
         Assimp::Importer import;
-        const aiScene* scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
+        // the vertices have room for MAX_BONE_INFLUENCE weights, which is also Assimp's default limit
+        const aiScene* scene = import.ReadFile(path, animated ? importFlags | aiProcess_LimitBoneWeights : importFlags);
 
         if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
         {
             cout << "ERROR::ASSIMP::" << import.GetErrorString() << endl;
             return;
         }
-        directory = path.substr(0, path.find_last_of('/'));
 
-        processNode(scene->mRootNode, scene);
+        // every scene mesh is referenced by at least one node in practice, so this is usually exact
+        if (preallocateMeshes)
+            meshes.reserve(scene->mNumMeshes);
+        // bone indices are handed out before any mesh is converted, so conversion stays free of shared writes
+        if (animated)
+            collectBones(scene);
+        if (parallelLoad)
+            processSceneParallel(scene);
+        else
+            processNode(scene->mRootNode, scene, -1);
+        if (animated)
+        {
+            resolveSkeleton();
+            loadAnimations(scene);
+            // a file without bones or animations is static after all
+            if (skeleton.boneIndex.empty() && animations.empty())
+                skeleton = Skeleton();
+        }
+
+        // the meshes keep their CPU geometry until the cache is written from it
+        if (useCache)
+        {
+            if (skeleton.empty())
+                ModelCache::write(path, importFlags, lodLevels, meshes, nodes);
+            if (!keepCpuGeometry)
+                for (unsigned int i = 0; i < meshes.size(); i++)
+                    meshes[i].ReleaseCpuData();
+        }
+    }
+
+    // build the meshes straight from the mapped cache, false on a miss
+    bool loadCache(const string& path, unsigned int importFlags)
+    {
+        ModelCache cache;
+        if (!cache.open(path, importFlags, lodLevels))
+            return false;
+        if (preallocateMeshes)
+            meshes.reserve(cache.meshCount());
+        for (unsigned int i = 0; i < cache.meshCount(); i++)
+        {
+            CachedMesh cached = cache.mesh(i);
+            vector<Texture> textures;
+            for (size_t t = 0; t < cached.textures.size(); t++)
+                textures.push_back(loadTexture(cached.textures[t].second.c_str(), cached.textures[t].first));
+            meshes.push_back(Mesh(cached.vertices, cached.vertexCount, cached.indices, cached.indexCount, std::move(textures),
+                                  cached.boundsMin, cached.boundsMax, megaBuffer, vertexFormat, keepCpuGeometry, std::move(cached.lods)));
+        }
+        nodes.reserve(cache.nodeCount());
+        for (unsigned int i = 0; i < cache.nodeCount(); i++)
+            nodes.push_back(cache.node(i));
+        return true;
     }
 
-    void processNode(aiNode* node, const aiScene* scene)
+    void processNode(aiNode* node, const aiScene* scene, int parent)
     {
+        int index = addNode(node, parent, static_cast<unsigned int>(meshes.size()));
         // precess all the node's meshes (if any)
         for (unsigned int i = 0; i < node->mNumMeshes; i++)
         {
@@ -68,14 +361,84 @@ private:
         // then do the same for each of its children
         for (unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, index);
         }
     }
+    // flatten the node tree into the order processNode visits it, recording the nodes on the way
+    void collectMeshes(aiNode* node, const aiScene* scene, vector<aiMesh*>& order, int parent)
+    {
+        int index = addNode(node, parent, static_cast<unsigned int>(meshes.size() + order.size()));
+        for (unsigned int i = 0; i < node->mNumMeshes; i++)
+            order.push_back(scene->mMeshes[node->mMeshes[i]]);
+        for (unsigned int i = 0; i < node->mNumChildren; i++)
+            collectMeshes(node->mChildren[i], scene, order, index);
+    }
+    // aiMatrix4x4 is row major, glm column major
+    static glm::mat4 toGlm(const aiMatrix4x4& m)
+    {
+        return glm::mat4(glm::vec4(m.a1, m.b1, m.c1, m.d1),
+                         glm::vec4(m.a2, m.b2, m.c2, m.d2),
+                         glm::vec4(m.a3, m.b3, m.c3, m.d3),
+                         glm::vec4(m.a4, m.b4, m.c4, m.d4));
+    }
+    int addNode(const aiNode* node, int parent, unsigned int firstMesh)
+    {
+        ModelNode record;
+        record.name = node->mName.C_Str();
+        record.transform = toGlm(node->mTransformation);
+        record.parent = parent;
+        record.firstMesh = firstMesh;
+        record.meshCount = node->mNumMeshes;
+        nodes.push_back(record);
+        return static_cast<int>(nodes.size() - 1);
+    }
+
+    // the geometry of every mesh is converted concurrently into its own preallocated slot; textures
+    // and GL buffers are then created here on the context thread, in order
+    void processSceneParallel(const aiScene* scene)
+    {
+        vector<aiMesh*> order;
+        collectMeshes(scene->mRootNode, scene, order, -1);
+
+        vector< vector<Vertex> > vertices(order.size());
+        vector< vector<unsigned int> > indices(order.size());
+        vector< vector<MeshLod> > lods(order.size());
+        const Skeleton* bones = animated ? &skeleton : NULL;
+        if (animated)
+            for (size_t i = 0; i < order.size(); i++)
+                skeleton.meshRigidBone.push_back(order[i]->mNumBones > 0 ? -1 : RIGID_BONE_PENDING);
+        jobPool().parallelFor(order.size(), [&](size_t i) {
+            convertMesh(order[i], vertices[i], indices[i], bones);
+            if (lodLevels > 1)
+                lods[i] = buildLodChain(vertices[i].data(), vertices[i].size(), indices[i], lodLevels);
+        });
+
+        meshes.reserve(meshes.size() + order.size());
+        for (size_t i = 0; i < order.size(); i++)
+            meshes.push_back(Mesh(std::move(vertices[i]), std::move(indices[i]), processMaterial(order[i], scene), megaBuffer, vertexFormat, keepCpuGeometry || useCache,
+                                  std::move(lods[i])));
+    }
+
     Mesh processMesh(aiMesh* mesh, const aiScene* scene)
     {
         vector<Vertex> vertices;
         vector<unsigned int> indices;
-        vector<Texture> textures;
+        if (animated)
+            skeleton.meshRigidBone.push_back(mesh->mNumBones > 0 ? -1 : RIGID_BONE_PENDING);
+        convertMesh(mesh, vertices, indices, animated ? &skeleton : NULL);
+        vector<MeshLod> lods;
+        if (lodLevels > 1)
+            lods = buildLodChain(vertices.data(), vertices.size(), indices, lodLevels);
+
+        return Mesh(std::move(vertices), std::move(indices), processMaterial(mesh, scene), megaBuffer, vertexFormat, keepCpuGeometry || useCache, std::move(lods));
+    }
+
+    // CPU only and touches nothing but its arguments, so it is safe to run on any thread. With a skeleton
+    // (only read, its bones are all registered by collectBones) the bone weights are filled in as well.
+    static void convertMesh(const aiMesh* mesh, vector<Vertex>& vertices, vector<unsigned int>& indices, const Skeleton* skeleton = NULL)
+    {
+        vertices.reserve(mesh->mNumVertices);
+        indices.reserve(mesh->mNumFaces * 3);
 
         for (unsigned int i = 0; i < mesh->mNumVertices; i++)
         {
@@ -102,34 +465,186 @@ private:
             else
                 vertex.TexCoords = glm::vec2(0.0f, 0.0f);
 
+            // no bone until one is assigned below
+            for (int b = 0; b < MAX_BONE_INFLUENCE; b++)
+            {
+                vertex.m_BoneIDs[b] = -1;
+                vertex.m_Weights[b] = 0.0f;
+            }
+
             vertices.push_back(vertex);
         }
 
+        if (skeleton)
+            addBoneWeights(mesh, *skeleton, vertices);
+
         for (unsigned int i = 0; i < mesh->mNumFaces; i++)
         {
             aiFace face = mesh->mFaces[i];
             for (unsigned int j = 0; j < face.mNumIndices; j++)
                 indices.push_back(face.mIndices[j]);
         }
+    }
+
+    // marks a mesh without bones in skeleton.meshRigidBone until resolveSkeleton gives it its node's bone
+    static const int RIGID_BONE_PENDING = -2;
+
+    // every bone name of the scene gets its index, in the order the meshes list them
+    void collectBones(const aiScene* scene)
+    {
+        for (unsigned int m = 0; m < scene->mNumMeshes; m++)
+        {
+            const aiMesh* mesh = scene->mMeshes[m];
+            for (unsigned int b = 0; b < mesh->mNumBones; b++)
+            {
+                const aiBone* bone = mesh->mBones[b];
+                if (skeleton.boneIndex.count(bone->mName.C_Str()))
+                    continue;
+                skeleton.boneIndex[bone->mName.C_Str()] = static_cast<unsigned int>(skeleton.bones.size());
+                Bone record;
+                record.node = -1;
+                record.offset = toGlm(bone->mOffsetMatrix);
+                skeleton.bones.push_back(record);
+            }
+        }
+    }
+
+    // keep the MAX_BONE_INFLUENCE strongest bones of every vertex, their weights summing to one
+    static void addBoneWeights(const aiMesh* mesh, const Skeleton& skeleton, vector<Vertex>& vertices)
+    {
+        for (unsigned int b = 0; b < mesh->mNumBones; b++)
+        {
+            const aiBone* bone = mesh->mBones[b];
+            unordered_map<string, unsigned int>::const_iterator it = skeleton.boneIndex.find(bone->mName.C_Str());
+            if (it == skeleton.boneIndex.end())
+                continue;
+            for (unsigned int w = 0; w < bone->mNumWeights; w++)
+            {
+                const aiVertexWeight& weight = bone->mWeights[w];
+                if (weight.mVertexId >= vertices.size() || weight.mWeight <= 0.0f)
+                    continue;
+                Vertex& vertex = vertices[weight.mVertexId];
+                int slot = 0;
+                for (int s = 1; s < MAX_BONE_INFLUENCE; s++)
+                    if (vertex.m_Weights[s] < vertex.m_Weights[slot])
+                        slot = s;
+                if (weight.mWeight > vertex.m_Weights[slot])
+                {
+                    vertex.m_BoneIDs[slot] = static_cast<int>(it->second);
+                    vertex.m_Weights[slot] = weight.mWeight;
+                }
+            }
+        }
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            float total = 0.0f;
+            for (int s = 0; s < MAX_BONE_INFLUENCE; s++)
+                total += vertices[i].m_Weights[s];
+            if (total > 0.0f)
+                for (int s = 0; s < MAX_BONE_INFLUENCE; s++)
+                    vertices[i].m_Weights[s] /= total;
+        }
+    }
+
+    // once the nodes are recorded: find every bone's node, and give the meshes without bones one each
+    // that follows the node they hang from
+    void resolveSkeleton()
+    {
+        unordered_map<string, int> nodeIndex;
+        for (size_t n = 0; n < nodes.size(); n++)
+            nodeIndex[nodes[n].name] = static_cast<int>(n);
+        for (unordered_map<string, unsigned int>::const_iterator it = skeleton.boneIndex.begin(); it != skeleton.boneIndex.end(); ++it)
+        {
+            unordered_map<string, int>::const_iterator node = nodeIndex.find(it->first);
+            if (node == nodeIndex.end())
+                cout << "Model: bone " << it->first << " has no node, it stays at the root" << endl;
+            skeleton.bones[it->second].node = node == nodeIndex.end() ? 0 : node->second;
+        }
+        unordered_map<int, int> nodeBone;
+        for (size_t n = 0; n < nodes.size(); n++)
+        {
+            for (unsigned int m = nodes[n].firstMesh; m < nodes[n].firstMesh + nodes[n].meshCount && m < skeleton.meshRigidBone.size(); m++)
+            {
+                if (skeleton.meshRigidBone[m] != RIGID_BONE_PENDING)
+                    continue;
+                if (!nodeBone.count((int)n))
+                {
+                    Bone record;
+                    record.node = static_cast<int>(n);
+                    record.offset = glm::mat4(1.0f);
+                    nodeBone[(int)n] = static_cast<int>(skeleton.bones.size());
+                    skeleton.bones.push_back(record);
+                }
+                skeleton.meshRigidBone[m] = nodeBone[(int)n];
+            }
+        }
+        skeleton.globalInverse = nodes.empty() ? glm::mat4(1.0f) : glm::inverse(nodes[0].transform);
+    }
 
-        if (mesh->mMaterialIndex >= 0)
+    void loadAnimations(const aiScene* scene)
+    {
+        unordered_map<string, int> nodeIndex;
+        for (size_t n = 0; n < nodes.size(); n++)
+            nodeIndex[nodes[n].name] = static_cast<int>(n);
+        for (unsigned int a = 0; a < scene->mNumAnimations; a++)
         {
-            aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+            const aiAnimation* animation = scene->mAnimations[a];
+            AnimationClip clip;
+            clip.name = animation->mName.C_Str();
+            clip.duration = static_cast<float>(animation->mDuration);
+            clip.ticksPerSecond = static_cast<float>(animation->mTicksPerSecond);
+            clip.nodeChannel.assign(nodes.size(), -1);
+            for (unsigned int c = 0; c < animation->mNumChannels; c++)
+            {
+                const aiNodeAnim* source = animation->mChannels[c];
+                unordered_map<string, int>::const_iterator node = nodeIndex.find(source->mNodeName.C_Str());
+                if (node == nodeIndex.end())
+                    continue;
+                NodeChannel channel;
+                channel.node = node->second;
+                for (unsigned int k = 0; k < source->mNumPositionKeys; k++)
+                {
+                    const aiVectorKey& key = source->mPositionKeys[k];
+                    VectorKey record = { static_cast<float>(key.mTime), glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z) };
+                    channel.positions.push_back(record);
+                }
+                for (unsigned int k = 0; k < source->mNumRotationKeys; k++)
+                {
+                    const aiQuatKey& key = source->mRotationKeys[k];
+                    RotationKey record = { static_cast<float>(key.mTime), glm::quat(key.mValue.w, key.mValue.x, key.mValue.y, key.mValue.z) };
+                    channel.rotations.push_back(record);
+                }
+                for (unsigned int k = 0; k < source->mNumScalingKeys; k++)
+                {
+                    const aiVectorKey& key = source->mScalingKeys[k];
+                    VectorKey record = { static_cast<float>(key.mTime), glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z) };
+                    channel.scales.push_back(record);
+                }
+                clip.nodeChannel[channel.node] = static_cast<int>(clip.channels.size());
+                clip.channels.push_back(channel);
+            }
+            animations.push_back(clip);
+        }
+    }
 
-            vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-            textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+    vector<Texture> processMaterial(const aiMesh* mesh, const aiScene* scene)
+    {
+        vector<Texture> textures;
+        aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
 
-            vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-            textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
+        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
 
-            std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-            textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
+        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
 
-            std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-            textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
+        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
 
-            return Mesh(vertices, indices, textures);
-        }
+        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
+        textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+
+        return textures;
     }
     vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
     {
@@ -138,69 +653,35 @@ private:
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for (unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if (!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecessary load duplicate textures.
-            }
+            textures.push_back(loadTexture(str.C_Str(), typeName));
         }
         return textures;
     }
+    Texture loadTexture(const char* path, const string& typeName)
+    {
+        // check if texture was loaded before and if so, skip loading a new texture
+        unordered_map<string, unsigned int>::iterator it = loadedIndex.find(path);
+        if (it != loadedIndex.end())
+            return textures_loaded[it->second]; // a texture with the same filepath has already been loaded (optimization)
+        // if texture hasn't been loaded by this model, take it from the cache (which may load it)
+        Texture texture;
+        texture.id = TextureFromFile(path, this->directory, gammaCorrection);
+        texture.type = typeName;
+        texture.path = path;
+        loadedIndex[texture.path] = static_cast<unsigned int>(textures_loaded.size());
+        textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecessary load duplicate textures.
+        return texture;
+    }
 };
 
+// shared through the TextureCache and loaded in the background by the TextureLoader, the returned
+// name is usable right away and holds one cache reference
 unsigned int TextureFromFile(const char* path, const string& directory, bool gamma)
 {
     string filename = string(path);
     filename = directory + '/' + filename;
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    return textureCache().acquire(filename, gamma);
 }
 
 #endif // !MODEL_H
@@ -0,0 +1,469 @@
+#ifndef MODEL_CACHE_H
+#define MODEL_CACHE_H
+
+#include </OpenGl programming/Sandbox/mesh.h>
+
+#include <sys/stat.h>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <utility>
+#include <iostream>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Binary copy of an imported model, written next to the source as <source>.cache the first time it
+// is loaded through Assimp. It is only valid for the exact source path, modification time, import
+// flags and LOD level count it was written with, and for the Vertex layout of the build that wrote it; anything
+// else is treated as a miss and the model is imported (and cached) again.
+//
+// layout, native byte order, every section starts 8 byte aligned so the mapped file can be used
+// in place:
+//   ModelCacheHeader
+//   source path, header.pathLength chars
+//   ModelCacheMesh[header.meshCount]
+//   per mesh: Vertex[vertexCount], uint32 indices[indexCount] (every level), textureCount x
+//             { uint32 typeLength, uint32 pathLength, type chars, path chars }, MeshLod[lodCount]
+//   at header.nodeOffset: ModelCacheNode[header.nodeCount], then the node names
+#define MODEL_CACHE_MAGIC   0x434C444D // "MDLC"
+#define MODEL_CACHE_VERSION 3
+
+struct ModelCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t importFlags;
+    uint32_t vertexSize;
+    int64_t  sourceMtime;
+    uint32_t pathLength;
+    uint32_t meshCount;
+    uint32_t nodeCount;
+    uint32_t lodLevels;
+    uint64_t nodeOffset;
+};
+
+struct ModelCacheMesh {
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    uint64_t textureOffset;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t textureCount;
+    float    boundsMin[3];
+    float    boundsMax[3];
+    uint32_t lodCount;
+    uint64_t lodOffset;
+};
+
+struct ModelCacheNode {
+    float    transform[16]; // column major, like glm
+    int32_t  parent;
+    uint32_t firstMesh;
+    uint32_t meshCount;
+    uint32_t nameLength;
+    uint64_t nameOffset;
+};
+
+// one aiNode of the imported hierarchy, stored in pre-order so parents come before their children.
+// its meshes are the contiguous run of Model::meshes the node walk appended for it.
+struct ModelNode {
+    std::string name;
+    glm::mat4 transform; // relative to the parent
+    int parent;          // -1 for the root
+    unsigned int firstMesh;
+    unsigned int meshCount;
+};
+
+// read-only mapping of a whole file
+class MappedFile {
+public:
+    const unsigned char* data;
+    size_t size;
+
+    MappedFile() : data(NULL), size(0)
+    {
+#ifdef _WIN32
+        file = INVALID_HANDLE_VALUE;
+        mapping = NULL;
+#endif
+    }
+    ~MappedFile()
+    {
+        close();
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path)
+    {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+        {
+            close();
+            return false;
+        }
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping)
+            data = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (!data)
+        {
+            close();
+            return false;
+        }
+        size = static_cast<size_t>(fileSize.QuadPart);
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        void* view = mmap(NULL, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        // the mapping stays valid after the descriptor is closed
+        ::close(fd);
+        if (view == MAP_FAILED)
+            return false;
+        data = static_cast<const unsigned char*>(view);
+        size = static_cast<size_t>(info.st_size);
+#endif
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (data)
+            UnmapViewOfFile(data);
+        if (mapping)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+        mapping = NULL;
+#else
+        if (data)
+            munmap(const_cast<unsigned char*>(data), size);
+#endif
+        data = NULL;
+        size = 0;
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+// a mesh of an open ModelCache, the geometry pointers point into the mapped file
+struct CachedMesh {
+    const Vertex* vertices;
+    size_t vertexCount;
+    const unsigned int* indices;
+    size_t indexCount;
+    std::vector< std::pair<std::string, std::string> > textures; // {type, path}
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    std::vector<MeshLod> lods;
+};
+
+inline bool fileModifiedTime(const std::string& path, int64_t& mtime)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+        return false;
+    mtime = static_cast<int64_t>(info.st_mtime);
+    return true;
+}
+
+class ModelCache {
+public:
+    static std::string cachePath(const std::string& source)
+    {
+        return source + ".cache";
+    }
+
+    // maps the cache of source, false if there is none or it does not match source/importFlags/lodLevels
+    bool open(const std::string& source, unsigned int importFlags, unsigned int lodLevels)
+    {
+        int64_t mtime;
+        if (!fileModifiedTime(source, mtime) || !file.open(cachePath(source)))
+            return false;
+        if (!validate(source, importFlags, lodLevels, mtime))
+        {
+            file.close();
+            return false;
+        }
+        return true;
+    }
+
+    unsigned int meshCount() const
+    {
+        return header()->meshCount;
+    }
+
+    unsigned int nodeCount() const
+    {
+        return header()->nodeCount;
+    }
+
+    ModelNode node(unsigned int i) const
+    {
+        const ModelCacheNode& record = nodeRecords()[i];
+        ModelNode node;
+        node.name.assign(reinterpret_cast<const char*>(file.data + record.nameOffset), record.nameLength);
+        std::memcpy(&node.transform[0][0], record.transform, sizeof(record.transform));
+        node.parent = record.parent;
+        node.firstMesh = record.firstMesh;
+        node.meshCount = record.meshCount;
+        return node;
+    }
+
+    CachedMesh mesh(unsigned int i) const
+    {
+        const ModelCacheMesh& record = records()[i];
+        CachedMesh mesh;
+        mesh.vertices = reinterpret_cast<const Vertex*>(file.data + record.vertexOffset);
+        mesh.vertexCount = record.vertexCount;
+        mesh.indices = reinterpret_cast<const unsigned int*>(file.data + record.indexOffset);
+        mesh.indexCount = record.indexCount;
+        mesh.boundsMin = glm::vec3(record.boundsMin[0], record.boundsMin[1], record.boundsMin[2]);
+        mesh.boundsMax = glm::vec3(record.boundsMax[0], record.boundsMax[1], record.boundsMax[2]);
+
+        const unsigned char* p = file.data + record.textureOffset;
+        for (uint32_t t = 0; t < record.textureCount; t++)
+        {
+            uint32_t lengths[2];
+            std::memcpy(lengths, p, sizeof(lengths));
+            p += sizeof(lengths);
+            std::string type(reinterpret_cast<const char*>(p), lengths[0]);
+            std::string path(reinterpret_cast<const char*>(p) + lengths[0], lengths[1]);
+            p += lengths[0] + lengths[1];
+            mesh.textures.push_back(std::make_pair(type, path));
+        }
+        const MeshLod* lods = reinterpret_cast<const MeshLod*>(file.data + record.lodOffset);
+        mesh.lods.assign(lods, lods + record.lodCount);
+        return mesh;
+    }
+
+    void close()
+    {
+        file.close();
+    }
+
+    // writes the cache of source for the given meshes and node hierarchy; the meshes must still
+    // hold their CPU geometry
+    static bool write(const std::string& source, unsigned int importFlags, unsigned int lodLevels, const std::vector<Mesh>& meshes,
+                      const std::vector<ModelNode>& nodes)
+    {
+        int64_t mtime;
+        if (!fileModifiedTime(source, mtime))
+            return false;
+
+        std::vector<unsigned char> blob;
+        ModelCacheHeader header;
+        header.magic = MODEL_CACHE_MAGIC;
+        header.version = MODEL_CACHE_VERSION;
+        header.importFlags = importFlags;
+        header.vertexSize = sizeof(Vertex);
+        header.sourceMtime = mtime;
+        header.pathLength = static_cast<uint32_t>(source.size());
+        header.meshCount = static_cast<uint32_t>(meshes.size());
+        header.nodeCount = static_cast<uint32_t>(nodes.size());
+        header.lodLevels = lodLevels;
+        header.nodeOffset = 0; // patched once the meshes are in
+        append(blob, &header, sizeof(header));
+        append(blob, source.data(), source.size());
+        align(blob);
+
+        size_t recordsOffset = blob.size();
+        blob.resize(blob.size() + meshes.size() * sizeof(ModelCacheMesh));
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            const Mesh& mesh = meshes[i];
+            ModelCacheMesh record;
+            std::memset(&record, 0, sizeof(record));
+            record.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+            record.indexCount = static_cast<uint32_t>(mesh.indices.size());
+            record.textureCount = static_cast<uint32_t>(mesh.textures.size());
+            for (int c = 0; c < 3; c++)
+            {
+                record.boundsMin[c] = mesh.boundsMin[c];
+                record.boundsMax[c] = mesh.boundsMax[c];
+            }
+
+            record.vertexOffset = blob.size();
+            append(blob, mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+            align(blob);
+            record.indexOffset = blob.size();
+            append(blob, mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int));
+            align(blob);
+            record.textureOffset = blob.size();
+            for (size_t t = 0; t < mesh.textures.size(); t++)
+            {
+                uint32_t lengths[2] = { static_cast<uint32_t>(mesh.textures[t].type.size()), static_cast<uint32_t>(mesh.textures[t].path.size()) };
+                append(blob, lengths, sizeof(lengths));
+                append(blob, mesh.textures[t].type.data(), lengths[0]);
+                append(blob, mesh.textures[t].path.data(), lengths[1]);
+            }
+            align(blob);
+            record.lodCount = static_cast<uint32_t>(mesh.lods.size());
+            record.lodOffset = blob.size();
+            append(blob, mesh.lods.data(), mesh.lods.size() * sizeof(MeshLod));
+            align(blob);
+            std::memcpy(&blob[recordsOffset + i * sizeof(ModelCacheMesh)], &record, sizeof(record));
+        }
+
+        header.nodeOffset = blob.size();
+        std::memcpy(&blob[0], &header, sizeof(header));
+        blob.resize(blob.size() + nodes.size() * sizeof(ModelCacheNode));
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            ModelCacheNode record;
+            std::memset(&record, 0, sizeof(record));
+            std::memcpy(record.transform, &nodes[i].transform[0][0], sizeof(record.transform));
+            record.parent = nodes[i].parent;
+            record.firstMesh = nodes[i].firstMesh;
+            record.meshCount = nodes[i].meshCount;
+            record.nameLength = static_cast<uint32_t>(nodes[i].name.size());
+            record.nameOffset = blob.size();
+            append(blob, nodes[i].name.data(), nodes[i].name.size());
+            std::memcpy(&blob[header.nodeOffset + i * sizeof(ModelCacheNode)], &record, sizeof(record));
+        }
+        align(blob);
+
+        // write to a temporary first so a crash never leaves a truncated cache behind
+        std::string path = cachePath(source);
+        std::string temporary = path + ".tmp";
+        FILE* out = std::fopen(temporary.c_str(), "wb");
+        if (!out)
+        {
+            std::cout << "ERROR::MODEL_CACHE::CANNOT_WRITE " << temporary << std::endl;
+            return false;
+        }
+        bool written = std::fwrite(blob.data(), 1, blob.size(), out) == blob.size();
+        written = std::fclose(out) == 0 && written;
+        std::remove(path.c_str());
+        if (!written || std::rename(temporary.c_str(), path.c_str()) != 0)
+        {
+            std::cout << "ERROR::MODEL_CACHE::CANNOT_WRITE " << path << std::endl;
+            std::remove(temporary.c_str());
+            return false;
+        }
+        return true;
+    }
+
+private:
+    MappedFile file;
+
+    const ModelCacheHeader* header() const
+    {
+        return reinterpret_cast<const ModelCacheHeader*>(file.data);
+    }
+    const ModelCacheMesh* records() const
+    {
+        return reinterpret_cast<const ModelCacheMesh*>(file.data + alignedSize(sizeof(ModelCacheHeader) + header()->pathLength));
+    }
+    const ModelCacheNode* nodeRecords() const
+    {
+        return reinterpret_cast<const ModelCacheNode*>(file.data + header()->nodeOffset);
+    }
+
+    static size_t alignedSize(size_t size)
+    {
+        return (size + 7) & ~static_cast<size_t>(7);
+    }
+    static void align(std::vector<unsigned char>& blob)
+    {
+        blob.resize(alignedSize(blob.size()), 0);
+    }
+    static void append(std::vector<unsigned char>& blob, const void* data, size_t size)
+    {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        blob.insert(blob.end(), bytes, bytes + size);
+    }
+
+    bool inFile(uint64_t offset, uint64_t size) const
+    {
+        return offset <= file.size && size <= file.size - offset;
+    }
+
+    // checks the key and that every section lies inside the file, so a stale or damaged cache
+    // is rejected instead of read out of bounds
+    bool validate(const std::string& source, unsigned int importFlags, unsigned int lodLevels, int64_t mtime) const
+    {
+        if (!inFile(0, sizeof(ModelCacheHeader)))
+            return false;
+        const ModelCacheHeader* h = header();
+        if (h->magic != MODEL_CACHE_MAGIC || h->version != MODEL_CACHE_VERSION || h->importFlags != importFlags || h->lodLevels != lodLevels ||
+            h->vertexSize != sizeof(Vertex) || h->sourceMtime != mtime || h->pathLength != source.size())
+            return false;
+        if (!inFile(sizeof(ModelCacheHeader), h->pathLength) ||
+            std::memcmp(file.data + sizeof(ModelCacheHeader), source.data(), source.size()) != 0)
+            return false;
+
+        uint64_t recordsOffset = alignedSize(sizeof(ModelCacheHeader) + h->pathLength);
+        if (!inFile(recordsOffset, static_cast<uint64_t>(h->meshCount) * sizeof(ModelCacheMesh)))
+            return false;
+        for (uint32_t i = 0; i < h->meshCount; i++)
+        {
+            const ModelCacheMesh& record = records()[i];
+            if (!inFile(record.vertexOffset, static_cast<uint64_t>(record.vertexCount) * sizeof(Vertex)) ||
+                !inFile(record.indexOffset, static_cast<uint64_t>(record.indexCount) * sizeof(unsigned int)) ||
+                (record.vertexOffset | record.indexOffset) & 7)
+                return false;
+            uint64_t offset = record.textureOffset;
+            for (uint32_t t = 0; t < record.textureCount; t++)
+            {
+                uint32_t lengths[2];
+                if (!inFile(offset, sizeof(lengths)))
+                    return false;
+                std::memcpy(lengths, file.data + offset, sizeof(lengths));
+                offset += sizeof(lengths);
+                if (!inFile(offset, static_cast<uint64_t>(lengths[0]) + lengths[1]))
+                    return false;
+                offset += static_cast<uint64_t>(lengths[0]) + lengths[1];
+            }
+            if ((record.lodOffset & 3) || !inFile(record.lodOffset, static_cast<uint64_t>(record.lodCount) * sizeof(MeshLod)))
+                return false;
+            const MeshLod* lods = reinterpret_cast<const MeshLod*>(file.data + record.lodOffset);
+            for (uint32_t l = 0; l < record.lodCount; l++)
+                if (static_cast<uint64_t>(lods[l].firstIndex) + lods[l].indexCount > record.indexCount)
+                    return false;
+        }
+
+        if ((h->nodeOffset & 7) || !inFile(h->nodeOffset, static_cast<uint64_t>(h->nodeCount) * sizeof(ModelCacheNode)))
+            return false;
+        for (uint32_t i = 0; i < h->nodeCount; i++)
+        {
+            const ModelCacheNode& record = nodeRecords()[i];
+            if (record.parent >= static_cast<int32_t>(i) || record.parent < -1 || !inFile(record.nameOffset, record.nameLength) ||
+                static_cast<uint64_t>(record.firstMesh) + record.meshCount > h->meshCount)
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif
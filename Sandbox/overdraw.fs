@@ -0,0 +1,24 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+// alpha holds how many fragments were written to the pixel
+uniform sampler2D overdrawCounts;
+// the part of the target counted into this frame
+uniform vec2 uvScale;
+
+void main()
+{
+    float count = texture(overdrawCounts, TexCoords * uvScale).a;
+    if (count < 0.5)
+    {
+        FragColor = vec4(0.0, 0.0, 0.0, 1.0);
+        return;
+    }
+    // blue at one fragment, through green and yellow, to red at eight and more
+    float t = clamp(log2(count) / 3.0, 0.0, 1.0);
+    vec3 color = t < 0.5 ? mix(vec3(0.0, 0.2, 1.0), vec3(0.0, 1.0, 0.2), t * 2.0)
+                         : mix(vec3(1.0, 1.0, 0.0), vec3(1.0, 0.0, 0.0), t * 2.0 - 1.0);
+    FragColor = vec4(color, 1.0);
+}
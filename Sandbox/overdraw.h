@@ -0,0 +1,154 @@
+#ifndef OVERDRAW_H
+#define OVERDRAW_H
+
+#include <glad/glad.h>
+
+#include </OpenGl programming/Sandbox/gl_state_cache.h>
+#include </OpenGl programming/Sandbox/shader_s.h>
+
+#include <vector>
+#include <iostream>
+
+// Counts the fragments written to every pixel. Between begin() and end() the scene renders into an
+// offscreen target with blending set up so each fragment adds its alpha to the pixel's count and leaves
+// the color alone; every program keeps running its own shaders, which all write an alpha of 1.
+// Fragments rejected by the depth test or discarded are not counted, so with the depth pre-pass on,
+// every pixel covered by pre-passed geometry should read 1. Allocated at the scene target's allocated size
+// and drawn to through its scaled rectangle, like the GBuffer.
+class OverdrawCounter
+{
+public:
+    unsigned int FBO;
+    unsigned int counts; // RGBA16F, only alpha is written
+    unsigned int depth;
+    int allocatedWidth, allocatedHeight;
+    int width, height;   // the part rendered to this frame
+
+    OverdrawCounter() : FBO(0), counts(0), depth(0), allocatedWidth(0), allocatedHeight(0), width(0), height(0), emptyVAO(0)
+    {
+    }
+
+    bool resize(int w, int h)
+    {
+        if (FBO && w == allocatedWidth && h == allocatedHeight)
+            return true;
+        release();
+        allocatedWidth = width = w;
+        allocatedHeight = height = h;
+
+        glGenFramebuffers(1, &FBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glGenTextures(1, &counts);
+        glState().bindTexture(0, GL_TEXTURE_2D, counts);
+        // half floats count exactly up to 2048, far more layers than any pixel gets
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, w, h, 0, GL_RGBA, GL_HALF_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, counts, 0);
+        glGenRenderbuffers(1, &depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (!complete)
+        {
+            std::cout << "OverdrawCounter: framebuffer not complete at " << w << "x" << h << std::endl;
+            release();
+        }
+        return complete;
+    }
+
+    // count into this part of the target from now on, clamped to the allocated size
+    void setViewport(int w, int h)
+    {
+        width = w < 1 ? 1 : (w > allocatedWidth ? allocatedWidth : w);
+        height = h < 1 ? 1 : (h > allocatedHeight ? allocatedHeight : h);
+    }
+
+    // everything drawn until end() is counted instead of shown
+    void begin()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glViewport(0, 0, width, height);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glEnable(GL_BLEND);
+        // color: src * 0 + dst * 1, alpha: src * 1 + dst * 1
+        glBlendFuncSeparate(GL_ZERO, GL_ONE, GL_ONE, GL_ONE);
+    }
+
+    void end()
+    {
+        glDisable(GL_BLEND);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, width, height);
+    }
+
+    // draw the counts as a heat map into the bound framebuffer (fullscreen.vs + overdraw.fs)
+    void present(Shader& heatmap)
+    {
+        if (!emptyVAO)
+            glGenVertexArrays(1, &emptyVAO);
+        GLStateCache& state = glState();
+        heatmap.use();
+        heatmap.setInt("overdrawCounts", 0);
+        heatmap.setVec2("uvScale", (float)width / allocatedWidth, (float)height / allocatedHeight);
+        state.bindTexture(0, GL_TEXTURE_2D, counts);
+        state.bindVertexArray(emptyVAO);
+        glDisable(GL_DEPTH_TEST);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glEnable(GL_DEPTH_TEST);
+        state.countDraw();
+    }
+
+    // average fragments per covered pixel, and the share of the screen that is covered. reads the target
+    // back and waits for the GPU to get there, so only call it now and then.
+    float average(float* coverage = NULL)
+    {
+        size_t pixelCount = (size_t)width * height;
+        std::vector<float> pixels(pixelCount * 4);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_FLOAT, pixels.data());
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        double total = 0.0;
+        size_t covered = 0;
+        for (size_t i = 0; i < pixelCount; i++)
+        {
+            float count = pixels[i * 4 + 3];
+            if (count > 0.5f)
+            {
+                total += count;
+                covered++;
+            }
+        }
+        if (coverage)
+            *coverage = pixelCount ? (float)covered / (float)pixelCount : 0.0f;
+        return covered ? (float)(total / covered) : 0.0f;
+    }
+
+    void release()
+    {
+        if (counts)
+        {
+            glState().forgetTexture(counts);
+            glDeleteTextures(1, &counts);
+        }
+        if (depth)
+            glDeleteRenderbuffers(1, &depth);
+        if (FBO)
+            glDeleteFramebuffers(1, &FBO);
+        if (emptyVAO)
+        {
+            glState().forgetVertexArray(emptyVAO);
+            glDeleteVertexArrays(1, &emptyVAO);
+        }
+        FBO = counts = depth = emptyVAO = 0;
+    }
+
+private:
+    unsigned int emptyVAO; // the fullscreen triangle is generated from gl_VertexID, core still wants a VAO bound
+};
+
+#endif
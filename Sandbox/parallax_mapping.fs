@@ -14,44 +14,74 @@ uniform sampler2D normalMap;
 uniform sampler2D depthMap;
   
 uniform float heightScale;
+// the layer count adapts per pixel between these
+uniform float minLayers;
+uniform float maxLayers;
+
+// hard caps on the texture fetches of one march, whatever maxLayers is set to
+const int MAX_LAYER_STEPS = 64;
+const int REFINE_STEPS = 5;
 
 vec2 ParallaxMapping(vec2 texCoords, vec3 viewDir)
 {
-    // number of depth layers
-    const float numLayers = 10;
+    // the amount to shift the texture coordinates over the full depth (from vector p)
+    vec2 P = viewDir.xy / viewDir.z * heightScale;
+    // derivatives are taken here, in uniform control flow, and reused by every fetch in the loops below
+    vec2 gradX = dFdx(texCoords);
+    vec2 gradY = dFdy(texCoords);
+    // one layer per pixel the shift crosses on screen: grazing views shift further and get more layers,
+    // distant (minified) surfaces cover fewer pixels and get fewer
+    float pixelSize = max(max(length(gradX), length(gradY)), 1e-6);
+    float numLayers = clamp(length(P) / pixelSize, minLayers, min(maxLayers, float(MAX_LAYER_STEPS)));
+
     // calculate the size of each layer
     float layerDepth = 1.0 / numLayers;
     // depth of current layer
     float currentLayerDepth = 0.0;
-    // the amount to shift the texture coordinates per layer (from vector p)
-    vec2 P = viewDir.xy / viewDir.z * heightScale; 
     vec2 deltaTexCoords = P / numLayers;
     // get initial values
     vec2 currentTexCoords = texCoords;
-    float currentDepthMapValue = texture(depthMap, currentTexCoords).r;
+    float currentDepthMapValue = textureGrad(depthMap, currentTexCoords, gradX, gradY).r;
 
-    while(currentLayerDepth < currentDepthMapValue)
+    for (int i = 0; i < MAX_LAYER_STEPS && currentLayerDepth < currentDepthMapValue; i++)
     {
-         // shfift texture coordinates along direction of P
-         currentTexCoords -= deltaTexCoords;
-         // get depthmap value at current texture coordinates
-         currentDepthMapValue = texture(depthMap, currentTexCoords).r;
-         // get depth of next layer
-         currentLayerDepth += layerDepth;
+        // shift texture coordinates along direction of P
+        currentTexCoords -= deltaTexCoords;
+        // get depthmap value at current texture coordinates
+        currentDepthMapValue = textureGrad(depthMap, currentTexCoords, gradX, gradY).r;
+        // get depth of next layer
+        currentLayerDepth += layerDepth;
     }
+    if (currentLayerDepth == 0.0)
+        return texCoords;
 
-    // texture coordinates before collision
-    vec2 prevTexCoords = currentTexCoords + deltaTexCoords;
-
-    // depth after and before collision for linear
-    float afterDepth = currentDepthMapValue - currentLayerDepth;
-    float beforeDepth = texture(depthMap, prevTexCoords).r - currentLayerDepth + layerDepth;
-
-    // interpolation of texture coordinates
-    float weight = afterDepth / (afterDepth - beforeDepth);
-    vec2 finalTexCoords = prevTexCoords * weight + currentTexCoords * (1.0 - weight);
+    // binary search between the last layer above the surface and the first one below it
+    vec2 aboveTexCoords = currentTexCoords + deltaTexCoords;
+    float aboveDepth = currentLayerDepth - layerDepth;
+    vec2 belowTexCoords = currentTexCoords;
+    float belowDepth = currentLayerDepth;
+    for (int i = 0; i < REFINE_STEPS; i++)
+    {
+        vec2 middleTexCoords = (aboveTexCoords + belowTexCoords) * 0.5;
+        float middleDepth = (aboveDepth + belowDepth) * 0.5;
+        if (textureGrad(depthMap, middleTexCoords, gradX, gradY).r > middleDepth)
+        {
+            aboveTexCoords = middleTexCoords;
+            aboveDepth = middleDepth;
+        }
+        else
+        {
+            belowTexCoords = middleTexCoords;
+            belowDepth = middleDepth;
+        }
+    }
 
-    return finalTexCoords;
+    // depth after and before collision for linear interpolation within the last interval
+    float afterDepth = textureGrad(depthMap, belowTexCoords, gradX, gradY).r - belowDepth;
+    float beforeDepth = textureGrad(depthMap, aboveTexCoords, gradX, gradY).r - aboveDepth;
+    float difference = afterDepth - beforeDepth;
+    float weight = abs(difference) > 1e-6 ? afterDepth / difference : 0.0;
+    return aboveTexCoords * weight + belowTexCoords * (1.0 - weight);
 }
 
 void main()
@@ -64,8 +94,9 @@ void main()
         discard;
 
     // then sample textures with new texture coords
-    vec3 normal = texture(normalMap, texCoords).rgb;
-    normal = normalize(normal * 2.0  - 1.0);
+    // only xy is read so a two channel (BC5) normal map works too, z is rebuilt from them
+    vec2 normalXY = texture(normalMap, texCoords).rg * 2.0 - 1.0;
+    vec3 normal = normalize(vec3(normalXY, sqrt(max(1.0 - dot(normalXY, normalXY), 0.0))));
 
     vec3 color = texture(diffuseMap, texCoords).rgb;
     // ambient
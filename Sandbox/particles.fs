@@ -0,0 +1,17 @@
+#version 430 core
+out vec4 FragColor;
+
+in vec2 Corner;
+in float Life;
+
+void main()
+{
+    float falloff = 1.0 - dot(Corner, Corner);
+    if (falloff <= 0.0)
+        discard;
+    // white hot at the start, cooling to a dim red before going out
+    vec3 color = mix(vec3(0.8, 0.12, 0.02), vec3(1.0, 0.85, 0.45), clamp(Life, 0.0, 1.0));
+    color *= falloff * falloff * clamp(Life * 2.0, 0.0, 1.0);
+    // added to the scene with GL_ONE, GL_ONE; alpha stays 1 so the overdraw counter counts it once
+    FragColor = vec4(color, 1.0);
+}
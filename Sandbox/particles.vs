@@ -0,0 +1,31 @@
+#version 430 core
+
+#include <FrameData>
+
+struct Particle {
+    vec4 position;
+    vec4 velocity;
+};
+layout (std430, binding = 0) readonly buffer Particles {
+    Particle particles[];
+};
+layout (std430, binding = 1) readonly buffer Alive {
+    uint alive[];
+};
+
+uniform float size;
+
+out vec2 Corner;
+out float Life;
+
+void main()
+{
+    Particle p = particles[alive[gl_InstanceID]];
+    // a camera facing quad as a strip of four, made from the vertex id
+    Corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+    vec3 right = vec3(view[0][0], view[1][0], view[2][0]);
+    vec3 up = vec3(view[0][1], view[1][1], view[2][1]);
+    Life = p.position.w;
+    float radius = size * clamp(Life * 2.0, 0.25, 1.0);
+    gl_Position = projection * view * vec4(p.position.xyz + (right * Corner.x + up * Corner.y) * radius, 1.0);
+}
@@ -0,0 +1,73 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform samplerCube source;
+uniform int face;          // the cubemap face being rendered, +X -X +Y -Y +Z -Z
+uniform float roughness;   // of the lobe added on top of the source's blur
+uniform int sampleCount;
+
+const float PI = 3.14159265359;
+
+// the direction through this pixel of the face, following the cubemap coordinate tables of the GL spec
+vec3 faceDirection(vec2 uv)
+{
+    vec2 p = uv * 2.0 - 1.0;
+    if (face == 0) return vec3(1.0, -p.y, -p.x);
+    if (face == 1) return vec3(-1.0, -p.y, p.x);
+    if (face == 2) return vec3(p.x, 1.0, p.y);
+    if (face == 3) return vec3(p.x, -1.0, -p.y);
+    if (face == 4) return vec3(p.x, -p.y, 1.0);
+    return vec3(-p.x, -p.y, -1.0);
+}
+
+// Hammersley point i of n, the radical inverse spreads the samples evenly without any noise
+vec2 hammersley(uint i, uint n)
+{
+    uint bits = i;
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return vec2(float(i) / float(n), float(bits) * 2.3283064365386963e-10);
+}
+
+// a half vector around N distributed like the GGX lobe of this roughness
+vec3 importanceSampleGGX(vec2 xi, vec3 N, float a)
+{
+    float phi = 2.0 * PI * xi.x;
+    float cosTheta = sqrt((1.0 - xi.y) / (1.0 + (a * a - 1.0) * xi.y));
+    float sinTheta = sqrt(1.0 - cosTheta * cosTheta);
+    vec3 H = vec3(cos(phi) * sinTheta, sin(phi) * sinTheta, cosTheta);
+
+    vec3 up = abs(N.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+    vec3 tangent = normalize(cross(up, N));
+    vec3 bitangent = cross(N, tangent);
+    return normalize(tangent * H.x + bitangent * H.y + N * H.z);
+}
+
+void main()
+{
+    // split sum approximation: the view is taken to look straight along the normal
+    vec3 N = normalize(faceDirection(TexCoords));
+    float a = roughness * roughness;
+
+    vec3 color = vec3(0.0);
+    float weight = 0.0;
+    uint count = uint(max(sampleCount, 1));
+    for (uint i = 0u; i < count; i++)
+    {
+        vec3 H = importanceSampleGGX(hammersley(i, count), N, a);
+        vec3 L = normalize(2.0 * dot(N, H) * H - N);
+        float NdotL = dot(N, L);
+        if (NdotL > 0.0)
+        {
+            // the caller limits the source to the one level it may read
+            color += textureLod(source, L, 0.0).rgb * NdotL;
+            weight += NdotL;
+        }
+    }
+    FragColor = vec4(color / max(weight, 0.0001), 1.0);
+}
@@ -4,12 +4,21 @@ out vec4 FragColor;
 in vec3 Normal;
 in vec3 Position;
 
-uniform vec3 cameraPos;
-uniform samplerCube skybox;
+#include <FrameData>
+
+// prefiltered, level n holds the reflection at roughness n / maxLod (see EnvironmentMap)
+uniform samplerCube environment;
+uniform float environmentSize; // texels a side of level 0
+uniform float maxLod;
+uniform float roughness;
 
 void main()
 {
     vec3 I = normalize(Position - cameraPos);
     vec3 R = reflect(I, normalize(Normal));
-    FragColor = vec4(texture(skybox, R).rgb, 1.0);
-}
\ No newline at end of file
+    // the level the surface's roughness calls for, or a blurrier one where neighbouring pixels reflect
+    // directions further apart than a texel, so minified reflections do not shimmer; a face spans two units
+    float footprint = max(length(dFdx(R)), length(dFdy(R))) * environmentSize * 0.5;
+    float lod = max(roughness * maxLod, log2(max(footprint, 1.0)));
+    FragColor = vec4(textureLod(environment, R, min(lod, maxLod)).rgb, 1.0);
+}
@@ -1,3 +1,23 @@
-version https://git-lfs.github.com/spec/v1
-oid sha256:7f73cc8deb097eedb6bb6c7cbd6f36ff49806954463f3b587b73c3112ee2bccc
-size 391
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 7) in mat4 aInstanceModel;
+
+out vec3 Normal;
+out vec3 Position;
+
+// must come out bit-identical in depth_instanced.vs for the GL_EQUAL pass after the depth pre-pass
+invariant gl_Position;
+
+#include <FrameData>
+
+// dequantization of VERTEX_QUANTIZED positions, set by Mesh around its draws; identity for everything else
+uniform vec3 positionScale = vec3(1.0);
+uniform vec3 positionBias = vec3(0.0);
+
+void main()
+{
+    Normal = mat3(transpose(inverse(aInstanceModel))) * aNormal;
+    Position = vec3(aInstanceModel * vec4(aPos * positionScale + positionBias, 1.0));
+    gl_Position = projection * view * aInstanceModel * vec4(aPos * positionScale + positionBias, 1.0);
+}
@@ -0,0 +1,243 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include </OpenGl programming/Sandbox/gl_state_cache.h>
+#include </OpenGl programming/Sandbox/shader_s.h>
+#include </OpenGl programming/Sandbox/gpu_profiler.h>
+#include </OpenGl programming/Sandbox/sort_key.h>
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+// passes execute in this order; the background pass draws with GL_LEQUAL after all opaques.
+// the G-buffer pass only fills the deferred renderer's targets, it is executed on its own into that FBO
+enum RenderPass {
+    PASS_GBUFFER = 0,
+    PASS_OPAQUE = 1,
+    PASS_BACKGROUND = 2
+};
+
+// one texture a material binds
+struct MaterialTexture {
+    GLuint unit;
+    GLenum target;
+    GLuint id;
+};
+
+// one submitted draw; everything the queue needs to replay it later
+struct DrawItem {
+    Shader* shader;
+    UniformHandle modelLocation;
+    glm::mat4 model;
+    unsigned int material; // from RenderQueue::addMaterial, 0 binds no textures
+    GLuint VAO;
+    GLenum mode;
+    GLsizei count;
+    bool indexed;          // glDrawElements with GL_UNSIGNED_INT indices, otherwise glDrawArrays
+    GLsizei instanceCount; // > 0 draws that many instances, the VAO carries the per-instance data
+    const char* label;     // profiler scope consecutive draws with this label are timed under, NULL for none
+    // depth pre-pass: a program computing gl_Position exactly like the item's own (both declare it
+    // invariant) and a VAO streaming only what that program reads. NULL keeps the item out of the pre-pass,
+    // which any item whose fragment shader discards must be.
+    Shader* depthShader;
+    UniformHandle depthModelLocation;
+    GLuint depthVAO;
+};
+
+// Collects the frame's draws, sorts them once by a 64-bit key and plays them back, so program, material
+// and VAO changes are grouped and opaque objects draw front-to-back within each group.
+//
+// key layout, most significant bits first:
+//   63..62 pass | 61..52 program | 51..40 material | 39..28 VAO | 27..4 view depth (front-to-back) | 3..0 unused
+class RenderQueue
+{
+public:
+    RenderQueue() : nearPlane(0.1f), farPlane(100.0f), view(1.0f), prepassed(false)
+    {
+        materials.push_back(Material()); // material 0: no textures
+    }
+
+    // register a material once at load time, returns the id to put in DrawItem::material
+    unsigned int addMaterial(const MaterialTexture* textures, unsigned int count)
+    {
+        Material material;
+        material.textures.assign(textures, textures + count);
+        materials.push_back(material);
+        return static_cast<unsigned int>(materials.size() - 1);
+    }
+
+    // start a new frame; depth keys are taken along the view direction between the clip planes
+    void begin(const glm::mat4& viewMatrix, float zNear, float zFar)
+    {
+        view = viewMatrix;
+        nearPlane = zNear;
+        farPlane = zFar;
+        items.clear();
+        entries.clear();
+        prepassed = false;
+    }
+
+    void submit(RenderPass pass, const DrawItem& item)
+    {
+        SortEntry entry;
+        entry.key = makeKey(pass, item);
+        entry.index = static_cast<uint32_t>(items.size());
+        items.push_back(item);
+        entries.push_back(entry);
+    }
+
+    void sort()
+    {
+        sortByKey(entries, scratch);
+    }
+
+    // lay down the depth of every opaque item that has a depth program, with color writes off. the
+    // following execute() then draws those items with GL_EQUAL, so their fragment shaders only run for
+    // the pixels they end up covering; everything else keeps GL_LESS.
+    void executeDepthPrepass(GpuProfiler* profiler = NULL)
+    {
+        GLStateCache& state = glState();
+        if (profiler)
+            profiler->begin("depth prepass");
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        state.depthFunc(GL_LESS);
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            int itemPass = static_cast<int>(entries[i].key >> 62);
+            if (itemPass < PASS_OPAQUE)
+                continue;
+            if (itemPass > PASS_OPAQUE)
+                break;
+            const DrawItem& item = items[entries[i].index];
+            if (!item.depthShader)
+                continue;
+            item.depthShader->use();
+            state.bindVertexArray(item.depthVAO);
+            if (item.depthModelLocation.valid())
+                item.depthShader->setMat4(item.depthModelLocation, item.model);
+            draw(item);
+        }
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        if (profiler)
+            profiler->end();
+        prepassed = true;
+    }
+
+    // replay the sorted draws of passes firstPass..lastPass, all binding goes through the state cache so
+    // repeats are elided. with a profiler every run of draws sharing a label is one scope.
+    void execute(GpuProfiler* profiler = NULL, RenderPass firstPass = PASS_GBUFFER, RenderPass lastPass = PASS_BACKGROUND)
+    {
+        GLStateCache& state = glState();
+        unsigned int material = ~0u;
+        const char* label = NULL;
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            int itemPass = static_cast<int>(entries[i].key >> 62);
+            if (itemPass < firstPass)
+                continue;
+            if (itemPass > lastPass)
+                break;
+            const DrawItem& item = items[entries[i].index];
+            // the state cache drops the repeats, so this is only issued when the function changes
+            if (itemPass == PASS_BACKGROUND)
+                state.depthFunc(GL_LEQUAL);
+            else
+                state.depthFunc(prepassed && itemPass == PASS_OPAQUE && item.depthShader ? GL_EQUAL : GL_LESS);
+            if (profiler && !sameLabel(item.label, label))
+            {
+                if (label)
+                    profiler->end();
+                label = item.label;
+                if (label)
+                    profiler->begin(label);
+            }
+
+            item.shader->use();
+            if (item.material != material)
+            {
+                material = item.material;
+                const std::vector<MaterialTexture>& textures = materials[material].textures;
+                for (size_t t = 0; t < textures.size(); t++)
+                    state.bindTexture(textures[t].unit, textures[t].target, textures[t].id);
+            }
+            state.bindVertexArray(item.VAO);
+            if (item.modelLocation.valid())
+                item.shader->setMat4(item.modelLocation, item.model);
+            draw(item);
+        }
+        if (profiler && label)
+            profiler->end();
+        state.depthFunc(GL_LESS);
+    }
+
+    size_t size() const { return entries.size(); }
+
+    // whether anything was submitted to the pass this frame
+    bool hasPass(RenderPass pass) const
+    {
+        for (size_t i = 0; i < entries.size(); i++)
+            if (static_cast<int>(entries[i].key >> 62) == pass)
+                return true;
+        return false;
+    }
+
+private:
+    struct Material {
+        std::vector<MaterialTexture> textures;
+    };
+    struct SortEntry {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    std::vector<Material> materials;
+    std::vector<DrawItem> items;
+    std::vector<SortEntry> entries;
+    std::vector<SortEntry> scratch;
+    float nearPlane, farPlane;
+    glm::mat4 view;
+
+    bool prepassed; // executeDepthPrepass ran this frame
+
+    static void draw(const DrawItem& item)
+    {
+        if (item.instanceCount > 0)
+        {
+            if (item.indexed)
+                glDrawElementsInstanced(item.mode, item.count, GL_UNSIGNED_INT, 0, item.instanceCount);
+            else
+                glDrawArraysInstanced(item.mode, 0, item.count, item.instanceCount);
+        }
+        else if (item.indexed)
+            glDrawElements(item.mode, item.count, GL_UNSIGNED_INT, 0);
+        else
+            glDrawArrays(item.mode, 0, item.count);
+        glState().countDraw();
+    }
+
+    static bool sameLabel(const char* a, const char* b)
+    {
+        return a == b || (a && b && std::strcmp(a, b) == 0);
+    }
+
+    uint64_t makeKey(RenderPass pass, const DrawItem& item) const
+    {
+        // distance in front of the camera of the object's origin, quantized to 24 bits
+        glm::vec4 viewPos = view * item.model[3];
+        float depth = (-viewPos.z - nearPlane) / (farPlane - nearPlane);
+        depth = depth < 0.0f ? 0.0f : (depth > 1.0f ? 1.0f : depth);
+        uint64_t depthBits = static_cast<uint64_t>(depth * 16777215.0f);
+
+        return (static_cast<uint64_t>(pass & 0x3) << 62)
+             | (static_cast<uint64_t>(item.shader->ID & 0x3FF) << 52)
+             | (static_cast<uint64_t>(item.material & 0xFFF) << 40)
+             | (static_cast<uint64_t>(item.VAO & 0xFFF) << 28)
+             | (depthBits << 4);
+    }
+};
+
+#endif
@@ -0,0 +1,239 @@
+#ifndef RENDER_TARGET_H
+#define RENDER_TARGET_H
+
+#include <glad/glad.h>
+
+#include </OpenGl programming/Sandbox/gl_state_cache.h>
+#include </OpenGl programming/Sandbox/shader_s.h>
+
+#include <cmath>
+#include <iostream>
+
+// Picks the fraction of the window's resolution the scene renders at from measured GPU frame times.
+// The GPU time arrives a few frames late, so after every change it waits for the new resolution to show
+// up in the measurements before deciding again; scales are quantized so small jitter never reallocates.
+class DynamicResolution
+{
+public:
+    bool enabled;
+    float targetMs;  // GPU time per frame to stay under, a little below the frame budget
+    float minScale;
+    float maxScale;
+    float scale;     // current fraction of the window's width and height
+
+    DynamicResolution() : enabled(true), targetMs(1000.0f / 60.0f * 0.9f), minScale(0.5f), maxScale(1.0f), scale(1.0f),
+        smoothedMs(-1.0f), cooldown(0)
+    {
+    }
+
+    // feed the profiler's lastGpuFrameMs() once per frame
+    void update(float gpuMs)
+    {
+        if (!enabled)
+        {
+            scale = maxScale;
+            return;
+        }
+        if (gpuMs < 0.0f)
+            return;
+        smoothedMs = smoothedMs < 0.0f ? gpuMs : smoothedMs + (gpuMs - smoothedMs) * 0.2f;
+        if (cooldown > 0)
+        {
+            cooldown--;
+            return;
+        }
+
+        float next = scale;
+        if (smoothedMs > targetMs)
+        {
+            // GPU time roughly follows the pixel count, the square of the scale
+            next = scale * std::sqrt(targetMs / smoothedMs);
+        }
+        else if (smoothedMs < targetMs * 0.8f)
+        {
+            // grow carefully, overshooting costs a dropped frame
+            next = scale * 1.05f;
+        }
+        next = std::floor(next * STEPS + 0.5f) / STEPS;
+        next = next < minScale ? minScale : (next > maxScale ? maxScale : next);
+        if (next != scale)
+        {
+            scale = next;
+            smoothedMs = -1.0f;
+            cooldown = COOLDOWN_FRAMES;
+        }
+    }
+
+private:
+    static const int COOLDOWN_FRAMES = 20; // longer than the profiler's frames in flight plus some smoothing
+    static constexpr float STEPS = 20.0f;  // scale moves in 5% steps
+    float smoothedMs;
+    int cooldown;
+};
+
+// The offscreen target the scene renders into: MSAA color and depth allocated once at the window's size,
+// of which only the scaled rectangle is drawn to. resolve() averages the samples into a plain texture and
+// present() stretches that rectangle over the window with a contrast-adaptive sharpening filter
+// (fullscreen.vs + upscale.fs). When the target cannot be created at the window's size, bind() binds
+// the default framebuffer at full size instead and the scene is drawn natively into the window.
+class SceneTarget
+{
+public:
+    unsigned int FBO;         // multisampled, the scene draws here
+    unsigned int resolveFBO;
+    unsigned int colorBuffer, depthBuffer;
+    unsigned int resolveTexture;
+    int allocatedWidth, allocatedHeight;
+    int width, height;        // the part rendered to this frame
+    int samples;
+
+    SceneTarget() : FBO(0), resolveFBO(0), colorBuffer(0), depthBuffer(0), resolveTexture(0), allocatedWidth(0), allocatedHeight(0),
+        width(0), height(0), samples(0), emptyVAO(0), failed(false)
+    {
+    }
+
+    // allocate for a window of this size, a no-op when it has not changed; false when the framebuffer is
+    // incomplete, which is not tried again (or reported) until the size changes
+    bool resize(int windowWidth, int windowHeight, int requestedSamples = 4)
+    {
+        if (windowWidth < 1)
+            windowWidth = 1;
+        if (windowHeight < 1)
+            windowHeight = 1;
+        if (windowWidth == allocatedWidth && windowHeight == allocatedHeight && (FBO || failed))
+            return FBO != 0;
+        release();
+        allocatedWidth = width = windowWidth;
+        allocatedHeight = height = windowHeight;
+        GLint maxSamples = 0;
+        glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+        samples = requestedSamples < maxSamples ? requestedSamples : maxSamples;
+
+        glGenFramebuffers(1, &FBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glGenRenderbuffers(1, &colorBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, allocatedWidth, allocatedHeight);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+        glGenRenderbuffers(1, &depthBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT24, allocatedWidth, allocatedHeight);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+        glGenFramebuffers(1, &resolveFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, resolveFBO);
+        glGenTextures(1, &resolveTexture);
+        glState().bindTexture(0, GL_TEXTURE_2D, resolveTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, allocatedWidth, allocatedHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        // bilinear does the upscale, the sharpening taps are placed on texel centers
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, resolveTexture, 0);
+        complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        failed = !complete;
+        if (!complete)
+        {
+            std::cout << "SceneTarget: framebuffer not complete at " << windowWidth << "x" << windowHeight << " with " << samples << " samples" << std::endl;
+            release();
+        }
+        return complete;
+    }
+
+    // render at this fraction of the allocated size from now on; the window is always drawn at full size
+    void setScale(float scale)
+    {
+        if (!FBO)
+        {
+            width = allocatedWidth;
+            height = allocatedHeight;
+            return;
+        }
+        width = (int)(allocatedWidth * scale + 0.5f);
+        height = (int)(allocatedHeight * scale + 0.5f);
+        width = width < 1 ? 1 : (width > allocatedWidth ? allocatedWidth : width);
+        height = height < 1 ? 1 : (height > allocatedHeight ? allocatedHeight : height);
+    }
+
+    void bind()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glViewport(0, 0, width, height);
+    }
+
+    // average the samples of the rendered rectangle; a multisample blit has to keep its rectangle as is
+    void resolve()
+    {
+        if (!FBO)
+            return;
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolveFBO);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // at full scale there is nothing to stretch; resolve straight into the default framebuffer
+    void resolveToWindow()
+    {
+        if (!FBO)
+            return;
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // stretch the resolved rectangle over the default framebuffer; sharpness 0 is plain bilinear
+    void present(Shader& upscale, int windowWidth, int windowHeight, float sharpness)
+    {
+        if (!FBO)
+            return;
+        if (!emptyVAO)
+            glGenVertexArrays(1, &emptyVAO);
+        GLStateCache& state = glState();
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, windowWidth, windowHeight);
+        upscale.use();
+        upscale.setInt("source", 0);
+        upscale.setVec2("uvScale", (float)width / allocatedWidth, (float)height / allocatedHeight);
+        upscale.setVec2("texelSize", 1.0f / allocatedWidth, 1.0f / allocatedHeight);
+        upscale.setFloat("sharpness", sharpness);
+        state.bindTexture(0, GL_TEXTURE_2D, resolveTexture);
+        state.bindVertexArray(emptyVAO);
+        glDisable(GL_DEPTH_TEST);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glEnable(GL_DEPTH_TEST);
+        state.countDraw();
+    }
+
+    void release()
+    {
+        if (resolveTexture)
+        {
+            glState().forgetTexture(resolveTexture);
+            glDeleteTextures(1, &resolveTexture);
+        }
+        unsigned int renderbuffers[2] = { colorBuffer, depthBuffer };
+        glDeleteRenderbuffers(2, renderbuffers);
+        if (FBO)
+            glDeleteFramebuffers(1, &FBO);
+        if (resolveFBO)
+            glDeleteFramebuffers(1, &resolveFBO);
+        if (emptyVAO)
+        {
+            glState().forgetVertexArray(emptyVAO);
+            glDeleteVertexArrays(1, &emptyVAO);
+        }
+        FBO = resolveFBO = colorBuffer = depthBuffer = resolveTexture = emptyVAO = 0;
+    }
+
+private:
+    unsigned int emptyVAO; // the fullscreen triangle is generated from gl_VertexID, core still wants a VAO bound
+    bool failed;           // at the allocated size
+};
+
+#endif
@@ -0,0 +1,483 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glm/glm.hpp>
+
+#include </OpenGl programming/Sandbox/bvh.h>
+#include </OpenGl programming/Sandbox/frustum.h>
+#include </OpenGl programming/Sandbox/model.h>
+#include </OpenGl programming/Sandbox/command_buffer.h>
+#include </OpenGl programming/Sandbox/job_pool.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// A transform hierarchy over model instances. Every node has a local transform relative to its
+// parent; addModel() mirrors a model's own node hierarchy under a new node, so the transforms Assimp
+// stores per node (and processNode used to drop) are applied again. Nodes owning meshes are leaves of
+// a BVH over their world space bounds, which is what the frustum, pick and nearest queries walk.
+//
+//   int car = scene.addModel(carModel, glm::translate(glm::mat4(1.0f), position));
+//   scene.setTransform(car, moved);
+//   scene.update();                                // once per frame, before any query
+//   scene.queryFrustum(frustum, visible);
+//   scene.drawInstanced(shader, visible, &lodSelector);
+//
+// or, to spread the per node work over the job pool, record the visible nodes and submit them:
+//   recorder.begin(view, zNear, zFar, jobs);
+//   scene.recordInstanced(recorder, visible, &lodSelector);
+//   recorder.submit(glBackend);
+struct SceneNode {
+    std::string name;
+    glm::mat4 local;
+    glm::mat4 world;
+    int parent;                 // -1 for a root
+    std::vector<int> children;
+    Model* model;               // draws meshes [firstMesh, firstMesh + meshCount) of it, or none
+    unsigned int firstMesh;
+    unsigned int meshCount;
+    glm::vec3 boundsMin;        // object space, of those meshes
+    glm::vec3 boundsMax;
+    int proxy;                  // BVH leaf, BVH::NONE without meshes
+    unsigned int lod;           // level of detail it was drawn at last
+    bool dirty;                 // world of it and its subtree is out of date
+    bool used;                  // false while on the free list
+};
+
+class Scene
+{
+public:
+    Scene() : freeList(-1), changedSinceBuild(0)
+    {
+    }
+
+    int createNode(const std::string& name, const glm::mat4& local = glm::mat4(1.0f), int parent = -1)
+    {
+        int index = allocate();
+        SceneNode& node = nodes[index];
+        node.name = name;
+        node.local = local;
+        node.world = local;
+        node.parent = parent;
+        node.model = NULL;
+        node.firstMesh = node.meshCount = 0;
+        node.boundsMin = node.boundsMax = glm::vec3(0.0f);
+        node.proxy = BVH::NONE;
+        node.lod = 0;
+        node.dirty = false;
+        markDirty(index);
+        if (parent >= 0)
+            nodes[parent].children.push_back(index);
+        return index;
+    }
+
+    // one node per node of the model under a new root placed at transform, returns that root
+    int addModel(Model& model, const glm::mat4& transform = glm::mat4(1.0f), int parent = -1)
+    {
+        int instance = createNode("", transform, parent);
+        if (model.nodes.empty())
+        {
+            // nothing recorded (a failed import): treat the model as a single node
+            attach(instance, model, 0, static_cast<unsigned int>(model.meshes.size()));
+            return instance;
+        }
+        std::vector<int> mirrored(model.nodes.size());
+        for (size_t i = 0; i < model.nodes.size(); i++)
+        {
+            const ModelNode& source = model.nodes[i];
+            int index = createNode(source.name, source.transform, source.parent < 0 ? instance : mirrored[source.parent]);
+            attach(index, model, source.firstMesh, source.meshCount);
+            mirrored[i] = index;
+        }
+        return instance;
+    }
+
+    // the node and everything below it
+    void removeNode(int index)
+    {
+        SceneNode& node = nodes[index];
+        if (node.parent >= 0)
+        {
+            std::vector<int>& siblings = nodes[node.parent].children;
+            siblings.erase(std::remove(siblings.begin(), siblings.end(), index), siblings.end());
+        }
+        std::vector<int> stack(1, index);
+        while (!stack.empty())
+        {
+            int i = stack.back();
+            stack.pop_back();
+            SceneNode& removed = nodes[i];
+            stack.insert(stack.end(), removed.children.begin(), removed.children.end());
+            if (removed.proxy != BVH::NONE)
+                bvh.remove(removed.proxy);
+            removed.children.clear();
+            removed.proxy = BVH::NONE;
+            removed.model = NULL;
+            removed.used = false;
+            removed.parent = freeList;
+            freeList = i;
+            changedSinceBuild++;
+        }
+    }
+
+    void setTransform(int index, const glm::mat4& local)
+    {
+        nodes[index].local = local;
+        markDirty(index);
+    }
+
+    const SceneNode& node(int index) const { return nodes[index]; }
+    const glm::mat4& worldTransform(int index) const { return nodes[index].world; }
+    const BVH& hierarchy() const { return bvh; }
+
+    // bring world transforms and the BVH up to date with the setTransform calls since the last update
+    void update()
+    {
+        for (size_t d = 0; d < dirtyNodes.size(); d++)
+        {
+            int index = dirtyNodes[d];
+            // only ancestors that are still dirty start a walk, the walk covers their subtrees
+            if (!nodes[index].used || !nodes[index].dirty || dirtyAncestor(index))
+                continue;
+            updateSubtree(index);
+        }
+        dirtyNodes.clear();
+
+        // refitting keeps the leaves where they were inserted, so once enough of them moved check
+        // whether a top-down rebuild would make the queries tighter
+        if (changedSinceBuild * 8 > bvh.size())
+        {
+            if (bvh.needsRebuild())
+                bvh.rebuild();
+            changedSinceBuild = 0;
+        }
+    }
+
+    // nodes with meshes whose world bounds are at least partly in the frustum
+    void queryFrustum(const Frustum& frustum, std::vector<int>& visible) const
+    {
+        visible.clear();
+        bvh.queryFrustum(frustum, [&](int index) { visible.push_back(index); });
+    }
+
+    // the closest node hit by the ray within distance (world units along direction), -1 for none.
+    // Meshes that kept their CPU geometry are tested per triangle, the others by their bounds.
+    int pick(const glm::vec3& origin, const glm::vec3& direction, float& distance) const
+    {
+        return bvh.raycast(origin, direction, distance, [&](int index, float maxDistance) {
+            return pickNode(nodes[index], origin, direction, maxDistance);
+        });
+    }
+
+    // the k nodes nearest to point by their world bounds, closest first
+    void nearest(const glm::vec3& point, size_t k, std::vector<int>& out) const
+    {
+        bvh.nearest(point, k, nearestScratch);
+        out.clear();
+        for (size_t i = 0; i < nearestScratch.size(); i++)
+            out.push_back(nearestScratch[i].second);
+    }
+
+    // the given nodes' meshes instanced, in first-seen order: the transforms of all nodes drawing the same
+    // meshes of a model at one level are uploaded once to the model's instance buffer, and each of those
+    // meshes draws them with one call; the vertex shader takes its model matrix from the instance
+    // attribute. With a selector each node picks its level of detail from its distance, otherwise
+    // everything is drawn at full detail.
+    void drawInstanced(Shader& shader, const std::vector<int>& visible, const LodSelector* selector = NULL)
+    {
+        for (size_t b = 0; b < batches.size(); b++)
+            for (unsigned int l = 0; l < MAX_MESH_LODS; l++)
+                batches[b].transforms[l].clear();
+        batchIndex.clear();
+        size_t used = 0;
+        for (size_t v = 0; v < visible.size(); v++)
+        {
+            SceneNode& node = nodes[visible[v]];
+            if (node.meshCount == 0)
+                continue;
+            unsigned int lod = selector ? selectLod(node, *selector) : 0;
+            // node ranges of a model never overlap, so the first mesh tells the range
+            const Mesh* first = &node.model->meshes[node.firstMesh];
+            std::unordered_map<const Mesh*, size_t>::iterator it = batchIndex.find(first);
+            size_t b;
+            if (it == batchIndex.end())
+            {
+                b = used++;
+                if (batches.size() < used)
+                    batches.push_back(Batch());
+                batches[b].model = node.model;
+                batches[b].firstMesh = node.firstMesh;
+                batches[b].meshCount = node.meshCount;
+                batchIndex[first] = b;
+            }
+            else
+                b = it->second;
+            batches[b].transforms[std::min(lod, MAX_MESH_LODS - 1u)].push_back(node.world);
+        }
+        if (used == 0)
+            return;
+        Mesh::SetSamplerUnits(shader);
+        for (size_t b = 0; b < used; b++)
+            for (unsigned int l = 0; l < MAX_MESH_LODS; l++)
+            {
+                const std::vector<glm::mat4>& transforms = batches[b].transforms[l];
+                if (transforms.empty())
+                    continue;
+                batches[b].model->Instances().upload(transforms.data(), transforms.size());
+                for (unsigned int m = batches[b].firstMesh; m < batches[b].firstMesh + batches[b].meshCount; m++)
+                    batches[b].model->meshes[m].DrawUploadedInstances(shader, transforms.size(), l);
+            }
+    }
+
+    // the visible nodes as ModelInstanceCommands, recorded on the job pool: each of the recorder's jobs
+    // takes a slice of visible into its own buffer and picks every node's level of detail like
+    // drawInstanced. A node's meshes share one command, and so one upload of its transform, which is why
+    // they are culled together by the node's bounds the BVH tested and not one by one.
+    void recordInstanced(CommandRecorder& recorder, const std::vector<int>& visible, const LodSelector* selector = NULL)
+    {
+        size_t jobs = recorder.jobCount();
+        if (jobs == 0 || visible.empty())
+            return;
+        size_t slice = (visible.size() + jobs - 1) / jobs;
+        // a node is in one slice only, so the level selection writing node.lod is not shared
+        jobPool().parallelFor(jobs, [&](size_t job) {
+            CommandBuffer& buffer = recorder.buffer(job);
+            size_t end = std::min(visible.size(), (job + 1) * slice);
+            for (size_t v = job * slice; v < end; v++)
+            {
+                SceneNode& node = nodes[visible[v]];
+                if (node.meshCount == 0)
+                    continue;
+                unsigned int lod = selector ? selectLod(node, *selector) : 0;
+                glm::vec3 center = glm::vec3(node.world * glm::vec4((node.boundsMin + node.boundsMax) * 0.5f, 1.0f));
+                ModelInstanceCommand& command = buffer.record<ModelInstanceCommand>(COMMAND_MODEL_INSTANCE,
+                    ModelInstanceCommand::key(rangeIds.find(&node.model->meshes[node.firstMesh])->second, lod, recorder.depthBits(center)));
+                command.model = node.model;
+                command.firstMesh = node.firstMesh;
+                command.meshCount = node.meshCount;
+                command.lod = lod;
+                command.transform = node.world;
+            }
+        });
+    }
+
+    void clear()
+    {
+        nodes.clear();
+        rangeIds.clear();
+        dirtyNodes.clear();
+        bvh.clear();
+        freeList = -1;
+        changedSinceBuild = 0;
+    }
+
+private:
+    struct Batch {
+        Model* model;
+        unsigned int firstMesh;
+        unsigned int meshCount;
+        std::vector<glm::mat4> transforms[MAX_MESH_LODS];
+    };
+
+    std::vector<SceneNode> nodes;
+    std::vector<int> dirtyNodes;
+    BVH bvh;
+    int freeList;               // through SceneNode::parent
+    size_t changedSinceBuild;   // leaves inserted, moved or removed since the BVH was last checked
+    // scratch, kept so the per frame calls do not allocate
+    std::vector<Batch> batches;
+    std::unordered_map<const Mesh*, size_t> batchIndex;
+    // the mesh range of every node with meshes, by its first mesh in the order first added, what
+    // ModelInstanceCommand keys group by. Only written by addModel, so the recording jobs can all read it
+    std::unordered_map<const Mesh*, unsigned int> rangeIds;
+    mutable std::vector<std::pair<float, int> > nearestScratch;
+
+    int allocate()
+    {
+        int index;
+        if (freeList >= 0)
+        {
+            index = freeList;
+            freeList = nodes[index].parent;
+        }
+        else
+        {
+            index = static_cast<int>(nodes.size());
+            nodes.push_back(SceneNode());
+        }
+        nodes[index].used = true;
+        nodes[index].children.clear();
+        return index;
+    }
+
+    void markDirty(int index)
+    {
+        if (nodes[index].dirty)
+            return;
+        nodes[index].dirty = true;
+        dirtyNodes.push_back(index);
+    }
+
+    bool dirtyAncestor(int index) const
+    {
+        for (int p = nodes[index].parent; p >= 0; p = nodes[p].parent)
+            if (nodes[p].dirty)
+                return true;
+        return false;
+    }
+
+    void attach(int index, Model& model, unsigned int firstMesh, unsigned int meshCount)
+    {
+        SceneNode& node = nodes[index];
+        node.model = &model;
+        node.firstMesh = firstMesh;
+        node.meshCount = meshCount;
+        if (meshCount == 0)
+            return;
+        if (rangeIds.find(&model.meshes[firstMesh]) == rangeIds.end())
+        {
+            unsigned int id = static_cast<unsigned int>(rangeIds.size());
+            rangeIds[&model.meshes[firstMesh]] = id;
+        }
+        node.boundsMin = model.meshes[firstMesh].boundsMin;
+        node.boundsMax = model.meshes[firstMesh].boundsMax;
+        for (unsigned int m = firstMesh; m < firstMesh + meshCount; m++)
+        {
+            node.boundsMin = glm::min(node.boundsMin, model.meshes[m].boundsMin);
+            node.boundsMax = glm::max(node.boundsMax, model.meshes[m].boundsMax);
+        }
+    }
+
+    void updateSubtree(int root)
+    {
+        std::vector<int>& stack = subtreeScratch;
+        stack.assign(1, root);
+        while (!stack.empty())
+        {
+            int index = stack.back();
+            stack.pop_back();
+            SceneNode& node = nodes[index];
+            node.world = node.parent >= 0 ? nodes[node.parent].world * node.local : node.local;
+            node.dirty = false;
+            if (node.meshCount > 0)
+            {
+                glm::vec3 center, extent;
+                transformBounds(node.world, node.boundsMin, node.boundsMax, center, extent);
+                if (node.proxy == BVH::NONE)
+                    node.proxy = bvh.insert(center - extent, center + extent, index);
+                else
+                    bvh.update(node.proxy, center - extent, center + extent);
+                changedSinceBuild++;
+            }
+            stack.insert(stack.end(), node.children.begin(), node.children.end());
+        }
+    }
+    std::vector<int> subtreeScratch;
+
+    // a node's meshes share one level, so it is chosen by the largest error any of them has at it
+    static unsigned int selectLod(SceneNode& node, const LodSelector& selector)
+    {
+        float errors[MAX_MESH_LODS] = {};
+        unsigned int count = 1;
+        for (unsigned int m = node.firstMesh; m < node.firstMesh + node.meshCount; m++)
+        {
+            const Mesh& mesh = node.model->meshes[m];
+            count = std::max(count, mesh.LodCount());
+            for (unsigned int l = 0; l < mesh.lods.size(); l++)
+                errors[l] = std::max(errors[l], mesh.lods[l].error);
+        }
+        if (count == 1)
+            return 0;
+        for (unsigned int l = 1; l < count; l++)
+            errors[l] = std::max(errors[l], errors[l - 1]);
+
+        // world space: the largest axis scale, and the distance to the nearest point of the bounds sphere
+        glm::vec3 center = glm::vec3(node.world * glm::vec4((node.boundsMin + node.boundsMax) * 0.5f, 1.0f));
+        float scale = std::sqrt(std::max(glm::dot(glm::vec3(node.world[0]), glm::vec3(node.world[0])),
+                                std::max(glm::dot(glm::vec3(node.world[1]), glm::vec3(node.world[1])), glm::dot(glm::vec3(node.world[2]), glm::vec3(node.world[2])))));
+        float radius = glm::length(node.boundsMax - node.boundsMin) * 0.5f * scale;
+        for (unsigned int l = 0; l < count; l++)
+            errors[l] *= scale;
+        node.lod = selector.select(errors, count, glm::length(center - selector.eye) - radius, node.lod);
+        return node.lod;
+    }
+
+    // ray against the node in its object space, where t along the transformed direction is the
+    // same t as along the world ray
+    static float pickNode(const SceneNode& node, const glm::vec3& origin, const glm::vec3& direction, float maxDistance)
+    {
+        glm::mat4 inverse = glm::inverse(node.world);
+        glm::vec3 localOrigin = glm::vec3(inverse * glm::vec4(origin, 1.0f));
+        glm::vec3 localDirection = glm::vec3(inverse * glm::vec4(direction, 0.0f));
+        float best = -1.0f;
+        for (unsigned int m = node.firstMesh; m < node.firstMesh + node.meshCount; m++)
+        {
+            const Mesh& mesh = node.model->meshes[m];
+            float t = mesh.vertices.empty() || mesh.indices.empty()
+                ? rayBox(localOrigin, localDirection, mesh.boundsMin, mesh.boundsMax, maxDistance)
+                : rayTriangles(localOrigin, localDirection, mesh, maxDistance);
+            if (t >= 0.0f && (best < 0.0f || t < best))
+            {
+                best = t;
+                maxDistance = t;
+            }
+        }
+        return best;
+    }
+
+    static float rayBox(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& boundsMin, const glm::vec3& boundsMax, float maxDistance)
+    {
+        float tmin = 0.0f, tmax = maxDistance;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float inverse = 1.0f / direction[axis];
+            float t1 = (boundsMin[axis] - origin[axis]) * inverse;
+            float t2 = (boundsMax[axis] - origin[axis]) * inverse;
+            tmin = std::max(tmin, std::min(t1, t2));
+            tmax = std::min(tmax, std::max(t1, t2));
+        }
+        return tmin <= tmax ? tmin : -1.0f;
+    }
+
+    // Moller-Trumbore over every triangle, the nearest t in [0, maxDistance] or -1
+    static float rayTriangles(const glm::vec3& origin, const glm::vec3& direction, const Mesh& mesh, float maxDistance)
+    {
+        if (rayBox(origin, direction, mesh.boundsMin, mesh.boundsMax, maxDistance) < 0.0f)
+            return -1.0f;
+        float best = -1.0f;
+        // level 0 only, the coarser levels follow it in the same list
+        size_t count = mesh.lods.empty() ? mesh.indices.size() : std::min<size_t>(mesh.lods[0].indexCount, mesh.indices.size());
+        for (size_t i = 0; i + 2 < count; i += 3)
+        {
+            const glm::vec3& a = mesh.vertices[mesh.indices[i]].Position;
+            glm::vec3 e1 = mesh.vertices[mesh.indices[i + 1]].Position - a;
+            glm::vec3 e2 = mesh.vertices[mesh.indices[i + 2]].Position - a;
+            glm::vec3 p = glm::cross(direction, e2);
+            float determinant = glm::dot(e1, p);
+            if (std::fabs(determinant) < 1e-12f)
+                continue;
+            float inverse = 1.0f / determinant;
+            glm::vec3 s = origin - a;
+            float u = glm::dot(s, p) * inverse;
+            if (u < 0.0f || u > 1.0f)
+                continue;
+            glm::vec3 q = glm::cross(s, e1);
+            float v = glm::dot(direction, q) * inverse;
+            if (v < 0.0f || u + v > 1.0f)
+                continue;
+            float t = glm::dot(e2, q) * inverse;
+            if (t >= 0.0f && t <= maxDistance)
+            {
+                best = t;
+                maxDistance = t;
+            }
+        }
+        return best;
+    }
+};
+
+#endif
@@ -1,3 +1,17 @@
-version https://git-lfs.github.com/spec/v1
-oid sha256:8015ec25399044a8220ef666ad142dd107c62c78f1eb214ffdd24b65fd58c3e8
-size 211
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 7) in mat4 aInstanceModel;
+
+// must come out bit-identical in depth_instanced.vs for the GL_EQUAL pass after the depth pre-pass
+invariant gl_Position;
+
+#include <FrameData>
+
+// dequantization of VERTEX_QUANTIZED positions, set by Mesh around its draws; identity for everything else
+uniform vec3 positionScale = vec3(1.0);
+uniform vec3 positionBias = vec3(0.0);
+
+void main()
+{
+    gl_Position = projection * view * aInstanceModel * vec4(aPos * positionScale + positionBias, 1.0);
+}
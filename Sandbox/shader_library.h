@@ -0,0 +1,355 @@
+#ifndef SHADER_LIBRARY_H
+#define SHADER_LIBRARY_H
+
+#include <glad/glad.h>
+
+#include </OpenGl programming/Sandbox/gl_state_cache.h>
+#include </OpenGl programming/Sandbox/shader_s.h>
+
+#include <sys/stat.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Owns the application's Shader objects and rebuilds them when their source files change on disk.
+// A background thread polls the files; update() (called between frames on the context thread) starts
+// a deferred build of the changed program and, once the driver reports it done, swaps it into the
+// existing Shader so every Shader& and DrawItem pointer stays valid. A build that fails to compile or
+// link is thrown away and the old program keeps drawing. Default block uniform values are copied over
+// to the new program and uniform blocks are rebound when it links; uniform locations can move, so
+// anything caching a UniformHandle re-resolves it in an onProgramChange callback.
+class ShaderLibrary
+{
+public:
+    ShaderLibrary() : stopping(false)
+    {
+    }
+    ~ShaderLibrary()
+    {
+        stopWatching();
+    }
+
+    // the returned reference stays valid for the lifetime of the library, across reloads
+    Shader& load(const std::string& name, const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr,
+                 ShaderBuild build = SHADER_BUILD_DEFERRED)
+    {
+        std::unique_ptr<Entry> entry(new Entry());
+        entry->name = name;
+        entry->paths.push_back(vertexPath);
+        entry->paths.push_back(fragmentPath);
+        if (geometryPath)
+            entry->paths.push_back(geometryPath);
+        entry->shader.reset(new Shader(vertexPath, fragmentPath, geometryPath, build));
+        return add(std::move(entry));
+    }
+
+    // a compute program, watched and reloaded like the others
+    Shader& loadCompute(const std::string& name, const char* computePath, ShaderBuild build = SHADER_BUILD_DEFERRED)
+    {
+        std::unique_ptr<Entry> entry(new Entry());
+        entry->name = name;
+        entry->paths.push_back(computePath);
+        entry->shader.reset(new Shader(computePath, build));
+        return add(std::move(entry));
+    }
+
+    Shader* find(const std::string& name)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unordered_map<std::string, size_t>::iterator it = index.find(name);
+        return it == index.end() ? NULL : entries[it->second]->shader.get();
+    }
+
+    // run now and again after every successful reload of the program, e.g. to resolve UniformHandles
+    void onProgramChange(const std::string& name, const std::function<void(Shader&)>& callback)
+    {
+        Entry* entry = NULL;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::unordered_map<std::string, size_t>::iterator it = index.find(name);
+            if (it != index.end())
+                entry = entries[it->second].get();
+        }
+        if (!entry)
+        {
+            std::cout << "ShaderLibrary: no shader named " << name << std::endl;
+            return;
+        }
+        entry->programChanged.push_back(callback);
+        callback(*entry->shader);
+    }
+
+    // start polling the source files every intervalMs on a background thread
+    void watch(unsigned int intervalMs = 250)
+    {
+        if (watcher.joinable())
+            return;
+        stopping = false;
+        watcher = std::thread(&ShaderLibrary::poll, this, intervalMs);
+    }
+
+    void stopWatching()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        if (watcher.joinable())
+            watcher.join();
+    }
+
+    // call once per frame on the context thread, before any of the programs is used
+    void update()
+    {
+        std::vector<Entry*> current;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (size_t i = 0; i < entries.size(); i++)
+                current.push_back(entries[i].get());
+        }
+        for (size_t i = 0; i < current.size(); i++)
+        {
+            Entry& entry = *current[i];
+            if (entry.candidate)
+            {
+                // poll, never block the frame on the driver's compiler threads
+                if (entry.candidate->isReady())
+                    finishReload(entry);
+            }
+            else if (entry.changed.exchange(false))
+            {
+                if (entry.paths.size() == 1)
+                    entry.candidate.reset(new Shader(entry.paths[0].c_str(), SHADER_BUILD_DEFERRED));
+                else
+                {
+                    const char* geometryPath = entry.paths.size() > 2 ? entry.paths[2].c_str() : nullptr;
+                    entry.candidate.reset(new Shader(entry.paths[0].c_str(), entry.paths[1].c_str(), geometryPath, SHADER_BUILD_DEFERRED));
+                }
+            }
+        }
+    }
+
+    // delete every program, call before the context goes away
+    void clear()
+    {
+        stopWatching();
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < entries.size(); i++)
+            destroy(*entries[i]);
+        entries.clear();
+        index.clear();
+    }
+
+private:
+    // modification time and size; either changing means the file was written
+    struct FileStamp {
+        int64_t mtime;
+        int64_t size;
+        bool operator==(const FileStamp& other) const { return mtime == other.mtime && size == other.size; }
+        bool operator!=(const FileStamp& other) const { return !(*this == other); }
+    };
+
+    struct Entry {
+        std::string name;
+        std::vector<std::string> paths;
+        std::vector<FileStamp> stamps;  // last stamps the watcher saw, only touched by the watcher after load
+        bool settling;                  // a stamp moved on the last poll, wait one more for the editor to finish writing
+        std::atomic<bool> changed;
+        std::unique_ptr<Shader> shader;
+        std::unique_ptr<Shader> candidate;
+        std::vector<std::function<void(Shader&)> > programChanged;
+    };
+
+    std::vector<std::unique_ptr<Entry> > entries;
+    std::unordered_map<std::string, size_t> index;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::thread watcher;
+    bool stopping;
+
+    // take the files' current stamps and register the entry under its name
+    Shader& add(std::unique_ptr<Entry> entry)
+    {
+        for (size_t i = 0; i < entry->paths.size(); i++)
+            entry->stamps.push_back(fileStamp(entry->paths[i]));
+        entry->settling = false;
+        entry->changed = false;
+
+        Shader& shader = *entry->shader;
+        const std::string name = entry->name;
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unordered_map<std::string, size_t>::iterator it = index.find(name);
+        if (it != index.end())
+        {
+            // a second load under the same name replaces the first, whose Shader& now dangles
+            std::cout << "ShaderLibrary: " << name << " loaded twice, replacing it" << std::endl;
+            destroy(*entries[it->second]);
+            entries[it->second].swap(entry);
+        }
+        else
+        {
+            index[name] = entries.size();
+            entries.push_back(std::move(entry));
+        }
+        return shader;
+    }
+
+    static FileStamp fileStamp(const std::string& path)
+    {
+        FileStamp stamp = { -1, -1 };
+        struct stat info;
+        if (stat(path.c_str(), &info) == 0)
+        {
+            stamp.mtime = static_cast<int64_t>(info.st_mtime);
+            stamp.size = static_cast<int64_t>(info.st_size);
+        }
+        return stamp;
+    }
+
+    void poll(unsigned int intervalMs)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!wake.wait_for(lock, std::chrono::milliseconds(intervalMs), [this] { return stopping; }))
+        {
+            for (size_t i = 0; i < entries.size(); i++)
+            {
+                Entry& entry = *entries[i];
+                bool moved = false;
+                for (size_t f = 0; f < entry.paths.size(); f++)
+                {
+                    FileStamp stamp = fileStamp(entry.paths[f]);
+                    if (stamp != entry.stamps[f])
+                    {
+                        entry.stamps[f] = stamp;
+                        moved = true;
+                    }
+                }
+                if (moved)
+                    entry.settling = true;
+                else if (entry.settling)
+                {
+                    entry.settling = false;
+                    entry.changed = true;
+                }
+            }
+        }
+    }
+
+    void finishReload(Entry& entry)
+    {
+        std::unique_ptr<Shader> candidate;
+        candidate.swap(entry.candidate);
+        candidate->finishBuild();
+
+        GLint linked = GL_FALSE;
+        glGetProgramiv(candidate->ID, GL_LINK_STATUS, &linked);
+        if (!linked)
+        {
+            std::cout << "ShaderLibrary: " << entry.name << " failed to build, keeping the previous program" << std::endl;
+            deleteProgram(candidate->ID);
+            return;
+        }
+
+        copyUniforms(entry.shader->ID, candidate->ID);
+        entry.shader->swapProgram(*candidate);
+        deleteProgram(candidate->ID);
+        std::cout << "ShaderLibrary: reloaded " << entry.name << std::endl;
+        for (size_t i = 0; i < entry.programChanged.size(); i++)
+            entry.programChanged[i](*entry.shader);
+    }
+
+    // carry every default block uniform both programs declare over from the old to the new one
+    static void copyUniforms(GLuint from, GLuint to)
+    {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(from, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(from, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> name(maxLength > 0 ? maxLength : 1);
+        glState().useProgram(to);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(from, (GLuint)i, maxLength, &length, &size, &type, name.data());
+            std::string base(name.data(), length);
+            if (base.size() > 3 && base.compare(base.size() - 3, 3, "[0]") == 0)
+                base.resize(base.size() - 3);
+            for (GLint e = 0; e < size; e++)
+            {
+                std::string element = size > 1 ? base + "[" + std::to_string(e) + "]" : base;
+                GLint source = glGetUniformLocation(from, element.c_str());
+                GLint target = glGetUniformLocation(to, element.c_str());
+                if (source >= 0 && target >= 0)
+                    copyUniform(from, source, target, type);
+            }
+        }
+    }
+
+    static void copyUniform(GLuint from, GLint source, GLint target, GLenum type)
+    {
+        GLfloat f[16];
+        GLint n[4];
+        GLuint u[4];
+        switch (type)
+        {
+        case GL_FLOAT:             glGetUniformfv(from, source, f); glUniform1fv(target, 1, f); break;
+        case GL_FLOAT_VEC2:        glGetUniformfv(from, source, f); glUniform2fv(target, 1, f); break;
+        case GL_FLOAT_VEC3:        glGetUniformfv(from, source, f); glUniform3fv(target, 1, f); break;
+        case GL_FLOAT_VEC4:        glGetUniformfv(from, source, f); glUniform4fv(target, 1, f); break;
+        case GL_FLOAT_MAT2:        glGetUniformfv(from, source, f); glUniformMatrix2fv(target, 1, GL_FALSE, f); break;
+        case GL_FLOAT_MAT3:        glGetUniformfv(from, source, f); glUniformMatrix3fv(target, 1, GL_FALSE, f); break;
+        case GL_FLOAT_MAT4:        glGetUniformfv(from, source, f); glUniformMatrix4fv(target, 1, GL_FALSE, f); break;
+        case GL_INT_VEC2:
+        case GL_BOOL_VEC2:         glGetUniformiv(from, source, n); glUniform2iv(target, 1, n); break;
+        case GL_INT_VEC3:
+        case GL_BOOL_VEC3:         glGetUniformiv(from, source, n); glUniform3iv(target, 1, n); break;
+        case GL_INT_VEC4:
+        case GL_BOOL_VEC4:         glGetUniformiv(from, source, n); glUniform4iv(target, 1, n); break;
+        case GL_UNSIGNED_INT:      glGetUniformuiv(from, source, u); glUniform1uiv(target, 1, u); break;
+        case GL_UNSIGNED_INT_VEC2: glGetUniformuiv(from, source, u); glUniform2uiv(target, 1, u); break;
+        case GL_UNSIGNED_INT_VEC3: glGetUniformuiv(from, source, u); glUniform3uiv(target, 1, u); break;
+        case GL_UNSIGNED_INT_VEC4: glGetUniformuiv(from, source, u); glUniform4uiv(target, 1, u); break;
+        case GL_INT:
+        case GL_BOOL:
+        case GL_SAMPLER_2D:
+        case GL_SAMPLER_3D:
+        case GL_SAMPLER_CUBE:
+        case GL_SAMPLER_2D_SHADOW:
+        case GL_SAMPLER_2D_ARRAY:
+        case GL_SAMPLER_2D_MULTISAMPLE:
+            glGetUniformiv(from, source, n);
+            glUniform1iv(target, 1, n);
+            break;
+        default:
+            break; // non-square matrices and the rarer sampler types are left at their defaults
+        }
+    }
+
+    static void deleteProgram(GLuint program)
+    {
+        glDeleteProgram(program);
+        glState().forgetProgram(program);
+    }
+
+    void destroy(Entry& entry)
+    {
+        if (entry.candidate)
+            deleteProgram(entry.candidate->ID);
+        entry.candidate.reset();
+        deleteProgram(entry.shader->ID);
+    }
+};
+
+#endif
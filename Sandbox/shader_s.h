@@ -4,10 +4,156 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include </OpenGl programming/Sandbox/gl_state_cache.h>
+#include </OpenGl programming/Sandbox/gl_extensions.h>
+#include </OpenGl programming/Sandbox/uniform_buffer.h>
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
 #include <string>
+#include <vector>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <memory>
+#include <utility>
+#include <cstdio>
+#include <cstdint>
+
+// a uniform location resolved once up front; setting through a handle does no string work at all
+struct UniformHandle
+{
+    GLint location = -1;
+    bool valid() const { return location >= 0; }
+};
+
+// flat open-addressing hash table from uniform name to location, filled once at link time
+class UniformTable
+{
+public:
+    void clear()
+    {
+        slots.clear();
+        count = 0;
+    }
+
+    void insert(const char* name, GLint location)
+    {
+        if ((count + 1) * 2 > slots.size())
+            grow();
+        put(name, hashName(name), location);
+    }
+
+    // returns -1 for unknown names, which glUniform* silently ignores (same as glGetUniformLocation)
+    GLint find(const char* name) const
+    {
+        if (slots.empty())
+            return -1;
+        uint32_t hash = hashName(name);
+        size_t mask = slots.size() - 1;
+        for (size_t i = hash & mask; ; i = (i + 1) & mask)
+        {
+            const Slot& slot = slots[i];
+            if (slot.location == EMPTY)
+                return -1;
+            if (slot.hash == hash && slot.name == name)
+                return slot.location;
+        }
+    }
+
+private:
+    static const GLint EMPTY = -2;
+    struct Slot
+    {
+        uint32_t hash = 0;
+        GLint location = EMPTY;
+        std::string name;
+    };
+    std::vector<Slot> slots;
+    size_t count = 0;
+
+    // FNV-1a
+    static uint32_t hashName(const char* name)
+    {
+        uint32_t hash = 2166136261u;
+        for (; *name; ++name)
+            hash = (hash ^ (unsigned char)*name) * 16777619u;
+        return hash;
+    }
+
+    void put(const char* name, uint32_t hash, GLint location)
+    {
+        size_t mask = slots.size() - 1;
+        for (size_t i = hash & mask; ; i = (i + 1) & mask)
+        {
+            Slot& slot = slots[i];
+            if (slot.location == EMPTY)
+            {
+                slot.hash = hash;
+                slot.location = location;
+                slot.name = name;
+                count++;
+                return;
+            }
+            if (slot.hash == hash && slot.name == name)
+            {
+                slot.location = location;
+                return;
+            }
+        }
+    }
+
+    void grow()
+    {
+        std::vector<Slot> old;
+        old.swap(slots);
+        slots.resize(old.empty() ? 16 : old.size() * 2);
+        count = 0;
+        for (size_t i = 0; i < old.size(); i++)
+            if (old[i].location != EMPTY)
+                put(old[i].name.c_str(), old[i].hash, old[i].location);
+    }
+};
+
+// fixed binding points of the uniform blocks shared by all programs
+enum UniformBlockBinding {
+    FRAME_DATA_BINDING = 0
+};
+
+// fixed binding points of the shader storage buffers, declared with layout (binding = N) in the shaders.
+// Only 8 are guaranteed, so passes that never run at the same time share them; each pass binds its own
+// buffers right before it dispatches or draws.
+enum ShaderStorageBinding {
+    LIGHT_BINDING = 0,
+    CLUSTER_BOUNDS_BINDING = 1,
+    CLUSTER_LIGHT_COUNT_BINDING = 2,
+    CLUSTER_LIGHT_INDEX_BINDING = 3,
+    BIND_POSE_BINDING = 4,     // a mesh's own vertex buffer, read by skinning.comp
+    SKINNED_VERTEX_BINDING = 5,
+    BONE_PALETTE_BINDING = 6,
+    CLOTH_SOURCE_BINDING = 0,  // GpuCloth's particles, read from one buffer and written to the other
+    CLOTH_TARGET_BINDING = 1,
+    PARTICLE_BINDING = 0,
+    PARTICLE_ALIVE_BINDING = 1,
+    PARTICLE_DRAW_BINDING = 2  // the indirect draw command, whose instance count the update appends to
+};
+
+// SHADER_BUILD_DEFERRED only issues the compile and link; the program is finished (and any errors
+// printed) on its first use, so the driver can build several programs at once in between
+enum ShaderBuild {
+    SHADER_BUILD_NOW,
+    SHADER_BUILD_DEFERRED
+};
+
+// where linked program binaries are kept, keyed by the sources and the driver; empty disables the cache
+inline std::string& shaderBinaryCacheDirectory()
+{
+    static std::string directory = "shadercache";
+    return directory;
+}
 
 class Shader
 {
@@ -15,7 +161,7 @@ public:
     unsigned int ID;
     // constructor generates the shader on the fly
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, ShaderBuild build = SHADER_BUILD_NOW)
     {
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
@@ -41,8 +187,8 @@ public:
             vShaderFile.close();
             fShaderFile.close();
             // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
+            vertexCode = expandIncludes(vShaderStream.str(), vertexPath);
+            fragmentCode = expandIncludes(fShaderStream.str(), fragmentPath);
             // if geometry shader path is present, also load a geometry shader
             if (geometryPath != nullptr)
             {
@@ -50,118 +196,510 @@ public:
                 std::stringstream gShaderStream;
                 gShaderStream << gShaderFile.rdbuf();
                 gShaderFile.close();
-                geometryCode = gShaderStream.str();
+                geometryCode = expandIncludes(gShaderStream.str(), geometryPath);
             }
         }
         catch (std::ifstream::failure& e)
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
         }
-        const char* vShaderCode = vertexCode.c_str();
-        const char* fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        // if geometry shader is given, compile geometry shader
-        unsigned int geometry;
-        if (geometryPath != nullptr)
-        {
-            const char* gShaderCode = geometryCode.c_str();
-            geometry = glCreateShader(GL_GEOMETRY_SHADER);
-            glShaderSource(geometry, 1, &gShaderCode, NULL);
-            glCompileShader(geometry);
-            checkCompileErrors(geometry, "GEOMETRY");
-        }
-        // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        if (geometryPath != nullptr)
-            glAttachShader(ID, geometry);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessary
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-        if (geometryPath != nullptr)
-            glDeleteShader(geometry);
+        pending = std::make_shared<PendingBuild>();
+        pending->vertexCode.swap(vertexCode);
+        pending->fragmentCode.swap(fragmentCode);
+        pending->geometryCode.swap(geometryCode);
+        pending->hasGeometry = geometryPath != nullptr;
 
+        // 2. start building the program, from the binary cache when it has a match
+        startBuild(build);
+    }
+    // a compute program from a single source file, only available when glCaps().computeShaders is set
+    // ------------------------------------------------------------------------
+    explicit Shader(const char* computePath, ShaderBuild build = SHADER_BUILD_NOW)
+    {
+        std::string computeCode;
+        std::ifstream cShaderFile;
+        cShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+        try
+        {
+            cShaderFile.open(computePath);
+            std::stringstream cShaderStream;
+            cShaderStream << cShaderFile.rdbuf();
+            cShaderFile.close();
+            computeCode = expandIncludes(cShaderStream.str(), computePath);
+        }
+        catch (std::ifstream::failure& e)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+        }
+        pending = std::make_shared<PendingBuild>();
+        pending->computeCode.swap(computeCode);
+        pending->hasCompute = true;
+        startBuild(build);
+    }
+    // false while a deferred build is still running on the driver's compiler threads; without
+    // KHR_parallel_shader_compile there is no way to ask, so it is always true
+    // ------------------------------------------------------------------------
+    bool isReady() const
+    {
+        if (!pending || !glCaps().parallelShaderCompile)
+            return true;
+        GLint done = GL_FALSE;
+        glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &done);
+        return done == GL_TRUE;
+    }
+    // wait for the program, check for errors and reflect its uniforms; no-op once built
+    // ------------------------------------------------------------------------
+    void finishBuild()
+    {
+        if (!pending)
+            return;
+        std::shared_ptr<PendingBuild> build = pending;
+        pending.reset();
+
+        if (build->fromBinary)
+        {
+            GLint linked = GL_FALSE;
+            glGetProgramiv(ID, GL_LINK_STATUS, &linked);
+            if (!linked)
+            {
+                // binaries are dropped by driver updates the key did not catch, rebuild and overwrite it
+                std::cout << "SHADER::PROGRAM_BINARY_REJECTED " << build->cacheFile << ", compiling from source" << std::endl;
+                compileFromSource(*build);
+            }
+        }
+        if (!build->fromBinary)
+        {
+            if (build->hasCompute)
+                checkCompileErrors(build->compute, "COMPUTE");
+            else
+            {
+                checkCompileErrors(build->vertex, "VERTEX");
+                checkCompileErrors(build->fragment, "FRAGMENT");
+            }
+            if (build->hasGeometry)
+                checkCompileErrors(build->geometry, "GEOMETRY");
+            checkCompileErrors(ID, "PROGRAM");
+            // delete the shaders as they're linked into our program now and no longer necessary
+            if (build->hasCompute)
+                glDeleteShader(build->compute);
+            else
+            {
+                glDeleteShader(build->vertex);
+                glDeleteShader(build->fragment);
+            }
+            if (build->hasGeometry)
+                glDeleteShader(build->geometry);
+            if (!build->cacheFile.empty())
+                saveProgramBinary(build->cacheFile);
+        }
+        reflectUniforms();
+        bindUniformBlock("FrameData", FRAME_DATA_BINDING);
+    }
+    // exchange programs with another shader, used to put a rebuilt program in place of a live one
+    // ------------------------------------------------------------------------
+    void swapProgram(Shader& other)
+    {
+        std::swap(ID, other.ID);
+        std::swap(uniforms, other.uniforms);
+        pending.swap(other.pending);
     }
     // activate the shader
     // ------------------------------------------------------------------------
     void use()
     {
-        glUseProgram(ID);
+        if (pending)
+            finishBuild();
+        glState().useProgram(ID);
+    }
+    // attach a uniform block to a binding point, if this program declares it
+    // ------------------------------------------------------------------------
+    bool bindUniformBlock(const char* blockName, unsigned int binding)
+    {
+        if (pending)
+            finishBuild();
+        GLuint index = glGetUniformBlockIndex(ID, blockName);
+        if (index == GL_INVALID_INDEX)
+            return false;
+        glUniformBlockBinding(ID, index, binding);
+        return true;
+    }
+    // resolve a uniform once (e.g. before the render loop) and set it through the handle every frame
+    // ------------------------------------------------------------------------
+    UniformHandle getUniform(const char* name)
+    {
+        if (pending)
+            finishBuild();
+        UniformHandle handle;
+        handle.location = uniforms.find(name);
+        return handle;
+    }
+    UniformHandle getUniform(const std::string& name)
+    {
+        return getUniform(name.c_str());
     }
     // utility uniform functions
     // ------------------------------------------------------------------------
+    void setBool(const char* name, bool value) const
+    {
+        glUniform1i(uniforms.find(name), (int)value);
+    }
     void setBool(const std::string& name, bool value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        setBool(name.c_str(), value);
+    }
+    void setBool(UniformHandle handle, bool value) const
+    {
+        glUniform1i(handle.location, (int)value);
     }
     // ------------------------------------------------------------------------
+    void setInt(const char* name, int value) const
+    {
+        glUniform1i(uniforms.find(name), value);
+    }
     void setInt(const std::string& name, int value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        setInt(name.c_str(), value);
+    }
+    void setInt(UniformHandle handle, int value) const
+    {
+        glUniform1i(handle.location, value);
     }
     // ------------------------------------------------------------------------
+    void setFloat(const char* name, float value) const
+    {
+        glUniform1f(uniforms.find(name), value);
+    }
     void setFloat(const std::string& name, float value) const
     {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        setFloat(name.c_str(), value);
+    }
+    void setFloat(UniformHandle handle, float value) const
+    {
+        glUniform1f(handle.location, value);
     }
     // ------------------------------------------------------------------------
+    void setVec2(const char* name, const glm::vec2& value) const
+    {
+        glUniform2fv(uniforms.find(name), 1, &value[0]);
+    }
     void setVec2(const std::string& name, const glm::vec2& value) const
     {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        setVec2(name.c_str(), value);
+    }
+    void setVec2(UniformHandle handle, const glm::vec2& value) const
+    {
+        glUniform2fv(handle.location, 1, &value[0]);
+    }
+    void setVec2(const char* name, float x, float y) const
+    {
+        glUniform2f(uniforms.find(name), x, y);
     }
     void setVec2(const std::string& name, float x, float y) const
     {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        setVec2(name.c_str(), x, y);
     }
     // ------------------------------------------------------------------------
+    void setVec3(const char* name, const glm::vec3& value) const
+    {
+        glUniform3fv(uniforms.find(name), 1, &value[0]);
+    }
     void setVec3(const std::string& name, const glm::vec3& value) const
     {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        setVec3(name.c_str(), value);
+    }
+    void setVec3(UniformHandle handle, const glm::vec3& value) const
+    {
+        glUniform3fv(handle.location, 1, &value[0]);
+    }
+    void setVec3(const char* name, float x, float y, float z) const
+    {
+        glUniform3f(uniforms.find(name), x, y, z);
     }
     void setVec3(const std::string& name, float x, float y, float z) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        setVec3(name.c_str(), x, y, z);
     }
     // ------------------------------------------------------------------------
+    void setVec4(const char* name, const glm::vec4& value) const
+    {
+        glUniform4fv(uniforms.find(name), 1, &value[0]);
+    }
     void setVec4(const std::string& name, const glm::vec4& value) const
     {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        setVec4(name.c_str(), value);
     }
-    void setVec4(const std::string& name, float x, float y, float z, float w)
+    void setVec4(UniformHandle handle, const glm::vec4& value) const
     {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        glUniform4fv(handle.location, 1, &value[0]);
+    }
+    void setVec4(const char* name, float x, float y, float z, float w) const
+    {
+        glUniform4f(uniforms.find(name), x, y, z, w);
+    }
+    void setVec4(const std::string& name, float x, float y, float z, float w) const
+    {
+        setVec4(name.c_str(), x, y, z, w);
     }
     // ------------------------------------------------------------------------
+    void setMat2(const char* name, const glm::mat2& mat) const
+    {
+        glUniformMatrix2fv(uniforms.find(name), 1, GL_FALSE, &mat[0][0]);
+    }
     void setMat2(const std::string& name, const glm::mat2& mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat2(name.c_str(), mat);
+    }
+    void setMat2(UniformHandle handle, const glm::mat2& mat) const
+    {
+        glUniformMatrix2fv(handle.location, 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
+    void setMat3(const char* name, const glm::mat3& mat) const
+    {
+        glUniformMatrix3fv(uniforms.find(name), 1, GL_FALSE, &mat[0][0]);
+    }
     void setMat3(const std::string& name, const glm::mat3& mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat3(name.c_str(), mat);
+    }
+    void setMat3(UniformHandle handle, const glm::mat3& mat) const
+    {
+        glUniformMatrix3fv(handle.location, 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
+    void setMat4(const char* name, const glm::mat4& mat) const
+    {
+        glUniformMatrix4fv(uniforms.find(name), 1, GL_FALSE, &mat[0][0]);
+    }
     void setMat4(const std::string& name, const glm::mat4& mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat4(name.c_str(), mat);
+    }
+    void setMat4(UniformHandle handle, const glm::mat4& mat) const
+    {
+        glUniformMatrix4fv(handle.location, 1, GL_FALSE, &mat[0][0]);
     }
 
 private:
+    UniformTable uniforms;
+
+    // sources and shader objects of a build that has been started but not checked yet
+    struct PendingBuild
+    {
+        std::string vertexCode;
+        std::string fragmentCode;
+        std::string geometryCode;
+        std::string computeCode;
+        bool hasGeometry = false;
+        bool hasCompute = false;
+        GLuint vertex = 0, fragment = 0, geometry = 0, compute = 0;
+        std::string cacheFile;
+        bool fromBinary = false;
+    };
+    std::shared_ptr<PendingBuild> pending;
+
+    struct ProgramBinaryHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t format;
+        uint32_t length;
+    };
+    static const uint32_t PROGRAM_BINARY_MAGIC = 0x4E494250; // "PBIN"
+    static const uint32_t PROGRAM_BINARY_VERSION = 1;
+
+    // replace every "#include <Name>" line with the GLSL the engine keeps for Name, see frameDataBlock()
+    // ------------------------------------------------------------------------
+    static std::string expandIncludes(const std::string& code, const char* path)
+    {
+        std::string expanded;
+        expanded.reserve(code.size());
+        size_t start = 0;
+        while (start < code.size())
+        {
+            size_t end = code.find('\n', start);
+            end = end == std::string::npos ? code.size() : end + 1;
+            std::string line = code.substr(start, end - start);
+            start = end;
+            if (line.compare(0, 10, "#include <") != 0)
+            {
+                expanded += line;
+                continue;
+            }
+            std::string name = line.substr(10, line.find('>') == std::string::npos ? 0 : line.find('>') - 10);
+            if (name == "FrameData")
+                expanded += frameDataBlock();
+            else
+                std::cout << "ERROR::SHADER::UNKNOWN_INCLUDE <" << name << "> in " << path << std::endl;
+        }
+        return expanded;
+    }
+
+    // ------------------------------------------------------------------------
+    void startBuild(ShaderBuild build)
+    {
+        ID = glCreateProgram();
+        pending->cacheFile = programBinaryPath(*pending);
+        if (pending->cacheFile.empty() || !loadProgramBinary(pending->cacheFile))
+            compileFromSource(*pending);
+        if (build == SHADER_BUILD_NOW)
+            finishBuild();
+    }
+
+    // compile and link from source; with KHR_parallel_shader_compile none of these calls block
+    // ------------------------------------------------------------------------
+    void compileFromSource(PendingBuild& build)
+    {
+        build.fromBinary = false;
+        if (build.hasCompute)
+        {
+            const char* cShaderCode = build.computeCode.c_str();
+            build.compute = glCreateShader(GL_COMPUTE_SHADER);
+            glShaderSource(build.compute, 1, &cShaderCode, NULL);
+            glCompileShader(build.compute);
+            glAttachShader(ID, build.compute);
+            if (!build.cacheFile.empty())
+                glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+            glLinkProgram(ID);
+            return;
+        }
+        const char* vShaderCode = build.vertexCode.c_str();
+        const char* fShaderCode = build.fragmentCode.c_str();
+        build.vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(build.vertex, 1, &vShaderCode, NULL);
+        glCompileShader(build.vertex);
+        build.fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(build.fragment, 1, &fShaderCode, NULL);
+        glCompileShader(build.fragment);
+        if (build.hasGeometry)
+        {
+            const char* gShaderCode = build.geometryCode.c_str();
+            build.geometry = glCreateShader(GL_GEOMETRY_SHADER);
+            glShaderSource(build.geometry, 1, &gShaderCode, NULL);
+            glCompileShader(build.geometry);
+        }
+        glAttachShader(ID, build.vertex);
+        glAttachShader(ID, build.fragment);
+        if (build.hasGeometry)
+            glAttachShader(ID, build.geometry);
+        if (!build.cacheFile.empty())
+            glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(ID);
+    }
+
+    // cache file for these sources on this driver, empty when binaries are unsupported or disabled
+    // ------------------------------------------------------------------------
+    std::string programBinaryPath(const PendingBuild& build) const
+    {
+        if (!glCaps().programBinary || shaderBinaryCacheDirectory().empty())
+            return std::string();
+        // FNV-1a 64 over the driver strings and every stage, each terminated so "ab"+"c" != "a"+"bc"
+        uint64_t hash = 14695981039346656037ull;
+        const char* parts[] = {
+            (const char*)glGetString(GL_VENDOR), (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION),
+            build.vertexCode.c_str(), build.fragmentCode.c_str(), build.hasGeometry ? build.geometryCode.c_str() : "",
+            build.computeCode.c_str()
+        };
+        for (size_t i = 0; i < sizeof(parts) / sizeof(parts[0]); i++)
+        {
+            for (const char* c = parts[i] ? parts[i] : ""; *c; ++c)
+                hash = (hash ^ (unsigned char)*c) * 1099511628211ull;
+            hash = (hash ^ 0xFF) * 1099511628211ull;
+        }
+        char name[17];
+        std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash);
+        return shaderBinaryCacheDirectory() + "/" + name + ".bin";
+    }
+
+    // hand a cached binary to the driver; whether it was accepted is only known from the link status
+    // ------------------------------------------------------------------------
+    bool loadProgramBinary(const std::string& path)
+    {
+        FILE* file = std::fopen(path.c_str(), "rb");
+        if (!file)
+            return false;
+        ProgramBinaryHeader header;
+        std::vector<char> binary;
+        bool ok = std::fread(&header, sizeof(header), 1, file) == 1 && header.magic == PROGRAM_BINARY_MAGIC &&
+                  header.version == PROGRAM_BINARY_VERSION && header.length > 0;
+        if (ok)
+        {
+            binary.resize(header.length);
+            ok = std::fread(binary.data(), 1, binary.size(), file) == binary.size();
+        }
+        std::fclose(file);
+        if (!ok)
+            return false;
+        glProgramBinary(ID, header.format, binary.data(), (GLsizei)binary.size());
+        pending->fromBinary = true;
+        return true;
+    }
+
+    // ------------------------------------------------------------------------
+    void saveProgramBinary(const std::string& path)
+    {
+        GLint linked = GL_FALSE, length = 0;
+        glGetProgramiv(ID, GL_LINK_STATUS, &linked);
+        glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (!linked || length <= 0)
+            return;
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(ID, length, &length, &format, binary.data());
+
+#ifdef _WIN32
+        _mkdir(shaderBinaryCacheDirectory().c_str());
+#else
+        mkdir(shaderBinaryCacheDirectory().c_str(), 0755);
+#endif
+        ProgramBinaryHeader header = { PROGRAM_BINARY_MAGIC, PROGRAM_BINARY_VERSION, (uint32_t)format, (uint32_t)length };
+        FILE* file = std::fopen(path.c_str(), "wb");
+        bool written = file && std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+                       std::fwrite(binary.data(), 1, (size_t)length, file) == (size_t)length;
+        if (file)
+            written = std::fclose(file) == 0 && written;
+        if (!written)
+        {
+            std::cout << "SHADER::PROGRAM_BINARY_NOT_WRITTEN " << path << std::endl;
+            std::remove(path.c_str());
+        }
+    }
+
+    // reflect every active uniform once after linking so the setters never have to ask the driver again.
+    // arrays are registered both as "name" and as each "name[i]" element.
+    // ------------------------------------------------------------------------
+    void reflectUniforms()
+    {
+        uniforms.clear();
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> name(maxLength > 0 ? maxLength : 1);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, (GLuint)i, maxLength, &length, &size, &type, name.data());
+            GLint location = glGetUniformLocation(ID, name.data());
+            if (location < 0)
+                continue; // members of a uniform block have no location
+            uniforms.insert(name.data(), location);
+
+            std::string base(name.data(), length);
+            if (base.size() > 3 && base.compare(base.size() - 3, 3, "[0]") == 0)
+            {
+                base.resize(base.size() - 3);
+                uniforms.insert(base.c_str(), location);
+                for (GLint e = 1; e < size; e++)
+                {
+                    std::string element = base + "[" + std::to_string(e) + "]";
+                    uniforms.insert(element.c_str(), glGetUniformLocation(ID, element.c_str()));
+                }
+            }
+        }
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
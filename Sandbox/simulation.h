@@ -0,0 +1,294 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <glm/glm.hpp>
+
+#include </OpenGl programming/Sandbox/camera.h>
+#include </OpenGl programming/Sandbox/gpu_profiler.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+typedef std::chrono::steady_clock SimulationClock;
+
+// One writer and one reader passing whole values without ever waiting on each other: the writer fills
+// its back slot and swaps it with the middle one, the reader swaps the middle one with its front slot
+// when something new arrived there. Neither ever touches the slot the other one is working on.
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() : middle(1), back(0), front(2)
+    {
+    }
+
+    // writer: the slot to fill before publish()
+    T& write()
+    {
+        return slots[back];
+    }
+
+    void publish()
+    {
+        back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    // reader: take the latest published value, if there is one newer than read()
+    bool update()
+    {
+        if (!(middle.load(std::memory_order_acquire) & FRESH))
+            return false;
+        front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+
+    const T& read() const
+    {
+        return slots[front];
+    }
+
+private:
+    static const unsigned int INDEX = 3;
+    static const unsigned int FRESH = 4; // set on the middle slot by publish(), cleared by update()
+
+    T slots[3];
+    std::atomic<unsigned int> middle;
+    unsigned int back;   // the writer's
+    unsigned int front;  // the reader's
+};
+
+// the input the main thread polled, GLFW only answers there. Held keys are replaced by every submit,
+// mouse and scroll movements add up until a step consumes them.
+struct InputState {
+    unsigned int keys;      // bit (1 << Camera_Movement) per held movement key
+    float mouseX, mouseY;   // offsets as ProcessMouseMovement takes them
+    float scroll;
+    uint64_t sequence;      // counts the submits that carried any input
+    SimulationClock::time_point sampled; // when the latest of them was polled
+
+    InputState() : keys(0), mouseX(0.0f), mouseY(0.0f), scroll(0.0f), sequence(0)
+    {
+    }
+
+    bool active() const
+    {
+        return keys != 0 || mouseX != 0.0f || mouseY != 0.0f || scroll != 0.0f;
+    }
+};
+
+// the world after one step; the scene's animations are functions of time, so it is all they need
+struct SimulationState {
+    double time;                      // simulated seconds
+    SimulationClock::time_point wall; // when the step was due, what the render thread interpolates by
+    glm::vec3 cameraPosition;
+    float yaw, pitch, zoom;
+    uint64_t inputSequence;           // the last input this step has seen, and when it was polled
+    SimulationClock::time_point inputSampled;
+
+    SimulationState() : time(0.0), cameraPosition(0.0f), yaw(0.0f), pitch(0.0f), zoom(45.0f), inputSequence(0)
+    {
+    }
+};
+
+// Steps the camera and the clock at a fixed rate on a thread of its own, so a slow frame no longer slows
+// input or the simulation down, and the simulation no longer depends on the frame rate. Every step
+// publishes itself together with the step before it, and the render thread draws a blend of the two at a
+// time one step in the past, which is always between them while the simulation keeps up.
+//
+//   simulation.start(camera);
+//   simulation.submit(input);                             // main thread, after polling
+//   SimulationState state = simulation.sample();          // render thread, once a frame
+class Simulation
+{
+public:
+    static constexpr double STEP = 1.0 / 120.0;
+    static const int MAX_CATCH_UP = 25; // steps run back to back after a stall before the rest are dropped
+
+    Simulation() : running(false), stopping(false)
+    {
+    }
+    ~Simulation()
+    {
+        stop();
+    }
+
+    // take over the camera's pose and start stepping from time 0
+    void start(const Camera& initial)
+    {
+        if (running)
+            return;
+        camera = initial;
+        SimulationState first;
+        first.wall = SimulationClock::now();
+        capture(first);
+        Snapshot& snapshot = snapshots.write();
+        snapshot.previous = snapshot.current = first;
+        snapshots.publish();
+        current = first;
+        stopping = false;
+        running = true;
+        thread = std::thread(&Simulation::run, this);
+    }
+
+    void stop()
+    {
+        if (!running)
+            return;
+        stopping = true;
+        thread.join();
+        running = false;
+    }
+
+    bool isRunning() const
+    {
+        return running;
+    }
+
+    void submit(const InputState& input)
+    {
+        std::lock_guard<std::mutex> lock(inputMutex);
+        pendingInput.keys = input.keys;
+        pendingInput.mouseX += input.mouseX;
+        pendingInput.mouseY += input.mouseY;
+        pendingInput.scroll += input.scroll;
+        if (input.active())
+        {
+            pendingInput.sequence++;
+            pendingInput.sampled = input.sampled;
+        }
+    }
+
+    // the state to draw now: one step back, blended between the two steps around that time
+    SimulationState sample(float* blend = NULL)
+    {
+        snapshots.update();
+        const Snapshot& snapshot = snapshots.read();
+        SimulationClock::time_point at = SimulationClock::now() - stepDuration();
+        double span = std::chrono::duration<double>(snapshot.current.wall - snapshot.previous.wall).count();
+        double t = span > 0.0 ? std::chrono::duration<double>(at - snapshot.previous.wall).count() / span : 1.0;
+        // past the current step the simulation fell behind, hold it rather than extrapolate
+        t = t < 0.0 ? 0.0 : (t > 1.0 ? 1.0 : t);
+        if (blend)
+            *blend = (float)t;
+
+        const SimulationState& a = snapshot.previous;
+        const SimulationState& b = snapshot.current;
+        SimulationState state = b;
+        state.time = a.time + (b.time - a.time) * t;
+        state.cameraPosition = glm::mix(a.cameraPosition, b.cameraPosition, (float)t);
+        state.yaw = a.yaw + (b.yaw - a.yaw) * (float)t;
+        state.pitch = a.pitch + (b.pitch - a.pitch) * (float)t;
+        state.zoom = a.zoom + (b.zoom - a.zoom) * (float)t;
+        return state;
+    }
+
+private:
+    struct Snapshot {
+        SimulationState previous, current;
+    };
+
+    Camera camera; // the simulation's own, the render thread's camera is only ever set from snapshots
+    SimulationState current;
+    TripleBuffer<Snapshot> snapshots;
+    InputState pendingInput;
+    std::mutex inputMutex;
+    std::thread thread;
+    bool running;
+    std::atomic<bool> stopping;
+
+    static SimulationClock::duration stepDuration()
+    {
+        return std::chrono::duration_cast<SimulationClock::duration>(std::chrono::nanoseconds((long long)(STEP * 1.0e9 + 0.5)));
+    }
+
+    void capture(SimulationState& state) const
+    {
+        state.cameraPosition = camera.Position;
+        state.yaw = camera.Yaw;
+        state.pitch = camera.Pitch;
+        state.zoom = camera.Zoom;
+    }
+
+    void run()
+    {
+        SimulationClock::time_point due = current.wall + stepDuration();
+        while (!stopping)
+        {
+            std::this_thread::sleep_until(due);
+            int steps = 0;
+            while (due <= SimulationClock::now() && steps < MAX_CATCH_UP)
+            {
+                step(due);
+                due += stepDuration();
+                steps++;
+            }
+            // a stall longer than the catch up, e.g. the window being dragged, is skipped over
+            if (due <= SimulationClock::now())
+                due = SimulationClock::now() + stepDuration();
+        }
+    }
+
+    void step(SimulationClock::time_point wall)
+    {
+        InputState input;
+        {
+            std::lock_guard<std::mutex> lock(inputMutex);
+            input = pendingInput;
+            pendingInput.mouseX = pendingInput.mouseY = pendingInput.scroll = 0.0f;
+        }
+        const float dt = (float)STEP;
+        for (int direction = FORWARD; direction <= DOWN; direction++)
+            if (input.keys & (1u << direction))
+                camera.ProcessKeyboard((Camera_Movement)direction, dt);
+        if (input.mouseX != 0.0f || input.mouseY != 0.0f)
+            camera.ProcessMouseMovement(input.mouseX, input.mouseY);
+        if (input.scroll != 0.0f)
+            camera.ProcessMouseScroll(input.scroll);
+
+        Snapshot& snapshot = snapshots.write();
+        snapshot.previous = current;
+        current.time += STEP;
+        current.wall = wall;
+        capture(current);
+        current.inputSequence = input.sequence;
+        current.inputSampled = input.sampled;
+        snapshot.current = current;
+        snapshots.publish();
+    }
+};
+
+// What the player feels of the frame pacing, into the profiler once a frame right after the swap:
+// "present interval" between successive swaps, and "input latency" from polling an input to the first
+// swap of a frame whose simulation state had consumed it. Swapping only queues the frame on most
+// drivers, so the latency is a lower bound of what reaches the screen.
+class FramePacing
+{
+public:
+    FramePacing() : hasPresented(false), shownSequence(0)
+    {
+    }
+
+    void presented(const SimulationState& shown, GpuProfiler& profiler)
+    {
+        SimulationClock::time_point now = SimulationClock::now();
+        if (hasPresented)
+            profiler.sample("present interval", std::chrono::duration<float, std::milli>(now - lastPresent).count());
+        if (shown.inputSequence != shownSequence)
+        {
+            profiler.sample("input latency", std::chrono::duration<float, std::milli>(now - shown.inputSampled).count());
+            shownSequence = shown.inputSequence;
+        }
+        lastPresent = now;
+        hasPresented = true;
+    }
+
+private:
+    SimulationClock::time_point lastPresent;
+    bool hasPresented;
+    uint64_t shownSequence;
+};
+
+#endif
@@ -0,0 +1,231 @@
+#ifndef SKINNING_H
+#define SKINNING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include </OpenGl programming/Sandbox/gl_extensions.h>
+#include </OpenGl programming/Sandbox/gl_state_cache.h>
+#include </OpenGl programming/Sandbox/shader_s.h>
+#include </OpenGl programming/Sandbox/instance_buffer.h>
+#include </OpenGl programming/Sandbox/vertex.h>
+#include </OpenGl programming/Sandbox/model.h>
+
+#include <iostream>
+#include <vector>
+
+// Skins many characters of one animated Model once per frame in a compute shader (skinning.comp) into a
+// vertex buffer of their own. Every pass after that (depth pre-pass, main pass, any shadow pass) draws the
+// skinned vertices like static geometry with the plain instanced shaders, instead of each pass skinning
+// again in its vertex shader. The vertices come out in world space in the full Vertex layout, and every
+// VAO carries a single identity instance matrix, so shader.vs and depth_instanced.vs read them unchanged.
+//
+// Each mesh's output holds all characters back to back and is drawn with one glMultiDrawElementsBaseVertex
+// over the mesh's own index buffer. Only meshes with their own VERTEX_FULL buffers can be skinned, those
+// are what the compute shader reads the bind pose from. Needs glCaps().computeShaders.
+class GpuSkinning
+{
+public:
+    static const unsigned int GROUP_SIZE = 64; // skinning.comp local_size_x
+    unsigned int characterCount;
+
+    GpuSkinning() : characterCount(0), model(NULL), outputBuffer(0), paletteBuffer(0), paletteCapacity(0), samplerProgram(0)
+    {
+    }
+
+    // lay out the output for count characters of target, a no-op when neither changed; false when the
+    // model cannot be skinned this way, for the caller to draw it unskinned instead
+    bool resize(Model& target, unsigned int count)
+    {
+        if (model == &target && characterCount == count && (outputBuffer || count == 0))
+            return true;
+        release();
+        model = &target;
+        characterCount = count;
+        if (count == 0 || target.skeleton.empty())
+            return true;
+
+        // each mesh's range is bound on its own, so it has to start on the storage buffer offset alignment,
+        // and at a whole vertex so the draws can address it with a base vertex
+        GLint alignment = 1, maxBlockSize = 0;
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        glGetIntegerv(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &maxBlockSize);
+        size_t vertexStep = alignment > 0 ? (size_t)alignment / gcd(sizeof(Vertex), (size_t)alignment) : 1;
+        size_t totalVertices = 0;
+        for (unsigned int i = 0; i < target.meshes.size(); i++)
+        {
+            const Mesh& mesh = target.meshes[i];
+            if (mesh.megaBuffer || mesh.vertexFormat != VERTEX_FULL || mesh.VertexBuffer() == 0)
+            {
+                std::cout << "GpuSkinning: mesh " << i << " does not own a full format vertex buffer, it cannot be skinned" << std::endl;
+                release();
+                return false;
+            }
+            SkinnedMesh skinned;
+            skinned.mesh = i;
+            skinned.firstVertex = (totalVertices + vertexStep - 1) / vertexStep * vertexStep;
+            totalVertices = skinned.firstVertex + mesh.vertexCount * count;
+            // the dispatch binds all copies of the mesh as one block, past the limit they are drawn unskinned
+            if ((double)mesh.vertexCount * count * sizeof(Vertex) > (double)maxBlockSize)
+            {
+                std::cout << "GpuSkinning: " << count << " copies of mesh " << i << " exceed the largest storage block of " << maxBlockSize << " bytes" << std::endl;
+                release();
+                return false;
+            }
+            meshes.push_back(skinned);
+        }
+
+        glGenBuffers(1, &outputBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, outputBuffer);
+        glBufferData(GL_ARRAY_BUFFER, totalVertices * sizeof(Vertex), NULL, GL_DYNAMIC_COPY);
+        glGenBuffers(1, &paletteBuffer);
+
+        GLStateCache& state = glState();
+        glm::mat4 identity(1.0f);
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            SkinnedMesh& skinned = meshes[i];
+            const Mesh& mesh = target.meshes[skinned.mesh];
+            glGenVertexArrays(1, &skinned.VAO);
+            state.bindVertexArray(skinned.VAO);
+            glBindBuffer(GL_ARRAY_BUFFER, outputBuffer);
+            setupVertexAttributes();
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ElementBuffer());
+            // the one instance of every draw is the identity, the vertices are in world space already
+            identityInstance.attach();
+            if (i == 0)
+                identityInstance.upload(&identity, 1);
+
+            skinned.counts.assign(count, mesh.range.indexCount);
+            skinned.indices.assign(count, (const void*)(mesh.range.firstIndex * sizeof(unsigned int)));
+            skinned.baseVertices.resize(count);
+            for (unsigned int c = 0; c < count; c++)
+                skinned.baseVertices[c] = (GLint)(skinned.firstVertex + c * mesh.vertexCount);
+        }
+        state.bindVertexArray(0);
+        return true;
+    }
+
+    // from onProgramChange of the skinning.comp program
+    void resolveUniforms(Shader& program)
+    {
+        boneCountLocation = program.getUniform("boneCount");
+        vertexCountLocation = program.getUniform("vertexCount");
+        rigidBoneLocation = program.getUniform("rigidBone");
+    }
+
+    // skin every character from its palette (AnimationSampler::palettes, skeleton.bones.size() each)
+    void skin(Shader& program, const std::vector<glm::mat4>& palettes)
+    {
+        if (!outputBuffer)
+            return;
+        size_t boneCount = model->skeleton.bones.size();
+        size_t size = (size_t)characterCount * boneCount * sizeof(glm::mat4);
+        if (palettes.size() * sizeof(glm::mat4) < size)
+        {
+            std::cout << "GpuSkinning: " << palettes.size() << " bone matrices for " << characterCount << " characters of " << boneCount << " bones" << std::endl;
+            return;
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, paletteBuffer);
+        if (size > paletteCapacity)
+            paletteCapacity = size;
+        glBufferData(GL_SHADER_STORAGE_BUFFER, paletteCapacity, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, palettes.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BONE_PALETTE_BINDING, paletteBuffer);
+
+        program.use();
+        program.setInt(boneCountLocation, (int)boneCount);
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            const SkinnedMesh& skinned = meshes[i];
+            const Mesh& mesh = model->meshes[skinned.mesh];
+            if (mesh.vertexCount == 0)
+                continue;
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BIND_POSE_BINDING, mesh.VertexBuffer());
+            glBindBufferRange(GL_SHADER_STORAGE_BUFFER, SKINNED_VERTEX_BINDING, outputBuffer, skinned.firstVertex * sizeof(Vertex),
+                              mesh.vertexCount * characterCount * sizeof(Vertex));
+            program.setInt(vertexCountLocation, (int)mesh.vertexCount);
+            int rigidBone = skinned.mesh < model->skeleton.meshRigidBone.size() ? model->skeleton.meshRigidBone[skinned.mesh] : -1;
+            program.setInt(rigidBoneLocation, rigidBone);
+            // x walks the mesh's vertices, y the characters
+            glDispatchCompute((GLuint)((mesh.vertexCount + GROUP_SIZE - 1) / GROUP_SIZE), characterCount, 1);
+        }
+        glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    }
+
+    // every character in one draw per mesh, with any program reading the instanced vertex layout
+    void draw(Shader& shader)
+    {
+        if (!outputBuffer)
+            return;
+        if (samplerProgram != shader.ID)
+        {
+            Mesh::SetSamplerUnits(shader);
+            samplerProgram = shader.ID;
+        }
+        GLStateCache& state = glState();
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            SkinnedMesh& skinned = meshes[i];
+            model->meshes[skinned.mesh].BindTextures();
+            state.bindVertexArray(skinned.VAO);
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, skinned.counts.data(), GL_UNSIGNED_INT, skinned.indices.data(), (GLsizei)characterCount,
+                                          skinned.baseVertices.data());
+            state.countDraw();
+        }
+    }
+
+    void release()
+    {
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            glState().forgetVertexArray(meshes[i].VAO);
+            glDeleteVertexArrays(1, &meshes[i].VAO);
+        }
+        meshes.clear();
+        if (outputBuffer)
+            glDeleteBuffers(1, &outputBuffer);
+        if (paletteBuffer)
+            glDeleteBuffers(1, &paletteBuffer);
+        if (identityInstance.ID)
+            glDeleteBuffers(1, &identityInstance.ID);
+        identityInstance = InstanceBuffer();
+        outputBuffer = paletteBuffer = 0;
+        paletteCapacity = 0;
+        characterCount = 0;
+        model = NULL;
+    }
+
+private:
+    struct SkinnedMesh {
+        unsigned int mesh;
+        size_t firstVertex;   // of its output range
+        unsigned int VAO;
+        std::vector<GLsizei> counts;
+        std::vector<const void*> indices;
+        std::vector<GLint> baseVertices;
+    };
+
+    Model* model;
+    std::vector<SkinnedMesh> meshes;
+    unsigned int outputBuffer;
+    unsigned int paletteBuffer;
+    size_t paletteCapacity;
+    InstanceBuffer identityInstance;
+    UniformHandle boneCountLocation, vertexCountLocation, rigidBoneLocation;
+    unsigned int samplerProgram;
+
+    static size_t gcd(size_t a, size_t b)
+    {
+        while (b)
+        {
+            size_t t = a % b;
+            a = b;
+            b = t;
+        }
+        return a;
+    }
+};
+
+#endif
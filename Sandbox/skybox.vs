@@ -1,3 +1,14 @@
-version https://git-lfs.github.com/spec/v1
-oid sha256:2b5172702fa0b79647284f2b8f50fb78972d9000295a1c58cc9fabb38f148cbf
-size 253
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+out vec3 TexCoords;
+
+#include <FrameData>
+
+void main()
+{
+    TexCoords = aPos;
+    // drop the translation so the skybox stays centered on the camera
+    vec4 pos = projection * mat4(mat3(view)) * vec4(aPos, 1.0);
+    gl_Position = pos.xyww;
+}
@@ -0,0 +1,35 @@
+#ifndef SORT_KEY_H
+#define SORT_KEY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// LSD radix sort of anything with a 64-bit key member, bytes that are equal in every key are skipped
+template <typename Entry>
+void sortByKey(std::vector<Entry>& entries, std::vector<Entry>& scratch)
+{
+    size_t n = entries.size();
+    scratch.resize(n);
+    for (unsigned int shift = 0; shift < 64; shift += 8)
+    {
+        size_t counts[256] = {};
+        for (size_t i = 0; i < n; i++)
+            counts[(entries[i].key >> shift) & 0xFF]++;
+        if (n == 0 || counts[(entries[0].key >> shift) & 0xFF] == n)
+            continue;
+
+        size_t offset = 0;
+        for (unsigned int b = 0; b < 256; b++)
+        {
+            size_t c = counts[b];
+            counts[b] = offset;
+            offset += c;
+        }
+        for (size_t i = 0; i < n; i++)
+            scratch[counts[(entries[i].key >> shift) & 0xFF]++] = entries[i];
+        entries.swap(scratch);
+    }
+}
+
+#endif
@@ -0,0 +1,182 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+
+#include </OpenGl programming/Sandbox/gl_state_cache.h>
+#include </OpenGl programming/Sandbox/texture_loader.h>
+
+#include <cctype>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Process-wide table of loaded textures, so every file is decoded and uploaded once no matter how
+// many models or materials use it. Entries are keyed by the canonical path and the sRGB flag and
+// counted: every acquire needs a matching release. Textures whose count dropped to zero stay
+// resident until evictUnused() is called, so unloading one model and loading the next does not
+// throw away the textures they share.
+class TextureCache
+{
+public:
+    unsigned int acquire(const std::string& path, bool srgb)
+    {
+        std::string key = canonicalTexturePath(path) + (srgb ? "|srgb" : "|linear");
+        std::unordered_map<std::string, Entry>::iterator it = entries.find(key);
+        if (it != entries.end())
+        {
+            it->second.references++;
+            return it->second.texture;
+        }
+        Entry entry;
+        entry.texture = textureLoader().load2D(path, srgb);
+        entry.references = 1;
+        entries[key] = entry;
+        keys[entry.texture] = key;
+        return entry.texture;
+    }
+
+    unsigned int acquireCubemap(const std::vector<std::string>& faces)
+    {
+        std::string key = "cube";
+        for (size_t i = 0; i < faces.size(); i++)
+            key += "|" + canonicalTexturePath(faces[i]);
+        std::unordered_map<std::string, Entry>::iterator it = entries.find(key);
+        if (it != entries.end())
+        {
+            it->second.references++;
+            return it->second.texture;
+        }
+        Entry entry;
+        entry.texture = textureLoader().loadCubemap(faces);
+        entry.references = 1;
+        entries[key] = entry;
+        keys[entry.texture] = key;
+        return entry.texture;
+    }
+
+    // take another reference to a texture this cache handed out
+    void retain(unsigned int texture)
+    {
+        Entry* entry = find(texture);
+        if (entry)
+            entry->references++;
+    }
+
+    void release(unsigned int texture)
+    {
+        Entry* entry = find(texture);
+        if (!entry)
+            std::cout << "TextureCache: release of texture " << texture << " that it does not own" << std::endl;
+        else if (entry->references > 0)
+            entry->references--;
+    }
+
+    // delete every texture nobody holds a reference to, returns how many went
+    unsigned int evictUnused()
+    {
+        std::vector<unsigned int> unused;
+        for (std::unordered_map<std::string, Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+            if (it->second.references == 0)
+                unused.push_back(it->second.texture);
+        if (unused.empty())
+            return 0;
+
+        // a pending upload must not land on a name that was deleted (and maybe handed out again)
+        if (!textureLoader().done())
+            textureLoader().finish();
+        for (size_t i = 0; i < unused.size(); i++)
+            erase(unused[i]);
+        return static_cast<unsigned int>(unused.size());
+    }
+
+    // delete everything regardless of references, call before the context goes away
+    void clear()
+    {
+        while (!keys.empty())
+            erase(keys.begin()->first);
+    }
+
+    size_t size() const
+    {
+        return entries.size();
+    }
+
+    // separators unified, "." and ".." resolved, and case folded on Windows where paths are case insensitive
+    static std::string canonicalTexturePath(const std::string& path)
+    {
+        std::string unified = path;
+        for (size_t i = 0; i < unified.size(); i++)
+        {
+            if (unified[i] == '\\')
+                unified[i] = '/';
+#ifdef _WIN32
+            unified[i] = static_cast<char>(std::tolower(static_cast<unsigned char>(unified[i])));
+#endif
+        }
+
+        std::vector<std::string> parts;
+        bool absolute = !unified.empty() && unified[0] == '/';
+        size_t start = 0;
+        while (start <= unified.size())
+        {
+            size_t end = unified.find('/', start);
+            if (end == std::string::npos)
+                end = unified.size();
+            std::string part = unified.substr(start, end - start);
+            if (part == "..")
+            {
+                if (!parts.empty() && parts.back() != "..")
+                    parts.pop_back();
+                else if (!absolute)
+                    parts.push_back(part);
+            }
+            else if (!part.empty() && part != ".")
+                parts.push_back(part);
+            start = end + 1;
+        }
+
+        std::string canonical = absolute ? "/" : "";
+        for (size_t i = 0; i < parts.size(); i++)
+        {
+            if (i > 0)
+                canonical += '/';
+            canonical += parts[i];
+        }
+        return canonical;
+    }
+
+private:
+    struct Entry {
+        unsigned int texture;
+        unsigned int references;
+    };
+    std::unordered_map<std::string, Entry> entries;
+    std::unordered_map<unsigned int, std::string> keys; // texture name -> entry key
+
+    Entry* find(unsigned int texture)
+    {
+        std::unordered_map<unsigned int, std::string>::iterator it = keys.find(texture);
+        return it == keys.end() ? NULL : &entries[it->second];
+    }
+
+    void erase(unsigned int texture)
+    {
+        std::unordered_map<unsigned int, std::string>::iterator it = keys.find(texture);
+        if (it == keys.end())
+            return;
+        entries.erase(it->second);
+        keys.erase(it);
+        glDeleteTextures(1, &texture);
+        glState().forgetTexture(texture);
+    }
+};
+
+inline TextureCache& textureCache()
+{
+    static TextureCache cache;
+    return cache;
+}
+
+#endif
@@ -0,0 +1,411 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+#include <stb/stb_image.h>
+
+#include </OpenGl programming/Sandbox/gl_state_cache.h>
+#include </OpenGl programming/Sandbox/compressed_texture.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Decodes image files on a pool of worker threads and uploads them on the render thread.
+// load2D/loadCubemap return a usable texture name straight away: it holds a 1x1 placeholder until
+// update() (called once per frame) streams the decoded pixels into it through a pixel unpack buffer,
+// at most uploadBudget bytes per frame. The name never changes, so it can be stored in materials
+// and passed to the render queue before the image has arrived.
+// When a converted .ktx2/.dds sits next to a source image (see findCompressedTexture) and the context
+// supports its format, the block compressed mip chain is uploaded instead of decoding the source.
+class TextureLoader
+{
+public:
+    // bytes handed to glTexImage2D per update(), a request larger than this still goes through alone
+    size_t uploadBudget;
+    // look for converted .ktx2/.dds files before decoding PNG/JPG sources
+    bool preferCompressed;
+
+    TextureLoader() : uploadBudget(8 * 1024 * 1024), preferCompressed(true), pbo(0), pboSize(0), stopping(false), outstanding(0)
+    {
+    }
+    ~TextureLoader()
+    {
+        stopWorkers();
+    }
+
+    // 2D texture with repeat wrapping and mipmaps, like the old synchronous loaders
+    unsigned int load2D(const std::string& path, bool gammaCorrection)
+    {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glState().bindTexture(0, GL_TEXTURE_2D, texture);
+        uploadPlaceholder(GL_TEXTURE_2D);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        std::vector<std::string> paths(1, path);
+        enqueue(texture, GL_TEXTURE_2D, gammaCorrection, paths);
+        return texture;
+    }
+
+    // cubemap from faces in +X, -X, +Y, -Y, +Z, -Z order; all six faces are uploaded in the same frame
+    unsigned int loadCubemap(const std::vector<std::string>& faces)
+    {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glState().bindTexture(0, GL_TEXTURE_CUBE_MAP, texture);
+        for (unsigned int i = 0; i < 6; i++)
+            uploadPlaceholder(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+        enqueue(texture, GL_TEXTURE_CUBE_MAP, false, faces);
+        return texture;
+    }
+
+    // upload decoded images within the frame budget, render thread only
+    void update()
+    {
+        std::vector< std::shared_ptr<Request> > batch;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            size_t bytes = 0;
+            while (!ready.empty() && (batch.empty() || bytes + ready.front()->bytes() <= uploadBudget))
+            {
+                bytes += ready.front()->bytes();
+                batch.push_back(ready.front());
+                ready.pop_front();
+            }
+        }
+        for (size_t i = 0; i < batch.size(); i++)
+            upload(*batch[i]);
+    }
+
+    // block until every request so far is decoded and uploaded, ignoring the budget
+    void finish()
+    {
+        for (;;)
+        {
+            std::vector< std::shared_ptr<Request> > batch;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                idle.wait(lock, [this] { return !ready.empty() || outstanding == 0; });
+                if (ready.empty())
+                    return;
+                batch.assign(ready.begin(), ready.end());
+                ready.clear();
+            }
+            for (size_t i = 0; i < batch.size(); i++)
+                upload(*batch[i]);
+        }
+    }
+
+    // true once nothing is waiting to be decoded or uploaded
+    bool done()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return outstanding == 0;
+    }
+
+    // stop the workers and free the staging buffer, call before the context goes away
+    void shutdown()
+    {
+        stopWorkers();
+        if (pbo)
+            glDeleteBuffers(1, &pbo);
+        pbo = 0;
+        pboSize = 0;
+    }
+
+private:
+    struct Image {
+        std::string path;
+        unsigned char* pixels;
+        int width, height, components;
+        CompressedTexture compressed; // used instead of pixels when its internalFormat is set
+
+        bool loaded() const
+        {
+            return pixels != NULL || compressed.internalFormat != 0;
+        }
+        size_t size() const
+        {
+            if (compressed.internalFormat)
+                return compressed.data.size();
+            return pixels ? static_cast<size_t>(width) * height * components : 0;
+        }
+    };
+    struct Request {
+        unsigned int texture;
+        GLenum target;
+        bool gammaCorrection;
+        std::vector<Image> images;
+        unsigned int pending; // images still being decoded, guarded by the loader's mutex
+
+        size_t bytes() const
+        {
+            size_t total = 0;
+            for (size_t i = 0; i < images.size(); i++)
+                total += images[i].size();
+            return total;
+        }
+    };
+    struct Job {
+        std::shared_ptr<Request> request;
+        size_t image;
+    };
+
+    unsigned int pbo;
+    size_t pboSize;
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    std::deque<Job> jobs;
+    std::deque< std::shared_ptr<Request> > ready;
+    bool stopping;
+    unsigned int outstanding; // requests enqueued but not uploaded yet
+
+    static void uploadPlaceholder(GLenum target)
+    {
+        static const unsigned char grey[4] = { 128, 128, 128, 255 };
+        glTexImage2D(target, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+    }
+
+    void enqueue(unsigned int texture, GLenum target, bool gammaCorrection, const std::vector<std::string>& paths)
+    {
+        std::shared_ptr<Request> request = std::make_shared<Request>();
+        request->texture = texture;
+        request->target = target;
+        request->gammaCorrection = gammaCorrection;
+        request->images.resize(paths.size());
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            request->images[i].path = paths[i];
+            request->images[i].pixels = NULL;
+            request->images[i].width = request->images[i].height = request->images[i].components = 0;
+        }
+        request->pending = static_cast<unsigned int>(paths.size());
+
+        if (workers.empty())
+            startWorkers();
+        std::lock_guard<std::mutex> lock(mutex);
+        outstanding++;
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            Job job = { request, i };
+            jobs.push_back(job);
+        }
+        wake.notify_all();
+    }
+
+    void startWorkers()
+    {
+        stopping = false;
+        // leave a core for the render thread, hardware_concurrency() may also report 0
+        unsigned int cores = std::thread::hardware_concurrency();
+        unsigned int count = cores > 2 ? cores - 1 : 1;
+        for (unsigned int i = 0; i < count; i++)
+            workers.push_back(std::thread(&TextureLoader::work, this));
+    }
+
+    void stopWorkers()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            // whatever was never uploaded is dropped, the textures keep their placeholder
+            for (size_t i = 0; i < ready.size(); i++)
+                freePixels(*ready[i]);
+            ready.clear();
+            jobs.clear();
+            outstanding = 0;
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+        workers.clear();
+    }
+
+    void work()
+    {
+        for (;;)
+        {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping)
+                    return;
+                job = jobs.front();
+                jobs.pop_front();
+            }
+
+            Image& image = job.request->images[job.image];
+            decode(image, job.request->gammaCorrection);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping)
+            {
+                freeImage(image);
+                return;
+            }
+            if (--job.request->pending == 0)
+            {
+                ready.push_back(job.request);
+                idle.notify_all();
+            }
+        }
+    }
+
+    // worker side: the converted file if there is a usable one, the source image otherwise
+    void decode(Image& image, bool srgb)
+    {
+        std::string converted = preferCompressed ? findCompressedTexture(image.path) : std::string();
+        if (!converted.empty())
+        {
+            std::string error;
+            if (loadCompressedTexture(converted, srgb, image.compressed, error) && compressedFormatSupported(image.compressed.internalFormat))
+                return;
+            if (error.empty())
+                error = "its format is not supported by this context";
+            // PNG/JPG sources can still be decoded, a .dds/.ktx2 path has nothing to fall back to
+            std::cout << "TextureLoader: not using " << converted << ", " << error << std::endl;
+            image.compressed = CompressedTexture();
+            if (converted == image.path)
+                return;
+        }
+        // stb_image keeps no shared state as long as the global flip flag is left alone
+        image.pixels = stbi_load(image.path.c_str(), &image.width, &image.height, &image.components, 0);
+    }
+
+    static void freeImage(Image& image)
+    {
+        stbi_image_free(image.pixels);
+        image.pixels = NULL;
+        image.compressed = CompressedTexture();
+    }
+
+    static void freePixels(Request& request)
+    {
+        for (size_t i = 0; i < request.images.size(); i++)
+            freeImage(request.images[i]);
+    }
+
+    void upload(Request& request)
+    {
+        size_t total = request.bytes();
+        if (total > 0)
+        {
+            // stage every image of the request in one buffer, mapping with invalidate orphans the previous contents
+            if (pbo == 0)
+                glGenBuffers(1, &pbo);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+            if (total > pboSize)
+            {
+                pboSize = total;
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, pboSize, NULL, GL_STREAM_DRAW);
+            }
+            unsigned char* staging = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, total, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+            std::vector<size_t> offsets(request.images.size(), 0);
+            size_t offset = 0;
+            for (size_t i = 0; i < request.images.size(); i++)
+            {
+                const Image& image = request.images[i];
+                if (!image.loaded())
+                    continue;
+                offsets[i] = offset;
+                if (staging)
+                    std::memcpy(staging + offset, image.compressed.internalFormat ? image.compressed.data.data() : image.pixels, image.size());
+                offset += image.size();
+            }
+            if (staging && glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER))
+            {
+                // rows of 1 and 3 channel images are not 4 byte aligned
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+                glState().bindTexture(0, request.target, request.texture);
+                bool generateMipmaps = request.target == GL_TEXTURE_2D;
+                for (size_t i = 0; i < request.images.size(); i++)
+                {
+                    const Image& image = request.images[i];
+                    if (!image.loaded())
+                        continue;
+                    GLenum face = request.target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + static_cast<GLenum>(i) : request.target;
+                    if (image.compressed.internalFormat)
+                    {
+                        // the mip chain comes with the file, and the faces of a cubemap must all be converted alike
+                        const CompressedTexture& compressed = image.compressed;
+                        for (size_t level = 0; level < compressed.levels.size(); level++)
+                            glCompressedTexImage2D(face, static_cast<GLint>(level), compressed.internalFormat, compressed.levels[level].width, compressed.levels[level].height, 0,
+                                                   static_cast<GLsizei>(compressed.levels[level].size), (void*)(offsets[i] + compressed.levels[level].offset));
+                        glTexParameteri(request.target, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(compressed.levels.size()) - 1);
+                        generateMipmaps = false;
+                        continue;
+                    }
+                    GLenum internalFormat, dataFormat;
+                    formats(image.components, request.gammaCorrection, internalFormat, dataFormat);
+                    glTexImage2D(face, 0, internalFormat, image.width, image.height, 0, dataFormat, GL_UNSIGNED_BYTE, (void*)offsets[i]);
+                }
+                if (generateMipmaps)
+                    glGenerateMipmap(GL_TEXTURE_2D);
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            }
+            else
+                std::cout << "TextureLoader: could not map the staging buffer for texture " << request.texture << std::endl;
+            // client pointers passed to glTexImage2D elsewhere must not be read as PBO offsets
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+
+        for (size_t i = 0; i < request.images.size(); i++)
+        {
+            if (!request.images[i].loaded())
+                std::cout << (request.target == GL_TEXTURE_CUBE_MAP ? "Cubemap texture" : "Texture") << " failed to load at path: " << request.images[i].path << std::endl;
+        }
+        freePixels(request);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (outstanding > 0)
+            outstanding--;
+        idle.notify_all();
+    }
+
+    static void formats(int components, bool gammaCorrection, GLenum& internalFormat, GLenum& dataFormat)
+    {
+        if (components == 1)
+            internalFormat = dataFormat = GL_RED;
+        else if (components == 2)
+            internalFormat = dataFormat = GL_RG;
+        else if (components == 3)
+        {
+            internalFormat = gammaCorrection ? GL_SRGB : GL_RGB;
+            dataFormat = GL_RGB;
+        }
+        else
+        {
+            internalFormat = gammaCorrection ? GL_SRGB_ALPHA : GL_RGBA;
+            dataFormat = GL_RGBA;
+        }
+    }
+};
+
+inline TextureLoader& textureLoader()
+{
+    static TextureLoader loader;
+    return loader;
+}
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// per-frame data shared by every program, mirrors frameDataBlock() in the shaders.
+// std140 aligns a vec3 to 16 bytes, so each trailing float packs into the vec3's 4th slot.
+struct FrameData {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec3 cameraPos;
+    float     time;
+    glm::vec3 lightPos;
+    float     deltaTime;
+};
+static_assert(sizeof(FrameData) == 160, "FrameData must match the std140 layout of the FrameData block");
+
+// the GLSL side of FrameData, kept here with the struct so the two only ever change together. Shaders
+// declare it with an "#include <FrameData>" line, which Shader replaces with this when it reads them.
+inline const char* frameDataBlock()
+{
+    return
+        "layout (std140) uniform FrameData\n"
+        "{\n"
+        "    mat4 projection;\n"
+        "    mat4 view;\n"
+        "    vec3 cameraPos;\n"
+        "    float time;\n"
+        "    vec3 lightPos;\n"
+        "    float deltaTime;\n"
+        "};\n";
+}
+
+// a uniform buffer holding one T, attached once to a fixed binding point.
+// every update orphans the previous storage so the driver never has to wait for in-flight frames still reading it.
+template <typename T>
+class UniformBuffer
+{
+public:
+    unsigned int ID;
+    unsigned int binding;
+
+    UniformBuffer(unsigned int bindingPoint) : binding(bindingPoint)
+    {
+        glGenBuffers(1, &ID);
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(T), NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, ID);
+    }
+
+    void update(const T& data)
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(T), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+};
+
+#endif
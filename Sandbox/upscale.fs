@@ -0,0 +1,31 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D source;
+uniform vec2 uvScale;    // the part of the source the frame was rendered to
+uniform vec2 texelSize;  // 1 / size of the source texture
+uniform float sharpness; // 0 plain bilinear, 1 strongest
+
+void main()
+{
+    vec2 uv = TexCoords * uvScale;
+    // keep every tap inside the rendered rectangle, the rest of the texture is stale
+    vec2 lo = texelSize * 0.5;
+    vec2 hi = uvScale - texelSize * 0.5;
+    vec3 center = texture(source, clamp(uv, lo, hi)).rgb;
+    vec3 north = texture(source, clamp(uv + vec2(0.0, texelSize.y), lo, hi)).rgb;
+    vec3 south = texture(source, clamp(uv - vec2(0.0, texelSize.y), lo, hi)).rgb;
+    vec3 east = texture(source, clamp(uv + vec2(texelSize.x, 0.0), lo, hi)).rgb;
+    vec3 west = texture(source, clamp(uv - vec2(texelSize.x, 0.0), lo, hi)).rgb;
+
+    // contrast adaptive sharpening: the less headroom the neighbourhood leaves before clipping, the less
+    // it is sharpened, so strong edges do not ring while flat detail lost to the upscale comes back
+    vec3 minColor = min(center, min(min(north, south), min(east, west)));
+    vec3 maxColor = max(center, max(max(north, south), max(east, west)));
+    vec3 amount = sqrt(clamp(min(minColor, 1.0 - maxColor) / max(maxColor, vec3(1e-4)), 0.0, 1.0));
+    vec3 weight = -amount * mix(0.0, 0.2, sharpness);
+    vec3 color = (center + (north + south + east + west) * weight) / (1.0 + 4.0 * weight);
+    FragColor = vec4(clamp(color, 0.0, 1.0), 1.0);
+}
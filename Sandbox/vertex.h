@@ -0,0 +1,209 @@
+#ifndef VERTEX_H
+#define VERTEX_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#define MAX_BONE_INFLUENCE 4
+
+struct Vertex {
+    // position
+    glm::vec3 Position;
+    // normal
+    glm::vec3 Normal;
+    // texCoords
+    glm::vec2 TexCoords;
+    // tangent
+    glm::vec3 Tangent;
+    // bitangent
+    glm::vec3 Bitangent;
+    //bone indexes which will influence this vertex
+    int m_BoneIDs[MAX_BONE_INFLUENCE];
+    //weights from each bone
+    float m_Weights[MAX_BONE_INFLUENCE];
+};
+
+// set the vertex attribute pointers of the Vertex layout for the bound VAO and GL_ARRAY_BUFFER
+inline void setupVertexAttributes()
+{
+    // vertex Positions
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    // vertex normals
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+    // vertex texture coords
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+    // vertex tangent
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+    // vertex bitangent
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+    // ids
+    glEnableVertexAttribArray(5);
+    glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
+
+    // weights
+    glEnableVertexAttribArray(6);
+    glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
+}
+
+// Compact vertex formats a mesh can be uploaded with instead of the 88 byte Vertex above. Flags combine:
+//   VERTEX_COMPACT      float position, octahedral normal (2 x snorm16), octahedral tangent with the
+//                       bitangent sign in w (4 x snorm8), half-float uv                        -> 24 bytes
+//   VERTEX_QUANTIZED    + 16 bit unorm positions, dequantized with the mesh's positionScale/positionBias -> 20 bytes
+//   VERTEX_SKINNED      + 4 x uint8 bone ids and 4 x unorm8 weights                                 -> +8 bytes
+// Attribute locations keep their meaning (0 position, 1 normal, 2 uv, 3 tangent, 5 ids, 6 weights);
+// 4 (bitangent) is not provided. A vertex shader reading a compact mesh decodes it like this:
+//
+//     vec3 octDecode(vec2 e)
+//     {
+//         vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+//         if (n.z < 0.0)
+//             n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+//         return normalize(n);
+//     }
+//     vec3 position  = aPos * positionScale + positionBias;   // quantized only, see shader.vs
+//     vec3 normal    = octDecode(aNormal.xy);
+//     vec3 tangent   = octDecode(aTangent.xy);
+//     vec3 bitangent = cross(normal, tangent) * aTangent.w;
+enum VertexFormatFlags {
+    VERTEX_FULL = 0,
+    VERTEX_COMPACT = 1,
+    VERTEX_QUANTIZED = 2,
+    VERTEX_SKINNED = 4
+};
+
+// byte layout of one packed vertex for a combination of format flags
+struct PackedVertexLayout {
+    GLsizei stride;
+    size_t position, normal, tangent, texCoords, boneIDs, weights;
+
+    explicit PackedVertexLayout(unsigned int format)
+    {
+        position = 0;
+        normal = (format & VERTEX_QUANTIZED) ? 8 : 12;
+        tangent = normal + 4;
+        texCoords = tangent + 4;
+        boneIDs = texCoords + 4;
+        weights = boneIDs + 4;
+        stride = static_cast<GLsizei>((format & VERTEX_SKINNED) ? weights + 4 : boneIDs);
+    }
+};
+
+// octahedral mapping of a unit vector onto the [-1, 1] square; a zero vector (a normal that was never
+// computed) encodes as +z rather than dividing by zero
+inline glm::vec2 octEncode(glm::vec3 n)
+{
+    float length = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    if (length <= 0.0f)
+        return glm::vec2(0.0f);
+    n /= length;
+    glm::vec2 e(n.x, n.y);
+    if (n.z < 0.0f)
+    {
+        e.x = (1.0f - std::fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+        e.y = (1.0f - std::fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return e;
+}
+
+// pack vertices into the compact format; scale/bias receive the position dequantization (identity if not quantized)
+inline std::vector<unsigned char> packVertices(const Vertex* vertices, size_t count, unsigned int format, glm::vec3& scale, glm::vec3& bias)
+{
+    PackedVertexLayout layout(format);
+    std::vector<unsigned char> packed(count * layout.stride);
+
+    scale = glm::vec3(1.0f);
+    bias = glm::vec3(0.0f);
+    if ((format & VERTEX_QUANTIZED) && count > 0)
+    {
+        glm::vec3 minPos = vertices[0].Position, maxPos = vertices[0].Position;
+        for (size_t i = 1; i < count; i++)
+        {
+            minPos = glm::min(minPos, vertices[i].Position);
+            maxPos = glm::max(maxPos, vertices[i].Position);
+        }
+        bias = minPos;
+        scale = glm::max(maxPos - minPos, glm::vec3(1e-6f));
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const Vertex& v = vertices[i];
+        unsigned char* out = &packed[i * layout.stride];
+
+        if (format & VERTEX_QUANTIZED)
+        {
+            glm::vec3 unit = (v.Position - bias) / scale;
+            uint16_t p[4] = { glm::packUnorm1x16(unit.x), glm::packUnorm1x16(unit.y), glm::packUnorm1x16(unit.z), 0 };
+            std::memcpy(out + layout.position, p, sizeof(p));
+        }
+        else
+            std::memcpy(out + layout.position, &v.Position, sizeof(glm::vec3));
+
+        glm::vec2 n = octEncode(v.Normal);
+        uint16_t normal[2] = { glm::packSnorm1x16(n.x), glm::packSnorm1x16(n.y) };
+        std::memcpy(out + layout.normal, normal, sizeof(normal));
+
+        // tangent frames that were never computed (zero vectors) encode as +x
+        glm::vec3 t = glm::dot(v.Tangent, v.Tangent) > 0.0f ? v.Tangent : glm::vec3(1.0f, 0.0f, 0.0f);
+        glm::vec2 te = octEncode(t);
+        float handedness = glm::dot(glm::cross(v.Normal, t), v.Bitangent) < 0.0f ? -1.0f : 1.0f;
+        uint8_t tangent[4] = { glm::packSnorm1x8(te.x), glm::packSnorm1x8(te.y), 0, glm::packSnorm1x8(handedness) };
+        std::memcpy(out + layout.tangent, tangent, sizeof(tangent));
+
+        uint16_t uv[2] = { glm::packHalf1x16(v.TexCoords.x), glm::packHalf1x16(v.TexCoords.y) };
+        std::memcpy(out + layout.texCoords, uv, sizeof(uv));
+
+        if (format & VERTEX_SKINNED)
+        {
+            for (int b = 0; b < MAX_BONE_INFLUENCE; b++)
+            {
+                out[layout.boneIDs + b] = static_cast<unsigned char>(v.m_BoneIDs[b] < 0 ? 0 : (v.m_BoneIDs[b] > 255 ? 255 : v.m_BoneIDs[b]));
+                out[layout.weights + b] = glm::packUnorm1x8(v.m_Weights[b]);
+            }
+        }
+    }
+    return packed;
+}
+inline std::vector<unsigned char> packVertices(const std::vector<Vertex>& vertices, unsigned int format, glm::vec3& scale, glm::vec3& bias)
+{
+    return packVertices(vertices.data(), vertices.size(), format, scale, bias);
+}
+
+// attribute pointers of a packed format for the bound VAO and GL_ARRAY_BUFFER
+inline void setupPackedVertexAttributes(unsigned int format)
+{
+    PackedVertexLayout layout(format);
+    glEnableVertexAttribArray(0);
+    if (format & VERTEX_QUANTIZED)
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, layout.stride, (void*)layout.position);
+    else
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, layout.stride, (void*)layout.position);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, layout.stride, (void*)layout.normal);
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, layout.stride, (void*)layout.texCoords);
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 4, GL_BYTE, GL_TRUE, layout.stride, (void*)layout.tangent);
+    if (format & VERTEX_SKINNED)
+    {
+        glEnableVertexAttribArray(5);
+        glVertexAttribIPointer(5, 4, GL_UNSIGNED_BYTE, layout.stride, (void*)layout.boneIDs);
+        glEnableVertexAttribArray(6);
+        glVertexAttribPointer(6, 4, GL_UNSIGNED_BYTE, GL_TRUE, layout.stride, (void*)layout.weights);
+    }
+}
+
+#endif